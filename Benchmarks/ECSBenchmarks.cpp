@@ -0,0 +1,1488 @@
+#include "PCH.h"
+#include "ECS/MortonCode.h"
+#include "ECS/Registry.h"
+#include "ECS/WorldScheduler.h"
+#include "EventManager/EventManager.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BENCHMARK_SSE 1
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef ENGINE_VERSION
+#define ENGINE_VERSION "unknown"
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// Benchmark components, tags, and events, shaped like typical gameplay data.
+struct PositionComponent { float X = 0.0f, Y = 0.0f, Z = 0.0f; };
+struct VelocityComponent { float X = 1.0f, Y = 1.0f, Z = 1.0f; };
+struct HealthComponent { int Value = 100; };
+struct ParticleComponent { float X = 0.0f, Y = 0.0f, Z = 0.0f, Age = 0.0f; };
+struct MaterialComponent { uint32_t Mesh = 0, Shader = 0; };
+struct SelectedTag {};
+struct DamageEvent { Entity Target; int Amount; };
+struct HealEvent { Entity Target; int Amount; };
+
+// Portable stand-ins for the engine's transform and physics components, whose DirectXMath types only build on Windows. The
+// unaligned transform is the XMFLOAT4X4 layout transforms had before they were stored as XMFLOAT4X4A.
+struct alignas(16) Float4x4A { float M[4][4]; };
+struct TransformComponent { Float4x4A Transform = { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } }; };
+struct Float4x4 { float M[4][4]; };
+struct UnalignedTransformComponent { Float4x4 Transform = { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } }; };
+struct PhysicsComponent { float LinearVelocity[3] = { 1.0f, 0.0f, 0.0f }; float AngularVelocity[3] = { 0.0f, 90.0f, 0.0f }; };
+
+// A family of component types for the system matching benchmarks, which put a varying number of component types to use.
+template<size_t Index> struct MatchingComponent { uint32_t Value = Index; };
+
+// Particles live in virtual memory storage, to compare it against the default heap storage.
+template<> struct ComponentStorage<ParticleComponent> : VirtualComponentStorage<ParticleComponent> {};
+
+// Materials are shared components, so they need an equality operator and a hash.
+inline bool operator==(const MaterialComponent& left, const MaterialComponent& right) { return left.Mesh == right.Mesh && left.Shader == right.Shader; }
+namespace std { template<> struct hash<MaterialComponent> { size_t operator()(const MaterialComponent& material) const { return material.Mesh * 31 + material.Shader; } }; }
+
+// The number of entities, components, tags, or events each benchmark processes in one repetition.
+constexpr size_t BENCHMARK_COUNTS[] = { 1000, 10000, 100000, 1000000 };
+
+// Small runs repeat more often, to even out timer resolution and scheduling noise.
+constexpr size_t BENCHMARK_MIN_REPETITIONS = 3;
+constexpr size_t BENCHMARK_MAX_REPETITIONS = 20;
+constexpr size_t BENCHMARK_OPERATIONS_PER_RUN = 1000000;
+
+// The number of distinct materials the shared component benchmarks spread the entities over.
+constexpr uint32_t BENCHMARK_MATERIAL_COUNT = 64;
+
+// The number of independent worlds the entities are spread over by the world benchmarks.
+constexpr size_t BENCHMARK_WORLD_COUNT = 16;
+
+// The spatial benchmarks scatter entities this far apart on average, and quantize positions to cells of this size.
+constexpr float BENCHMARK_ENTITY_SPACING = 2.0f;
+constexpr float BENCHMARK_MORTON_CELL_SIZE = 4.0f;
+
+// The number of spatial neighbours every entity reads in the proximity benchmarks.
+constexpr size_t BENCHMARK_NEIGHBOUR_COUNT = 8;
+
+// The number of listeners subscribed to every event type in the event dispatch benchmarks.
+constexpr size_t BENCHMARK_LISTENER_COUNT = 8;
+
+// The number of entities the physics benchmarks integrate, and the time step they integrate over.
+constexpr size_t BENCHMARK_PHYSICS_COUNT = 1000000;
+constexpr float BENCHMARK_PHYSICS_TIME_STEP = 1.0f / 60.0f;
+
+// The numbers of component types the system matching benchmarks spread their entities and systems over. The largest count
+// leaves room under COMPONENT_COUNT for the other benchmark components.
+constexpr size_t BENCHMARK_MATCHING_TYPE_COUNTS[] = { 16, 64, 224 };
+constexpr size_t BENCHMARK_MATCHING_MAX_TYPE_COUNT = 224;
+constexpr size_t BENCHMARK_MATCHING_SYSTEM_COUNT = 32;
+constexpr size_t BENCHMARK_MATCHING_ENTITY_COUNT = 100000;
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// The timings of one benchmark at one scale, per operation.
+struct BenchmarkResult
+{
+	std::string Name;
+	std::string Storage;		// The registry storage mode, empty for benchmarks that do not touch the registry.
+	size_t Count = 0;
+	size_t ThreadCount = 0;		// The threads of the job system the benchmark ran with.
+	size_t Repetitions = 0;
+	double MinNanoseconds = 0.0;
+	double MedianNanoseconds = 0.0;
+	double MedianCacheMisses = -1.0;	// The median cache misses per operation, negative when no hardware counter is available.
+};
+
+// Counts the cache misses of the calling thread, on platforms exposing hardware counters to user code. Misses of work the
+// job system runs on other threads are not counted.
+class CacheMissCounter final
+{
+	NO_COPY(CacheMissCounter);
+	NO_MOVE(CacheMissCounter);
+
+public:
+	CacheMissCounter();
+	~CacheMissCounter();
+
+	bool IsAvailable() const { return m_fileDescriptor >= 0; }
+	void Start();
+	uint64_t Stop();
+
+private:
+	int m_fileDescriptor = -1;
+};
+
+#if defined(__linux__)
+
+CacheMissCounter::CacheMissCounter()
+{
+	// Count user space misses of the last level cache on this thread, on any processor. This fails in most virtual
+	// machines and containers, and when the kernel does not allow unprivileged profiling.
+	perf_event_attr attributes;
+	std::memset(&attributes, 0, sizeof(attributes));
+	attributes.type = PERF_TYPE_HARDWARE;
+	attributes.size = sizeof(attributes);
+	attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+	attributes.disabled = 1;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv = 1;
+	m_fileDescriptor = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+}
+
+CacheMissCounter::~CacheMissCounter()
+{
+	if (m_fileDescriptor >= 0)
+	{
+		close(m_fileDescriptor);
+	}
+}
+
+void CacheMissCounter::Start()
+{
+	ioctl(m_fileDescriptor, PERF_EVENT_IOC_RESET, 0);
+	ioctl(m_fileDescriptor, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+uint64_t CacheMissCounter::Stop()
+{
+	ioctl(m_fileDescriptor, PERF_EVENT_IOC_DISABLE, 0);
+
+	uint64_t misses = 0;
+	return read(m_fileDescriptor, &misses, sizeof(misses)) == sizeof(misses) ? misses : 0;
+}
+
+#else
+
+CacheMissCounter::CacheMissCounter() {}
+CacheMissCounter::~CacheMissCounter() {}
+void CacheMissCounter::Start() {}
+uint64_t CacheMissCounter::Stop() { return 0; }
+
+#endif
+
+// Accumulates values read by the timed code, so the compiler cannot discard the work.
+static volatile size_t g_benchmarkSink = 0;
+
+// Receives the events emitted by the event benchmarks.
+class DamageListener final
+{
+public:
+	void OnDamage(const DamageEvent& event) { m_totalDamage += static_cast<size_t>(event.Amount); }
+	void OnHeal(const HealEvent& event) { m_totalDamage -= static_cast<size_t>(event.Amount); }
+	size_t GetTotalDamage() const { return m_totalDamage; }
+
+private:
+	size_t m_totalDamage = 0;
+};
+
+// Integrates positions, the update every world of the world benchmarks runs.
+class MovementSystem final : public ISystem
+{
+public:
+	MovementSystem(Registry& registry) : ISystem(registry)
+	{
+		RequireWrite<PositionComponent>();
+		RequireRead<VelocityComponent>();
+	}
+
+	void Initialize() override {}
+	void Render() override {}
+
+	void Update(float deltaTime) override
+	{
+		m_registry.View<PositionComponent, const VelocityComponent>().Each([deltaTime](Entity, PositionComponent& position, const VelocityComponent& velocity)
+		{
+			position.X += velocity.X * deltaTime;
+			position.Y += velocity.Y * deltaTime;
+			position.Z += velocity.Z * deltaTime;
+		});
+	}
+};
+
+class MatchingSystem;
+
+// Adds, removes and requires the matching component of a given index, which is only known at run time.
+struct MatchingComponentOperations
+{
+	void (*Add)(Registry& registry, Entity entity);
+	void (*Remove)(Registry& registry, Entity entity);
+	void (*Require)(MatchingSystem& system);
+};
+
+// The component types the next matching system requires.
+static size_t g_matchingSystemComponents[2] = {};
+
+// Requires two matching components, and does nothing else. Only the cost of matching entities against it is measured.
+class MatchingSystem final : public ISystem
+{
+public:
+	MatchingSystem(Registry& registry);
+
+	void Initialize() override {}
+	void Update(float) override {}
+	void Render() override {}
+
+	template<size_t Index> void RequireMatchingComponent() { RequireRead<MatchingComponent<Index>>(); }
+};
+
+template<size_t Index>
+static MatchingComponentOperations MakeMatchingComponentOperations()
+{
+	MatchingComponentOperations operations;
+	operations.Add = [](Registry& registry, Entity entity) { registry.AddComponent(entity, MatchingComponent<Index>(), RequestPriority::Immediate); };
+	operations.Remove = [](Registry& registry, Entity entity) { registry.RemoveComponent<MatchingComponent<Index>>(entity, RequestPriority::Immediate); };
+	operations.Require = [](MatchingSystem& system) { system.RequireMatchingComponent<Index>(); };
+	return operations;
+}
+
+template<size_t... Indices>
+static std::vector<MatchingComponentOperations> MakeMatchingComponentOperations(std::index_sequence<Indices...>)
+{
+	return { MakeMatchingComponentOperations<Indices>()... };
+}
+
+static const std::vector<MatchingComponentOperations>& GetMatchingComponentOperations()
+{
+	static const std::vector<MatchingComponentOperations> operations = MakeMatchingComponentOperations(std::make_index_sequence<BENCHMARK_MATCHING_MAX_TYPE_COUNT>());
+	return operations;
+}
+
+MatchingSystem::MatchingSystem(Registry& registry) : ISystem(registry)
+{
+	for (const size_t componentIndex : g_matchingSystemComponents)
+	{
+		GetMatchingComponentOperations()[componentIndex].Require(*this);
+	}
+}
+
+// The component set backend the sparse set replaced, kept to compare the two. Two hash maps link entities and dense indices.
+template<typename TComponent>
+class MapComponentSet final
+{
+public:
+	void AddComponent(Entity entity, const TComponent& component)
+	{
+		m_entityIdToIndexMap[entity] = m_packedComponentData.size();
+		m_indexToEntityIdMap[m_packedComponentData.size()] = entity;
+		m_packedComponentData.push_back(component);
+	}
+
+	const TComponent& GetComponentRead(Entity entity) const { return m_packedComponentData[m_entityIdToIndexMap.find(entity)->second]; }
+	Entity GetEntity(size_t index) const { return m_indexToEntityIdMap.find(index)->second; }
+	const TComponent& GetPackedComponentRead(size_t index) const { return m_packedComponentData[index]; }
+	size_t GetSize() const { return m_packedComponentData.size(); }
+
+private:
+	std::unordered_map<Entity, size_t> m_entityIdToIndexMap;
+	std::unordered_map<size_t, Entity> m_indexToEntityIdMap;
+	std::vector<TComponent> m_packedComponentData;
+};
+
+// The event manager the handler tables replaced, kept to compare the two. Handlers are virtual, and both handlers and pending
+// events are found through hash maps.
+class MapEventManager final
+{
+public:
+	template<typename TEvent, typename TOwner>
+	void SubscribeToEvent(TOwner* owner, void(TOwner::* callback)(const TEvent& event))
+	{
+		m_eventHandlerMap[EventIdGenerator::GetEventId<TEvent>()].emplace_back(new MapEventHandler<TEvent, TOwner>(owner, callback));
+	}
+
+	template<typename TEvent>
+	void EmitEvent(const TEvent& event, EventPriority priority)
+	{
+		const EventId eventId = EventIdGenerator::GetEventId<TEvent>();
+		if (priority == EventPriority::Immediate)
+		{
+			// Run the event through every handler of its type.
+			if (m_eventHandlerMap.find(eventId) != m_eventHandlerMap.end())
+			{
+				for (std::unique_ptr<IMapEventHandler>& eventHandler : m_eventHandlerMap[eventId])
+				{
+					eventHandler->HandleEvent(&event);
+				}
+			}
+			return;
+		}
+
+		// Queue the event with the others of its type.
+		if (m_pendingEventMap.find(eventId) == m_pendingEventMap.end())
+		{
+			m_pendingEventMap[eventId].reset(new MapEventVector<TEvent>());
+		}
+
+		static_cast<MapEventVector<TEvent>*>(m_pendingEventMap[eventId].get())->Events.push_back(event);
+	}
+
+	void Update()
+	{
+		// Run every pending event through every handler of its type, one virtual call per event and handler.
+		for (std::pair<const EventId, std::unique_ptr<IMapEventVector>>& pendingEventPair : m_pendingEventMap)
+		{
+			IMapEventVector& eventVector = *pendingEventPair.second;
+			for (const std::unique_ptr<IMapEventHandler>& eventHandler : m_eventHandlerMap[pendingEventPair.first])
+			{
+				for (size_t index = 0; index < eventVector.GetElementCount(); ++index)
+				{
+					eventHandler->HandleEvent(eventVector.GetEvent(index));
+				}
+			}
+
+			eventVector.Clear();
+		}
+	}
+
+	void Shutdown()
+	{
+		m_eventHandlerMap.clear();
+		m_pendingEventMap.clear();
+	}
+
+private:
+	class IMapEventHandler
+	{
+	public:
+		virtual ~IMapEventHandler() = default;
+		virtual void HandleEvent(const void* event) const = 0;
+	};
+
+	template<typename TEvent, typename TOwner>
+	class MapEventHandler final : public IMapEventHandler
+	{
+	public:
+		MapEventHandler(TOwner* owner, void(TOwner::* callback)(const TEvent& event)) : m_owner(owner), m_callback(callback) {}
+		void HandleEvent(const void* event) const override { (m_owner->*m_callback)(*static_cast<const TEvent*>(event)); }
+
+	private:
+		TOwner* m_owner;
+		void(TOwner::* m_callback)(const TEvent& event);
+	};
+
+	class IMapEventVector
+	{
+	public:
+		virtual ~IMapEventVector() = default;
+		virtual const void* GetEvent(size_t index) const = 0;
+		virtual size_t GetElementCount() const = 0;
+		virtual void Clear() = 0;
+	};
+
+	template<typename TEvent>
+	class MapEventVector final : public IMapEventVector
+	{
+	public:
+		const void* GetEvent(size_t index) const override { return &Events[index]; }
+		size_t GetElementCount() const override { return Events.size(); }
+		void Clear() override { Events.clear(); }
+
+		std::vector<TEvent> Events;
+	};
+
+	std::unordered_map<EventId, std::vector<std::unique_ptr<IMapEventHandler>>> m_eventHandlerMap;
+	std::unordered_map<EventId, std::unique_ptr<IMapEventVector>> m_pendingEventMap;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// A 4x4 matrix held in SIMD registers, a row per register, like an XMMATRIX. Falls back to plain floats without SSE.
+#if defined(BENCHMARK_SSE)
+using MatrixRow = __m128;
+static inline MatrixRow LoadRowAligned(const float* row) { return _mm_load_ps(row); }
+static inline MatrixRow LoadRow(const float* row) { return _mm_loadu_ps(row); }
+static inline void StoreRowAligned(float* row, MatrixRow value) { _mm_store_ps(row, value); }
+static inline void StoreRow(float* row, MatrixRow value) { _mm_storeu_ps(row, value); }
+static inline MatrixRow SetRow(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+static inline MatrixRow SplatRowElement(MatrixRow row, size_t index)
+{
+	switch (index)
+	{
+	case 0: return _mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0));
+	case 1: return _mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1));
+	case 2: return _mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2));
+	default: return _mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+}
+static inline MatrixRow MultiplyAddRows(MatrixRow first, MatrixRow second, MatrixRow sum) { return _mm_add_ps(_mm_mul_ps(first, second), sum); }
+static inline float GetRowElement(MatrixRow row, size_t index) { return _mm_cvtss_f32(SplatRowElement(row, index)); }
+#else
+struct MatrixRow { float V[4]; };
+static inline MatrixRow LoadRowAligned(const float* row) { return { { row[0], row[1], row[2], row[3] } }; }
+static inline MatrixRow LoadRow(const float* row) { return LoadRowAligned(row); }
+static inline void StoreRowAligned(float* row, MatrixRow value) { std::memcpy(row, value.V, sizeof(value.V)); }
+static inline void StoreRow(float* row, MatrixRow value) { StoreRowAligned(row, value); }
+static inline MatrixRow SetRow(float x, float y, float z, float w) { return { { x, y, z, w } }; }
+static inline MatrixRow SplatRowElement(MatrixRow row, size_t index) { return SetRow(row.V[index], row.V[index], row.V[index], row.V[index]); }
+static inline MatrixRow MultiplyAddRows(MatrixRow first, MatrixRow second, MatrixRow sum) { for (size_t index = 0; index < 4; ++index) { sum.V[index] += first.V[index] * second.V[index]; } return sum; }
+static inline float GetRowElement(MatrixRow row, size_t index) { return row.V[index]; }
+#endif
+
+struct Matrix { MatrixRow R[4]; };
+
+static inline Matrix MultiplyMatrices(const Matrix& left, const Matrix& right)
+{
+	// Every result row combines the rows of the right matrix, weighted by the elements of the left row.
+	Matrix result;
+	for (size_t row = 0; row < 4; ++row)
+	{
+		MatrixRow sum = SetRow(0.0f, 0.0f, 0.0f, 0.0f);
+		for (size_t column = 0; column < 4; ++column)
+		{
+			sum = MultiplyAddRows(SplatRowElement(left.R[row], column), right.R[column], sum);
+		}
+
+		result.R[row] = sum;
+	}
+
+	return result;
+}
+
+static inline Matrix MakeTranslation(float x, float y, float z)
+{
+	return { { SetRow(1.0f, 0.0f, 0.0f, 0.0f), SetRow(0.0f, 1.0f, 0.0f, 0.0f), SetRow(0.0f, 0.0f, 1.0f, 0.0f), SetRow(x, y, z, 1.0f) } };
+}
+
+static inline Matrix MakeRotationRollPitchYaw(float pitch, float yaw, float roll)
+{
+	// Roll about z, then pitch about x, then yaw about y, in row vector convention.
+	const float cosPitch = std::cos(pitch), sinPitch = std::sin(pitch);
+	const float cosYaw = std::cos(yaw), sinYaw = std::sin(yaw);
+	const float cosRoll = std::cos(roll), sinRoll = std::sin(roll);
+	return { {
+		SetRow(cosRoll * cosYaw + sinRoll * sinPitch * sinYaw, sinRoll * cosPitch, sinRoll * sinPitch * cosYaw - cosRoll * sinYaw, 0.0f),
+		SetRow(cosRoll * sinPitch * sinYaw - sinRoll * cosYaw, cosRoll * cosPitch, sinRoll * sinYaw + cosRoll * sinPitch * cosYaw, 0.0f),
+		SetRow(cosPitch * sinYaw, -sinPitch, cosPitch * cosYaw, 0.0f),
+		SetRow(0.0f, 0.0f, 0.0f, 1.0f)
+	} };
+}
+
+// Rotates a transform about its own position, the first half of the PhysicsSystem::Update integration.
+static inline Matrix RotateTransform(const Matrix& transform, const PhysicsComponent& physics, float deltaTime)
+{
+	const float degreesToRadians = 3.14159265f / 180.0f;
+	const float pitch = physics.AngularVelocity[0] * deltaTime * degreesToRadians;
+	const float yaw = physics.AngularVelocity[1] * deltaTime * degreesToRadians;
+	const float roll = physics.AngularVelocity[2] * deltaTime * degreesToRadians;
+
+	const float x = GetRowElement(transform.R[3], 0), y = GetRowElement(transform.R[3], 1), z = GetRowElement(transform.R[3], 2);
+	const Matrix rotation = MultiplyMatrices(MultiplyMatrices(MakeTranslation(-x, -y, -z), MakeRotationRollPitchYaw(pitch, yaw, roll)), MakeTranslation(x, y, z));
+	return MultiplyMatrices(transform, rotation);
+}
+
+// Translates a transform by its linear velocity, the second half of the PhysicsSystem::Update integration.
+static inline Matrix TranslateTransform(const Matrix& transform, const PhysicsComponent& physics, float deltaTime)
+{
+	return MultiplyMatrices(transform, MakeTranslation(physics.LinearVelocity[0] * deltaTime, physics.LinearVelocity[1] * deltaTime, physics.LinearVelocity[2] * deltaTime));
+}
+
+static inline void IntegrateTransform(TransformComponent& transformComponent, const PhysicsComponent& physics, float deltaTime)
+{
+	// Load the aligned transform once, like XMLoadFloat4x4A, and store it back once.
+	float (*rows)[4] = transformComponent.Transform.M;
+	Matrix transform = { { LoadRowAligned(rows[0]), LoadRowAligned(rows[1]), LoadRowAligned(rows[2]), LoadRowAligned(rows[3]) } };
+	transform = TranslateTransform(RotateTransform(transform, physics, deltaTime), physics, deltaTime);
+	for (size_t row = 0; row < 4; ++row)
+	{
+		StoreRowAligned(rows[row], transform.R[row]);
+	}
+}
+
+static inline void IntegrateUnalignedTransform(UnalignedTransformComponent& transformComponent, const PhysicsComponent& physics, float deltaTime)
+{
+	// The integration before transforms were aligned. Each half loads the transform like XMLoadFloat4x4, and stores it back.
+	float (*rows)[4] = transformComponent.Transform.M;
+	Matrix transform = { { LoadRow(rows[0]), LoadRow(rows[1]), LoadRow(rows[2]), LoadRow(rows[3]) } };
+	transform = RotateTransform(transform, physics, deltaTime);
+	for (size_t row = 0; row < 4; ++row)
+	{
+		StoreRow(rows[row], transform.R[row]);
+	}
+
+	transform = { { LoadRow(rows[0]), LoadRow(rows[1]), LoadRow(rows[2]), LoadRow(rows[3]) } };
+	transform = TranslateTransform(transform, physics, deltaTime);
+	for (size_t row = 0; row < 4; ++row)
+	{
+		StoreRow(rows[row], transform.R[row]);
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+static const char* GetStorageName(StorageMode storageMode)
+{
+	return storageMode == StorageMode::Archetype ? "archetype" : "sparse_set";
+}
+
+static void ResetRegistry(StorageMode storageMode)
+{
+	// Every repetition starts from an empty registry in the requested storage mode.
+	Registry& registry = Registry::GetInstanceWrite();
+	registry.Shutdown();
+	registry.SetStorageMode(storageMode);
+}
+
+static void CreateEntities(size_t count, std::vector<Entity>& entities)
+{
+	// Create plain entities, without any components.
+	Registry& registry = Registry::GetInstanceWrite();
+	entities.clear();
+	entities.reserve(count);
+	for (size_t index = 0; index < count; ++index)
+	{
+		entities.push_back(registry.CreateEntity());
+	}
+}
+
+static void CreateMovingEntities(size_t count, std::vector<Entity>& entities)
+{
+	// Create entities carrying a position and a velocity, and settle their system membership.
+	Registry& registry = Registry::GetInstanceWrite();
+	EntityPrototype prototype;
+	prototype.AddComponent(PositionComponent());
+	prototype.AddComponent(VelocityComponent());
+	entities = registry.CreateEntities(count, prototype);
+	registry.ProcessPendingEntities();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// Runs the benchmark a number of times, preparing every repetition with the setup function and timing only the run function.
+template<typename TSetup, typename TRun>
+static void RunBenchmark(std::vector<BenchmarkResult>& results, const char* name, const char* storage, size_t count, TSetup setup, TRun run)
+{
+	const size_t repetitions = std::max(BENCHMARK_MIN_REPETITIONS, std::min(BENCHMARK_MAX_REPETITIONS, BENCHMARK_OPERATIONS_PER_RUN / count));
+
+	// One counter serves every benchmark, opening it is a system call.
+	static CacheMissCounter cacheMissCounter;
+
+	std::vector<double> timings;
+	std::vector<double> cacheMisses;
+	timings.reserve(repetitions);
+	cacheMisses.reserve(repetitions);
+	for (size_t repetition = 0; repetition < repetitions; ++repetition)
+	{
+		setup();
+
+		if (cacheMissCounter.IsAvailable())
+		{
+			cacheMissCounter.Start();
+		}
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		run();
+		const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+		if (cacheMissCounter.IsAvailable())
+		{
+			cacheMisses.push_back(static_cast<double>(cacheMissCounter.Stop()) / static_cast<double>(count));
+		}
+
+		timings.push_back(std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(count));
+	}
+
+	// Report the best repetition, and the median to show how noisy the runs were.
+	std::sort(timings.begin(), timings.end());
+	std::sort(cacheMisses.begin(), cacheMisses.end());
+
+	BenchmarkResult result;
+	result.Name = name;
+	result.Storage = storage;
+	result.Count = count;
+	result.ThreadCount = JobSystem::GetInstanceRead().GetThreadCount();
+	result.Repetitions = repetitions;
+	result.MinNanoseconds = timings.front();
+	result.MedianNanoseconds = timings[timings.size() / 2];
+	result.MedianCacheMisses = cacheMisses.empty() ? -1.0 : cacheMisses[cacheMisses.size() / 2];
+	results.push_back(result);
+
+	std::cerr << name << (*storage ? " " : "") << storage << " x" << count << " on " << result.ThreadCount << " threads: " << result.MinNanoseconds << " ns/op";
+	if (result.MedianCacheMisses >= 0.0)
+	{
+		std::cerr << ", " << result.MedianCacheMisses << " cache misses/op";
+	}
+	else
+	{
+		std::cerr << ", cache misses not measured";
+	}
+
+	std::cerr << std::endl;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+static void RunEntityBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode, size_t count)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+	std::vector<Entity> entities;
+
+	RunBenchmark(results, "entity_create", storage, count,
+		[&]() { ResetRegistry(storageMode); entities.clear(); entities.reserve(count); },
+		[&]()
+		{
+			for (size_t index = 0; index < count; ++index)
+			{
+				entities.push_back(registry.CreateEntity());
+			}
+		});
+
+	RunBenchmark(results, "entity_create_prototype", storage, count,
+		[&]() { ResetRegistry(storageMode); },
+		[&]() { CreateMovingEntities(count, entities); });
+
+	RunBenchmark(results, "entity_destroy", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateMovingEntities(count, entities); },
+		[&]()
+		{
+			for (const Entity entity : entities)
+			{
+				registry.RemoveEntity(entity);
+			}
+
+			registry.ProcessPendingEntities();
+		});
+}
+
+static void RunComponentBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode, size_t count)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+	std::vector<Entity> entities;
+
+	RunBenchmark(results, "component_add_immediate", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateEntities(count, entities); },
+		[&]()
+		{
+			for (const Entity entity : entities)
+			{
+				registry.AddComponent(entity, HealthComponent(), RequestPriority::Immediate);
+			}
+
+			registry.ProcessPendingEntities();
+		});
+
+	RunBenchmark(results, "component_add_immediate_virtual_storage", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateEntities(count, entities); },
+		[&]()
+		{
+			for (const Entity entity : entities)
+			{
+				registry.AddComponent(entity, ParticleComponent(), RequestPriority::Immediate);
+			}
+
+			registry.ProcessPendingEntities();
+		});
+
+	RunBenchmark(results, "component_add_deferred", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateEntities(count, entities); },
+		[&]()
+		{
+			for (const Entity entity : entities)
+			{
+				registry.AddComponent(entity, HealthComponent(), RequestPriority::Deferred);
+			}
+
+			registry.ProcessPendingComponents();
+			registry.ProcessPendingEntities();
+		});
+
+	RunBenchmark(results, "component_remove_immediate", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateMovingEntities(count, entities); },
+		[&]()
+		{
+			for (const Entity entity : entities)
+			{
+				registry.RemoveComponent<VelocityComponent>(entity, RequestPriority::Immediate);
+			}
+
+			registry.ProcessPendingEntities();
+		});
+
+	RunBenchmark(results, "component_remove_deferred", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateMovingEntities(count, entities); },
+		[&]()
+		{
+			for (const Entity entity : entities)
+			{
+				registry.RemoveComponent<VelocityComponent>(entity, RequestPriority::Deferred);
+			}
+
+			registry.ProcessPendingComponents();
+			registry.ProcessPendingEntities();
+		});
+}
+
+static void RunIterationBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode, size_t count)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+	std::vector<Entity> entities;
+
+	// The world is only read and written in place, so it is built once for every repetition.
+	ResetRegistry(storageMode);
+	CreateMovingEntities(count, entities);
+
+	RunBenchmark(results, "iterate_single", storage, count,
+		[]() {},
+		[&]()
+		{
+			size_t visited = 0;
+			registry.View<const PositionComponent>().Each([&visited](Entity, const PositionComponent& position)
+			{
+				visited += position.X >= 0.0f;
+			});
+
+			g_benchmarkSink = g_benchmarkSink + visited;
+		});
+
+	RunBenchmark(results, "iterate_multi", storage, count,
+		[]() {},
+		[&]()
+		{
+			registry.View<PositionComponent, const VelocityComponent>().Each([](Entity, PositionComponent& position, const VelocityComponent& velocity)
+			{
+				position.X += velocity.X;
+				position.Y += velocity.Y;
+				position.Z += velocity.Z;
+			});
+		});
+}
+
+static void RunSharedComponentBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode, size_t count)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+	std::vector<Entity> entities;
+
+	// Materials are assigned round robin, so neighbouring entities never share one.
+	const auto getMaterial = [](size_t index) { return MaterialComponent{ static_cast<uint32_t>(index % BENCHMARK_MATERIAL_COUNT), 1 }; };
+
+	RunBenchmark(results, "shared_component_add_immediate", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateEntities(count, entities); },
+		[&]()
+		{
+			for (size_t index = 0; index < entities.size(); ++index)
+			{
+				registry.AddSharedComponent(entities[index], getMaterial(index), RequestPriority::Immediate);
+			}
+
+			registry.ProcessPendingEntities();
+		});
+
+	// The grouping benchmark only reads the world, so it is built once for every repetition.
+	ResetRegistry(storageMode);
+	CreateMovingEntities(count, entities);
+	for (size_t index = 0; index < entities.size(); ++index)
+	{
+		registry.AddSharedComponent(entities[index], getMaterial(index), RequestPriority::Immediate);
+	}
+
+	registry.ProcessPendingEntities();
+
+	RunBenchmark(results, "shared_component_group", storage, count,
+		[]() {},
+		[&]()
+		{
+			size_t visited = 0;
+			registry.ForEachSharedComponentGroup<MaterialComponent, PositionComponent>([&visited](const MaterialComponent& material, const Entity*, size_t entityCount)
+			{
+				visited += material.Shader * entityCount;
+			});
+
+			g_benchmarkSink = g_benchmarkSink + visited;
+		});
+}
+
+static uint64_t GetPositionMortonCode(const PositionComponent& position)
+{
+	return GetMortonCode(position.X, position.Y, position.Z, BENCHMARK_MORTON_CELL_SIZE);
+}
+
+static void CreateScatteredEntities(size_t count, std::vector<Entity>& entities)
+{
+	// Scatter positions uniformly over a cube holding the entities at the benchmark spacing.
+	Registry& registry = Registry::GetInstanceWrite();
+	const float extent = std::cbrt(static_cast<float>(count)) * BENCHMARK_ENTITY_SPACING;
+	std::mt19937 random(static_cast<uint32_t>(count));
+	std::uniform_real_distribution<float> coordinate(0.0f, extent);
+
+	entities.clear();
+	entities.reserve(count);
+	for (size_t index = 0; index < count; ++index)
+	{
+		const Entity entity = registry.CreateEntity();
+		registry.AddComponent(entity, PositionComponent{ coordinate(random), coordinate(random), coordinate(random) }, RequestPriority::Immediate);
+		entities.push_back(entity);
+	}
+
+	// Add the velocities in another order, like components added over the lifetime of a game.
+	std::vector<Entity> shuffledEntities = entities;
+	std::shuffle(shuffledEntities.begin(), shuffledEntities.end(), random);
+	for (const Entity entity : shuffledEntities)
+	{
+		registry.AddComponent(entity, VelocityComponent(), RequestPriority::Immediate);
+	}
+
+	registry.ProcessPendingEntities();
+}
+
+static void OrderEntitiesSpatially()
+{
+	// Request the Morton order, and keep updating until a finished sort was applied.
+	Registry& registry = Registry::GetInstanceWrite();
+	registry.RequestComponentOrder<PositionComponent>(GetPositionMortonCode);
+	while (registry.IsComponentOrderPending())
+	{
+		std::this_thread::yield();
+		registry.RunSystemsUpdate(0.0f);
+	}
+}
+
+static void RunSpatialBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode, size_t count)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+	std::vector<Entity> entities;
+
+	RunBenchmark(results, "spatial_order", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateScatteredEntities(count, entities); },
+		[&]() { OrderEntitiesSpatially(); });
+
+	// Culling visits every entity in storage order, and tests its position against a box covering a corner of the world.
+	const float extent = std::cbrt(static_cast<float>(count)) * BENCHMARK_ENTITY_SPACING;
+	const auto cull = [&registry, extent]()
+	{
+		size_t visible = 0;
+		registry.View<const PositionComponent, const VelocityComponent>().Each([&visible, extent](Entity, const PositionComponent& position, const VelocityComponent& velocity)
+		{
+			const float halfExtent = extent * 0.5f;
+			visible += position.X + velocity.X < halfExtent && position.Y + velocity.Y < halfExtent && position.Z + velocity.Z < halfExtent;
+		});
+
+		g_benchmarkSink = g_benchmarkSink + visible;
+	};
+
+	// The proximity pass walks the entities through space, and reads the positions of the next few neighbours of each.
+	std::vector<Entity> spatialEntities;
+	const auto approach = [&registry, &spatialEntities]()
+	{
+		float distanceSum = 0.0f;
+		for (size_t index = 0; index + BENCHMARK_NEIGHBOUR_COUNT < spatialEntities.size(); ++index)
+		{
+			const PositionComponent& position = registry.GetComponentRead<PositionComponent>(spatialEntities[index]);
+			for (size_t neighbour = 1; neighbour <= BENCHMARK_NEIGHBOUR_COUNT; ++neighbour)
+			{
+				const PositionComponent& neighbourPosition = registry.GetComponentRead<PositionComponent>(spatialEntities[index + neighbour]);
+				distanceSum += std::abs(neighbourPosition.X - position.X) + std::abs(neighbourPosition.Y - position.Y) + std::abs(neighbourPosition.Z - position.Z);
+			}
+		}
+
+		g_benchmarkSink = g_benchmarkSink + static_cast<size_t>(distanceSum);
+	};
+
+	// Measure both passes before and after ordering the same world.
+	ResetRegistry(storageMode);
+	CreateScatteredEntities(count, entities);
+
+	std::vector<std::pair<uint64_t, Entity>> sortedEntities;
+	for (const Entity entity : entities)
+	{
+		sortedEntities.emplace_back(GetPositionMortonCode(registry.GetComponentRead<PositionComponent>(entity)), entity);
+	}
+
+	std::sort(sortedEntities.begin(), sortedEntities.end());
+	for (const std::pair<uint64_t, Entity>& sortedEntity : sortedEntities)
+	{
+		spatialEntities.push_back(sortedEntity.second);
+	}
+
+	RunBenchmark(results, "culling_unordered", storage, count, []() {}, cull);
+	RunBenchmark(results, "proximity_unordered", storage, count, []() {}, approach);
+
+	OrderEntitiesSpatially();
+
+	RunBenchmark(results, "culling_ordered", storage, count, []() {}, cull);
+	RunBenchmark(results, "proximity_ordered", storage, count, []() {}, approach);
+}
+
+static void RunGroupBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode, size_t count)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+	std::vector<Entity> entities;
+
+	RunBenchmark(results, "group_add", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateScatteredEntities(count, entities); },
+		[&]() { registry.AddGroup<PositionComponent, VelocityComponent>(); });
+
+	const auto integrate = [&registry]()
+	{
+		registry.View<PositionComponent, const VelocityComponent>().Each([](Entity, PositionComponent& position, const VelocityComponent& velocity)
+		{
+			position.X += velocity.X;
+			position.Y += velocity.Y;
+			position.Z += velocity.Z;
+		});
+	};
+
+	// The positions and velocities of the world are stored in unrelated orders until the group co-sorts them.
+	ResetRegistry(storageMode);
+	CreateScatteredEntities(count, entities);
+	RunBenchmark(results, "group_iterate_ungrouped", storage, count, []() {}, integrate);
+
+	registry.AddGroup<PositionComponent, VelocityComponent>();
+	RunBenchmark(results, "group_iterate", storage, count, []() {}, integrate);
+
+	RunBenchmark(results, "group_iterate_chunk", storage, count,
+		[]() {},
+		[&]()
+		{
+			registry.View<PositionComponent, const VelocityComponent>().EachChunk([](size_t entityCount, const Entity*, PositionComponent* positions, const VelocityComponent* velocities)
+			{
+				for (size_t index = 0; index < entityCount; ++index)
+				{
+					positions[index].X += velocities[index].X;
+					positions[index].Y += velocities[index].Y;
+					positions[index].Z += velocities[index].Z;
+				}
+			});
+		});
+}
+
+static void RunTagBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode, size_t count)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+	std::vector<Entity> entities;
+
+	RunBenchmark(results, "tag_add", storage, count,
+		[&]() { ResetRegistry(storageMode); CreateEntities(count, entities); },
+		[&]()
+		{
+			for (const Entity entity : entities)
+			{
+				registry.AddTag<SelectedTag>(entity, RequestPriority::Immediate);
+			}
+		});
+
+	RunBenchmark(results, "tag_remove", storage, count,
+		[&]()
+		{
+			ResetRegistry(storageMode);
+			CreateEntities(count, entities);
+			for (const Entity entity : entities)
+			{
+				registry.AddTag<SelectedTag>(entity, RequestPriority::Immediate);
+			}
+		},
+		[&]()
+		{
+			for (const Entity entity : entities)
+			{
+				registry.RemoveTag<SelectedTag>(entity, RequestPriority::Immediate);
+			}
+		});
+
+	// Tag every other entity, so the queries see both outcomes.
+	ResetRegistry(storageMode);
+	CreateEntities(count, entities);
+	for (size_t index = 0; index < count; index += 2)
+	{
+		registry.AddTag<SelectedTag>(entities[index], RequestPriority::Immediate);
+	}
+
+	RunBenchmark(results, "tag_query", storage, count,
+		[]() {},
+		[&]()
+		{
+			size_t tagged = 0;
+			for (const Entity entity : entities)
+			{
+				tagged += registry.HaveTag<SelectedTag>(entity);
+			}
+
+			g_benchmarkSink = g_benchmarkSink + tagged;
+		});
+
+	RunBenchmark(results, "tag_iterate", storage, count,
+		[]() {},
+		[&]()
+		{
+			size_t tagged = 0;
+			for (const Entity entity : registry.GetEntitiesWithTag<SelectedTag>())
+			{
+				tagged += GetEntityIndex(entity);
+			}
+
+			g_benchmarkSink = g_benchmarkSink + tagged;
+		});
+}
+
+static void RunWorldBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode, size_t count)
+{
+	const char* storage = GetStorageName(storageMode);
+
+	// Spread the entities evenly over independent worlds, each running its own movement system.
+	std::vector<std::unique_ptr<Registry>> worlds;
+	WorldScheduler worldScheduler;
+	for (size_t worldIndex = 0; worldIndex < BENCHMARK_WORLD_COUNT; ++worldIndex)
+	{
+		worlds.push_back(std::make_unique<Registry>());
+		Registry& world = *worlds.back();
+		world.SetStorageMode(storageMode);
+		world.AddSystem<MovementSystem>();
+
+		EntityPrototype prototype;
+		prototype.AddComponent(PositionComponent());
+		prototype.AddComponent(VelocityComponent());
+		world.CreateEntities(std::max<size_t>(count / BENCHMARK_WORLD_COUNT, 1), prototype);
+		worldScheduler.AddWorld(world);
+	}
+
+	worldScheduler.RunWorldsInitialize();
+
+	RunBenchmark(results, "worlds_update_serial", storage, count,
+		[]() {},
+		[&]()
+		{
+			for (const std::unique_ptr<Registry>& world : worlds)
+			{
+				world->RunSystemsUpdate(1.0f / 60.0f);
+			}
+		});
+
+	RunBenchmark(results, "worlds_update_scheduled", storage, count,
+		[]() {},
+		[&]() { worldScheduler.RunWorldsUpdate(1.0f / 60.0f); });
+}
+
+static void RunPhysicsScalingBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	JobSystem& jobSystem = JobSystem::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+
+	// The world is only written in place, so it is built once for every thread count.
+	ResetRegistry(storageMode);
+	EntityPrototype prototype;
+	prototype.AddComponent(TransformComponent());
+	prototype.AddComponent(PhysicsComponent());
+	registry.CreateEntities(BENCHMARK_PHYSICS_COUNT, prototype);
+	registry.ProcessPendingEntities();
+
+	// Integrate on a single thread, then on twice as many threads each time, up to every hardware thread.
+	const size_t hardwareThreadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	std::vector<size_t> threadCounts;
+	for (size_t threadCount = 1; threadCount < hardwareThreadCount; threadCount *= 2)
+	{
+		threadCounts.push_back(threadCount);
+	}
+
+	threadCounts.push_back(hardwareThreadCount);
+
+	for (const size_t threadCount : threadCounts)
+	{
+		jobSystem.Shutdown();
+		jobSystem.Initialize(threadCount);
+
+		RunBenchmark(results, "physics_parallel_each", storage, BENCHMARK_PHYSICS_COUNT,
+			[]() {},
+			[&registry]()
+			{
+				registry.View<TransformComponent, const PhysicsComponent>().ParallelEach([](Entity, TransformComponent& transform, const PhysicsComponent& physics)
+				{
+					IntegrateTransform(transform, physics, BENCHMARK_PHYSICS_TIME_STEP);
+				});
+			});
+	}
+
+	// Give the remaining benchmarks the default pool back.
+	jobSystem.Shutdown();
+	jobSystem.Initialize();
+}
+
+static void RunPhysicsAlignmentBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+
+	// Integrate transforms stored the way they were before aligned component storage.
+	ResetRegistry(storageMode);
+	EntityPrototype unalignedPrototype;
+	unalignedPrototype.AddComponent(UnalignedTransformComponent());
+	unalignedPrototype.AddComponent(PhysicsComponent());
+	registry.CreateEntities(BENCHMARK_PHYSICS_COUNT, unalignedPrototype);
+	registry.ProcessPendingEntities();
+
+	RunBenchmark(results, "physics_transform_unaligned", storage, BENCHMARK_PHYSICS_COUNT,
+		[]() {},
+		[&registry]()
+		{
+			registry.View<UnalignedTransformComponent, const PhysicsComponent>().ParallelEach([](Entity, UnalignedTransformComponent& transform, const PhysicsComponent& physics)
+			{
+				IntegrateUnalignedTransform(transform, physics, BENCHMARK_PHYSICS_TIME_STEP);
+			});
+		});
+
+	// Then the same number of aligned transforms, loaded and stored once.
+	ResetRegistry(storageMode);
+	EntityPrototype alignedPrototype;
+	alignedPrototype.AddComponent(TransformComponent());
+	alignedPrototype.AddComponent(PhysicsComponent());
+	registry.CreateEntities(BENCHMARK_PHYSICS_COUNT, alignedPrototype);
+	registry.ProcessPendingEntities();
+
+	RunBenchmark(results, "physics_transform_aligned", storage, BENCHMARK_PHYSICS_COUNT,
+		[]() {},
+		[&registry]()
+		{
+			registry.View<TransformComponent, const PhysicsComponent>().ParallelEach([](Entity, TransformComponent& transform, const PhysicsComponent& physics)
+			{
+				IntegrateTransform(transform, physics, BENCHMARK_PHYSICS_TIME_STEP);
+			});
+		});
+}
+
+static void RunSystemMatchingBenchmarks(std::vector<BenchmarkResult>& results, StorageMode storageMode)
+{
+	Registry& registry = Registry::GetInstanceWrite();
+	const char* storage = GetStorageName(storageMode);
+	const std::vector<MatchingComponentOperations>& operations = GetMatchingComponentOperations();
+	std::vector<Entity> entities;
+
+	for (const size_t typeCount : BENCHMARK_MATCHING_TYPE_COUNTS)
+	{
+		// Every system requires two component types, spread over all types in use.
+		ResetRegistry(storageMode);
+		for (size_t systemIndex = 0; systemIndex < BENCHMARK_MATCHING_SYSTEM_COUNT; ++systemIndex)
+		{
+			g_matchingSystemComponents[0] = systemIndex % typeCount;
+			g_matchingSystemComponents[1] = (systemIndex * 7 + typeCount / 2) % typeCount;
+			registry.AddSystem<MatchingSystem>();
+		}
+
+		// Every entity carries four component types a quarter of the types in use apart.
+		CreateEntities(BENCHMARK_MATCHING_ENTITY_COUNT, entities);
+		for (size_t entityIndex = 0; entityIndex < entities.size(); ++entityIndex)
+		{
+			for (size_t component = 0; component < 4; ++component)
+			{
+				operations[(entityIndex + component * typeCount / 4) % typeCount].Add(registry, entities[entityIndex]);
+			}
+		}
+
+		registry.ProcessPendingEntities();
+
+		// Swap the first component type of every entity for one none of its other types collide with, and back on the next
+		// repetition. Only matching the entities against the systems under their new component keys is timed.
+		bool isSwapped = false;
+		const std::string name = "system_matching_" + std::to_string(typeCount) + "_types";
+		RunBenchmark(results, name.c_str(), storage, BENCHMARK_MATCHING_ENTITY_COUNT,
+			[&]()
+			{
+				for (size_t entityIndex = 0; entityIndex < entities.size(); ++entityIndex)
+				{
+					const size_t originalType = entityIndex % typeCount;
+					const size_t swappedType = (entityIndex + typeCount / 8) % typeCount;
+					operations[isSwapped ? swappedType : originalType].Remove(registry, entities[entityIndex]);
+					operations[isSwapped ? originalType : swappedType].Add(registry, entities[entityIndex]);
+				}
+
+				isSwapped = !isSwapped;
+			},
+			[&registry]() { registry.ProcessPendingEntities(); });
+	}
+}
+
+static void RunComponentSetBenchmarks(std::vector<BenchmarkResult>& results, size_t count)
+{
+	// Fill both backends with the same entities, and look them up in an order unrelated to their storage order.
+	ComponentSet<PositionComponent> sparseSet;
+	MapComponentSet<PositionComponent> mapSet;
+	std::vector<Entity> entities;
+	entities.reserve(count);
+	for (size_t index = 0; index < count; ++index)
+	{
+		const Entity entity = MakeEntity(static_cast<uint32_t>(index), 0);
+		const PositionComponent position{ static_cast<float>(index), 0.0f, 0.0f };
+		sparseSet.AddComponent(entity, position, 1);
+		mapSet.AddComponent(entity, position);
+		entities.push_back(entity);
+	}
+
+	std::mt19937 random(static_cast<uint32_t>(count));
+	std::shuffle(entities.begin(), entities.end(), random);
+
+	RunBenchmark(results, "component_set_lookup", "sparse_set", count,
+		[]() {},
+		[&]()
+		{
+			float sum = 0.0f;
+			for (const Entity entity : entities)
+			{
+				sum += sparseSet.GetComponentRead(entity).X;
+			}
+
+			g_benchmarkSink = g_benchmarkSink + static_cast<size_t>(sum);
+		});
+
+	RunBenchmark(results, "component_set_lookup", "unordered_map", count,
+		[]() {},
+		[&]()
+		{
+			float sum = 0.0f;
+			for (const Entity entity : entities)
+			{
+				sum += mapSet.GetComponentRead(entity).X;
+			}
+
+			g_benchmarkSink = g_benchmarkSink + static_cast<size_t>(sum);
+		});
+
+	// Iteration visits every component along with its owning entity, in storage order.
+	RunBenchmark(results, "component_set_iterate", "sparse_set", count,
+		[]() {},
+		[&]()
+		{
+			float sum = 0.0f;
+			const std::vector<Entity>& packedEntities = sparseSet.GetPackedEntities();
+			for (size_t index = 0; index < packedEntities.size(); ++index)
+			{
+				sum += sparseSet.GetPackedComponentWrite(index).X + static_cast<float>(GetEntityIndex(packedEntities[index]));
+			}
+
+			g_benchmarkSink = g_benchmarkSink + static_cast<size_t>(sum);
+		});
+
+	RunBenchmark(results, "component_set_iterate", "unordered_map", count,
+		[]() {},
+		[&]()
+		{
+			float sum = 0.0f;
+			for (size_t index = 0; index < mapSet.GetSize(); ++index)
+			{
+				sum += mapSet.GetPackedComponentRead(index).X + static_cast<float>(GetEntityIndex(mapSet.GetEntity(index)));
+			}
+
+			g_benchmarkSink = g_benchmarkSink + static_cast<size_t>(sum);
+		});
+}
+
+// Runs the event benchmarks against either the event manager or its hash map baseline, labelled by the given storage.
+template<typename TEventManager>
+static void RunEventBenchmarks(std::vector<BenchmarkResult>& results, TEventManager& eventManager, const char* storage, size_t count)
+{
+	DamageListener listener;
+
+	const auto subscribe = [&]()
+	{
+		eventManager.Shutdown();
+		eventManager.template SubscribeToEvent<DamageEvent>(&listener, &DamageListener::OnDamage);
+	};
+
+	RunBenchmark(results, "event_emit_immediate", storage, count,
+		subscribe,
+		[&]()
+		{
+			for (size_t index = 0; index < count; ++index)
+			{
+				eventManager.EmitEvent(DamageEvent{ INVALID_ENTITY, 1 }, EventPriority::Immediate);
+			}
+		});
+
+	RunBenchmark(results, "event_emit_deferred", storage, count,
+		subscribe,
+		[&]()
+		{
+			for (size_t index = 0; index < count; ++index)
+			{
+				eventManager.EmitEvent(DamageEvent{ INVALID_ENTITY, 1 }, EventPriority::Deferred);
+			}
+		});
+
+	RunBenchmark(results, "event_dispatch_deferred", storage, count,
+		[&]()
+		{
+			subscribe();
+			for (size_t index = 0; index < count; ++index)
+			{
+				eventManager.EmitEvent(DamageEvent{ INVALID_ENTITY, 1 }, EventPriority::Deferred);
+			}
+		},
+		[&]() { eventManager.Update(); });
+
+	// Every event runs through several listeners, so these measure the handler dispatch itself.
+	DamageListener listeners[BENCHMARK_LISTENER_COUNT];
+	const auto subscribeAll = [&]()
+	{
+		eventManager.Shutdown();
+		for (DamageListener& fanoutListener : listeners)
+		{
+			eventManager.template SubscribeToEvent<DamageEvent>(&fanoutListener, &DamageListener::OnDamage);
+			eventManager.template SubscribeToEvent<HealEvent>(&fanoutListener, &DamageListener::OnHeal);
+		}
+	};
+
+	RunBenchmark(results, "event_dispatch_fanout_immediate", storage, count,
+		subscribeAll,
+		[&]()
+		{
+			for (size_t index = 0; index < count; ++index)
+			{
+				eventManager.EmitEvent(DamageEvent{ INVALID_ENTITY, 1 }, EventPriority::Immediate);
+			}
+		});
+
+	RunBenchmark(results, "event_dispatch_fanout_deferred", storage, count,
+		[&]()
+		{
+			subscribeAll();
+			for (size_t index = 0; index < count; ++index)
+			{
+				if (index % 2 == 0)
+				{
+					eventManager.EmitEvent(DamageEvent{ INVALID_ENTITY, 2 }, EventPriority::Deferred);
+				}
+				else
+				{
+					eventManager.EmitEvent(HealEvent{ INVALID_ENTITY, 1 }, EventPriority::Deferred);
+				}
+			}
+		},
+		[&]() { eventManager.Update(); });
+
+	eventManager.Shutdown();
+	g_benchmarkSink = g_benchmarkSink + listener.GetTotalDamage();
+	for (const DamageListener& fanoutListener : listeners)
+	{
+		g_benchmarkSink = g_benchmarkSink + fanoutListener.GetTotalDamage();
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+static void WriteResults(std::ostream& stream, const std::vector<BenchmarkResult>& results)
+{
+	// The benchmark and storage names are plain identifiers, so no string escaping is needed.
+	stream << "{\n";
+	stream << "\t\"engine_version\": \"" << ENGINE_VERSION << "\",\n";
+	stream << "\t\"unit\": \"ns_per_op\",\n";
+	stream << "\t\"results\": [\n";
+	for (size_t index = 0; index < results.size(); ++index)
+	{
+		const BenchmarkResult& result = results[index];
+		stream << "\t\t{ \"name\": \"" << result.Name << "\"";
+		if (!result.Storage.empty())
+		{
+			stream << ", \"storage\": \"" << result.Storage << "\"";
+		}
+
+		stream << ", \"count\": " << result.Count;
+		stream << ", \"threads\": " << result.ThreadCount;
+		stream << ", \"repetitions\": " << result.Repetitions;
+		stream << ", \"min\": " << result.MinNanoseconds;
+		stream << ", \"median\": " << result.MedianNanoseconds;
+		// Cache misses are null rather than missing when no hardware counter was available, so they are never mistaken for zero.
+		if (result.MedianCacheMisses >= 0.0)
+		{
+			stream << ", \"cache_misses\": " << result.MedianCacheMisses;
+		}
+		else
+		{
+			stream << ", \"cache_misses\": null";
+		}
+
+		stream << " }";
+		stream << (index + 1 < results.size() ? ",\n" : "\n");
+	}
+
+	stream << "\t]\n";
+	stream << "}\n";
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<BenchmarkResult> results;
+
+	// Publish the type ids, as the engine does at initialization.
+	ComponentIdGenerator::PublishIds();
+	TagIdGenerator::PublishIds();
+	EventIdGenerator::PublishIds();
+
+	// The world benchmarks step worlds across every hardware thread.
+	JobSystem::GetInstanceWrite().Initialize();
+
+	// Run every registry benchmark in both storage modes, at every scale.
+	const StorageMode storageModes[] = { StorageMode::SparseSet, StorageMode::Archetype };
+	for (const StorageMode storageMode : storageModes)
+	{
+		for (const size_t count : BENCHMARK_COUNTS)
+		{
+			RunEntityBenchmarks(results, storageMode, count);
+			RunComponentBenchmarks(results, storageMode, count);
+			RunIterationBenchmarks(results, storageMode, count);
+			RunSharedComponentBenchmarks(results, storageMode, count);
+			RunSpatialBenchmarks(results, storageMode, count);
+			RunGroupBenchmarks(results, storageMode, count);
+			RunTagBenchmarks(results, storageMode, count);
+			RunWorldBenchmarks(results, storageMode, count);
+		}
+	}
+
+	// The physics benchmarks run at a single scale, over both transform layouts and a range of thread counts.
+	for (const StorageMode storageMode : storageModes)
+	{
+		RunPhysicsAlignmentBenchmarks(results, storageMode);
+		RunPhysicsScalingBenchmarks(results, storageMode);
+	}
+
+	// The system matching benchmarks run at a single scale, over a range of component type counts.
+	for (const StorageMode storageMode : storageModes)
+	{
+		RunSystemMatchingBenchmarks(results, storageMode);
+	}
+
+	// The component set backends and the event managers do not depend on the storage mode.
+	MapEventManager mapEventManager;
+	for (const size_t count : BENCHMARK_COUNTS)
+	{
+		RunComponentSetBenchmarks(results, count);
+		RunEventBenchmarks(results, EventManager::GetInstanceWrite(), "handler_table", count);
+		RunEventBenchmarks(results, mapEventManager, "unordered_map", count);
+	}
+
+	Registry::GetInstanceWrite().Shutdown();
+	JobSystem::GetInstanceWrite().Shutdown();
+
+	// Write the results to the given file, or to the standard output.
+	if (argc > 1)
+	{
+		std::ofstream file(argv[1]);
+		if (!file)
+		{
+			std::cerr << "Failed to open " << argv[1] << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		WriteResults(file, results);
+	}
+	else
+	{
+		WriteResults(std::cout, results);
+	}
+
+	return EXIT_SUCCESS;
+}
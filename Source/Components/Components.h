@@ -1,9 +1,12 @@
 #pragma once
 #include "PCH.h"
+#include "ECS/Types.h"
 
+// The world transform of an entity. The matrix is 16 byte aligned as XMLoadFloat4x4A requires. This is a layout guarantee
+// rather than a speedup, the physics loop is bound by its trigonometry and runs as fast on unaligned matrices.
 struct TransformComponent
 {
-	XMFLOAT4X4 Transform = {
+	XMFLOAT4X4A Transform = {
 		1.0f, 0.0f, 0.0f, 0.0f,
 		0.0f, 1.0f, 0.0f, 0.0f,
 		0.0f, 0.0f, 1.0f, 0.0f,
@@ -11,12 +14,23 @@ struct TransformComponent
 	};
 };
 
+// The transform of an entity relative to its parent. The transform hierarchy system composes it with the parent's world
+// transform into the entity's TransformComponent, so entities with both components should only be moved through this one.
+struct LocalTransformComponent
+{
+	XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	XMFLOAT4 Rotation = { 0.0f, 0.0f, 0.0f, 1.0f };	// A unit quaternion.
+	XMFLOAT3 Scale = { 1.0f, 1.0f, 1.0f };
+	Entity Parent = INVALID_ENTITY;					// The entity this one is attached to, or INVALID_ENTITY for a root.
+};
+
 struct PhysicsComponent
 {
 	XMFLOAT3 LinearVelocity = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT3 AngularVelocity = { 0.0f, 0.0f, 0.0f };
 };
 
+// Entities drawn with the same mesh, shader, and textures share one value, see Registry::AddSharedComponent.
 struct GraphicsMeshComponent
 {
 	const wchar_t* MeshName = nullptr;
@@ -25,6 +39,46 @@ struct GraphicsMeshComponent
 	const wchar_t* BlendTextureName = nullptr;
 };
 
+// Names are compared by content, equal names parsed from different scene nodes do not share their storage.
+inline bool AreNamesEqual(const wchar_t* left, const wchar_t* right)
+{
+	return left == right || (left && right && std::wcscmp(left, right) == 0);
+}
+
+inline size_t HashName(const wchar_t* name, size_t hash)
+{
+	// Fold every character into the hash with FNV-1a, a missing name leaves the hash unchanged.
+	for (; name && *name; ++name)
+	{
+		hash = (hash ^ static_cast<size_t>(*name)) * static_cast<size_t>(1099511628211ULL);
+	}
+
+	return hash;
+}
+
+inline bool operator==(const GraphicsMeshComponent& left, const GraphicsMeshComponent& right)
+{
+	return AreNamesEqual(left.MeshName, right.MeshName) && AreNamesEqual(left.ShaderName, right.ShaderName) &&
+		AreNamesEqual(left.TextureName, right.TextureName) && AreNamesEqual(left.BlendTextureName, right.BlendTextureName);
+}
+
+namespace std
+{
+	template<>
+	struct hash<GraphicsMeshComponent>
+	{
+		size_t operator()(const GraphicsMeshComponent& component) const
+		{
+			// Chain the names through one hash, a separator keeps names moving between fields from colliding.
+			size_t hash = static_cast<size_t>(14695981039346656037ULL);
+			hash = HashName(component.MeshName, hash) * 31;
+			hash = HashName(component.ShaderName, hash) * 31;
+			hash = HashName(component.TextureName, hash) * 31;
+			return HashName(component.BlendTextureName, hash);
+		}
+	};
+}
+
 struct UIComponent
 {
 	const wchar_t* ShaderName = nullptr;
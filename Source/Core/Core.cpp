@@ -4,6 +4,7 @@
 #include "Core.h"
 #include "ECS/Registry.h"
 #include "InputManager/InputManager.h"
+#include "JobSystem/JobSystem.h"
 #include "Logger/Logger.h"
 #include "MeshManager/MeshData.h"
 #include "SceneManager/SceneManager.h"
@@ -240,7 +241,13 @@ void Engine::Initialize(_In_ HINSTANCE hInstance, _In_ LPWSTR lpCmdLine, _In_ in
 	InitializePerformanceFrequency();
 	InitializeThreadAffinity();
 
+	// Publish the dense component, tag, and event ids before any registry or event manager looks them up.
+	ComponentIdGenerator::PublishIds();
+	TagIdGenerator::PublishIds();
+	EventIdGenerator::PublishIds();
+
 	Logger::GetInstanceWrite().Initialize();
+	JobSystem::GetInstanceWrite().Initialize();
 	Window::GetInstanceWrite().Initialize(hInstance, lpCmdLine, nShowCmd);
 	Renderer::GetInstanceWrite().Initialize();
 }
@@ -260,6 +267,7 @@ void Engine::Run()
 void Engine::Shutdown()
 {
 	Window::GetInstanceWrite().Shutdown();
+	JobSystem::GetInstanceWrite().Shutdown();
 	Logger::GetInstanceWrite().Shutdown();
 	CoUninitialize(); // Shutdown COM.
 }
@@ -1193,7 +1201,7 @@ void Renderer::CreateConstantBuffers()
 	CreateOrthographicConstantBuffer();
 }
 
-void Renderer::UpdatePerMeshConstantBuffer(const XMFLOAT4X4& worldMatrix)
+void Renderer::UpdatePerMeshConstantBuffer(const XMFLOAT4X4A& worldMatrix)
 {
 	// Retrieve the current camera to update the view matrix.
 	//const FirstPersonCamera& firstPersonCamera = FirstPersonCamera::GetInstanceRead();
@@ -1208,7 +1216,7 @@ void Renderer::UpdatePerMeshConstantBuffer(const XMFLOAT4X4& worldMatrix)
 	//);
 
 	// Update the contents of the per mesh constant buffer.
-	const XMMATRIX modelMatrix = XMMatrixTranspose(XMLoadFloat4x4(&worldMatrix));
+	const XMMATRIX modelMatrix = XMMatrixTranspose(XMLoadFloat4x4A(&worldMatrix));
 	m_id3d11DeviceContext->UpdateSubresource(
 		m_cbChangesPerMesh.Get(),		// Pointer to interface of the GPU buffer we want to copy to.
 		0,								// Index of the subresource we want to update.
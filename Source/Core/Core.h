@@ -118,7 +118,7 @@ public:
 
 	void CreateShaderResourceViewFromFile(TextureData& textureData);
 
-	void UpdatePerMeshConstantBuffer(const XMFLOAT4X4& worldMatrix);
+	void UpdatePerMeshConstantBuffer(const XMFLOAT4X4A& worldMatrix);
 
 	void DrawMesh(const MeshData* meshData, const ShaderData* shaderData, const TextureData* textureData = nullptr, const TextureData* blendTextureData = nullptr);
 	void DrawUI(const UIMeshData* meshData, const ShaderData* shaderData, const TextureData* textureData = nullptr);
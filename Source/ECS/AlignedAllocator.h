@@ -0,0 +1,53 @@
+#pragma once
+#include "PCH.h"
+
+// Allocates a block of memory starting on the given power of two alignment.
+inline void* AllocateAligned(size_t size, size_t alignment)
+{
+#if defined(_MSC_VER)
+	return _aligned_malloc(size, alignment);
+#else
+	void* memory = nullptr;
+	return posix_memalign(&memory, std::max(alignment, sizeof(void*)), size) == 0 ? memory : nullptr;
+#endif
+}
+
+// Releases a block of memory returned by AllocateAligned.
+inline void FreeAligned(void* memory)
+{
+#if defined(_MSC_VER)
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// A standard library allocator honouring the alignment of over-aligned types, which the default heap does not guarantee.
+template<typename T>
+class AlignedAllocator
+{
+public:
+	using value_type = T;
+
+	AlignedAllocator() = default;
+	template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+	T* allocate(size_t count);
+	void deallocate(T* memory, size_t) { FreeAligned(memory); }
+
+	template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+	template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+inline T* AlignedAllocator<T>::allocate(size_t count)
+{
+	T* memory = static_cast<T*>(AllocateAligned(count * sizeof(T), alignof(T)));
+	assert(memory != nullptr);
+	return memory;
+}
+
+// A vector whose elements start on their type's alignment.
+template<typename T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
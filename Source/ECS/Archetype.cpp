@@ -0,0 +1,348 @@
+#include "PCH.h"
+#include "Archetype.h"
+
+Archetype::Archetype(const ComponentKey& componentKey, const std::vector<ComponentTypeInfo>& componentTypeInfos)
+	: m_componentKey(componentKey)
+	, m_columnIndices(COMPONENT_COUNT, INVALID_INDEX)
+{
+	// Create a column for every component present in the component key.
+	m_componentKey.ForEachComponent([this, &componentTypeInfos](ComponentId componentId)
+	{
+		Column column;
+		column.Id = componentId;
+		column.TypeInfo = componentTypeInfos[componentId];
+
+		m_columnIndices[componentId] = m_columns.size();
+		m_columns.push_back(column);
+	});
+
+	// Place the columns within a chunk.
+	ComputeLayout();
+}
+
+Archetype::~Archetype()
+{
+	// Destroy every component still living in the chunks.
+	for (ArchetypeChunk& chunk : m_chunks)
+	{
+		for (const Column& column : m_columns)
+		{
+			for (size_t row = 0; row < chunk.Count; ++row)
+			{
+				column.TypeInfo.Destroy(chunk.Data + column.Offset + row * column.TypeInfo.Size);
+			}
+		}
+	}
+}
+
+EntityLocation Archetype::AddEntity(Entity entity, size_t archetypeIndex, ChangeTick tick)
+{
+	// Start a new chunk if the last one is full.
+	if (m_chunks.empty() || m_chunks.back().Count == m_chunkCapacity)
+	{
+		AllocateChunk();
+	}
+
+	// Claim the next row of the last chunk. The caller is responsible for constructing the row's components.
+	ArchetypeChunk& chunk = m_chunks.back();
+	EntityLocation location;
+	location.ArchetypeIndex = archetypeIndex;
+	location.ChunkIndex = m_chunks.size() - 1;
+	location.Row = chunk.Count++;
+
+	// Record the owning entity of the row.
+	reinterpret_cast<Entity*>(chunk.Data)[location.Row] = entity;
+	++m_entityCount;
+
+	// The new row counts as both an addition and a write of every column.
+	MarkAdded(chunk, tick);
+
+	return location;
+}
+
+void Archetype::AddEntities(const Entity* entities, size_t count, size_t archetypeIndex, const void* const* components, EntityLocation* locations, ChangeTick tick)
+{
+	size_t addedCount = 0;
+	while (addedCount < count)
+	{
+		// Start a new chunk if the last one is full.
+		if (m_chunks.empty() || m_chunks.back().Count == m_chunkCapacity)
+		{
+			AllocateChunk();
+		}
+
+		// Fill as many rows of the last chunk as possible in one run.
+		ArchetypeChunk& chunk = m_chunks.back();
+		const size_t runCount = std::min(count - addedCount, m_chunkCapacity - chunk.Count);
+
+		// Record the owning entities of the run, and where each one went.
+		std::memcpy(reinterpret_cast<Entity*>(chunk.Data) + chunk.Count, entities + addedCount, runCount * sizeof(Entity));
+		for (size_t runIndex = 0; runIndex < runCount; ++runIndex)
+		{
+			EntityLocation& location = locations[addedCount + runIndex];
+			location.ArchetypeIndex = archetypeIndex;
+			location.ChunkIndex = m_chunks.size() - 1;
+			location.Row = chunk.Count + runIndex;
+		}
+
+		// Copy the source component of every column into each row of the run.
+		for (const Column& column : m_columns)
+		{
+			const size_t size = column.TypeInfo.Size;
+			const void* source = components[column.Id];
+			unsigned char* destination = chunk.Data + column.Offset + chunk.Count * size;
+
+			for (size_t runIndex = 0; runIndex < runCount; ++runIndex, destination += size)
+			{
+				if (column.TypeInfo.IsTriviallyCopyable)
+				{
+					std::memcpy(destination, source, size);
+				}
+				else
+				{
+					column.TypeInfo.CopyConstruct(destination, source);
+				}
+			}
+		}
+
+		chunk.Count += runCount;
+		addedCount += runCount;
+		MarkAdded(chunk, tick);
+	}
+
+	m_entityCount += count;
+}
+
+Entity Archetype::RemoveEntity(const EntityLocation& location)
+{
+	// Get the chunk and row being erased, and the last row of the archetype that will fill the hole.
+	ArchetypeChunk& toEraseChunk = m_chunks[location.ChunkIndex];
+	ArchetypeChunk& toKeepChunk = m_chunks.back();
+	const size_t toKeepRow = toKeepChunk.Count - 1;
+	const bool isLastRow = &toEraseChunk == &toKeepChunk && location.Row == toKeepRow;
+
+	Entity movedEntity = INVALID_ENTITY;
+
+	for (const Column& column : m_columns)
+	{
+		const size_t size = column.TypeInfo.Size;
+		unsigned char* toErase = toEraseChunk.Data + column.Offset + location.Row * size;
+		unsigned char* toKeep = toKeepChunk.Data + column.Offset + toKeepRow * size;
+
+		// Destroy the erased component. Components the caller relocated elsewhere are left in a moved from state.
+		column.TypeInfo.Destroy(toErase);
+
+		// Relocate the last row's component into the hole.
+		if (!isLastRow)
+		{
+			column.TypeInfo.MoveConstruct(toErase, toKeep);
+			column.TypeInfo.Destroy(toKeep);
+		}
+	}
+
+	// Relocate the last row's owning entity into the hole, and report it so the caller can update its location.
+	if (!isLastRow)
+	{
+		Entity* toEraseEntities = reinterpret_cast<Entity*>(toEraseChunk.Data);
+		const Entity* toKeepEntities = reinterpret_cast<const Entity*>(toKeepChunk.Data);
+		movedEntity = toEraseEntities[location.Row] = toKeepEntities[toKeepRow];
+
+		// The moved row carries its changes along, so the receiving chunk must report them too.
+		for (size_t columnIndex = 0; columnIndex < m_columns.size(); ++columnIndex)
+		{
+			toEraseChunk.AddedTicks[columnIndex] = std::max(toEraseChunk.AddedTicks[columnIndex], toKeepChunk.AddedTicks[columnIndex]);
+			toEraseChunk.ChangedTicks[columnIndex] = std::max(toEraseChunk.ChangedTicks[columnIndex], toKeepChunk.ChangedTicks[columnIndex]);
+		}
+	}
+
+	// Release the last row, and the last chunk with it if it is now empty.
+	--toKeepChunk.Count;
+	--m_entityCount;
+	if (toKeepChunk.Count == 0)
+	{
+		m_chunks.pop_back();
+	}
+
+	return movedEntity;
+}
+
+void Archetype::SwapRows(const EntityLocation& first, const EntityLocation& second)
+{
+	// A row cannot be swapped with itself, its component would be destroyed before being moved back.
+	assert(first.ChunkIndex != second.ChunkIndex || first.Row != second.Row);
+
+	ArchetypeChunk& firstChunk = m_chunks[first.ChunkIndex];
+	ArchetypeChunk& secondChunk = m_chunks[second.ChunkIndex];
+
+	// Size the swap buffer for the largest component, with room to align it for the most aligned one.
+	if (!m_swapBuffer)
+	{
+		size_t bufferSize = 0;
+		for (const Column& column : m_columns)
+		{
+			bufferSize = std::max(bufferSize, column.TypeInfo.Size + column.TypeInfo.Alignment);
+		}
+
+		m_swapBuffer = std::make_unique<unsigned char[]>(std::max<size_t>(bufferSize, 1));
+	}
+
+	for (const Column& column : m_columns)
+	{
+		const size_t size = column.TypeInfo.Size;
+		unsigned char* firstComponent = firstChunk.Data + column.Offset + first.Row * size;
+		unsigned char* secondComponent = secondChunk.Data + column.Offset + second.Row * size;
+
+		// Relocate the first component into the buffer, the second into the first row, and the buffered one into the second.
+		const uintptr_t bufferAddress = reinterpret_cast<uintptr_t>(m_swapBuffer.get());
+		unsigned char* buffer = reinterpret_cast<unsigned char*>((bufferAddress + column.TypeInfo.Alignment - 1) & ~(column.TypeInfo.Alignment - 1));
+		column.TypeInfo.MoveConstruct(buffer, firstComponent);
+		column.TypeInfo.Destroy(firstComponent);
+		column.TypeInfo.MoveConstruct(firstComponent, secondComponent);
+		column.TypeInfo.Destroy(secondComponent);
+		column.TypeInfo.MoveConstruct(secondComponent, buffer);
+		column.TypeInfo.Destroy(buffer);
+	}
+
+	// Swap the owning entities along with their components.
+	Entity* firstEntities = reinterpret_cast<Entity*>(firstChunk.Data);
+	Entity* secondEntities = reinterpret_cast<Entity*>(secondChunk.Data);
+	std::swap(firstEntities[first.Row], secondEntities[second.Row]);
+
+	// Both rows carry their changes along, so both chunks must report the changes of either.
+	for (size_t columnIndex = 0; columnIndex < m_columns.size(); ++columnIndex)
+	{
+		firstChunk.AddedTicks[columnIndex] = secondChunk.AddedTicks[columnIndex] = std::max(firstChunk.AddedTicks[columnIndex], secondChunk.AddedTicks[columnIndex]);
+		firstChunk.ChangedTicks[columnIndex] = secondChunk.ChangedTicks[columnIndex] = std::max(firstChunk.ChangedTicks[columnIndex], secondChunk.ChangedTicks[columnIndex]);
+	}
+}
+
+void Archetype::SaveSnapshot(SnapshotWriter& writer) const
+{
+	// Components owning resources cannot be restored from raw bytes, only an empty archetype of them can be saved.
+	for (const Column& column : m_columns)
+	{
+		assert((column.TypeInfo.IsTriviallyCopyable || m_entityCount == 0) && "Only trivially copyable components can be saved to a snapshot.");
+		(void)column;
+	}
+
+	// Write only the occupied rows of every column, the layout is rebuilt identically from the component key on load.
+	writer.Write<uint64_t>(m_chunkCapacity);
+	writer.Write<uint64_t>(m_chunks.size());
+	for (const ArchetypeChunk& chunk : m_chunks)
+	{
+		writer.Write<uint64_t>(chunk.Count);
+		writer.WriteVector(chunk.AddedTicks);
+		writer.WriteVector(chunk.ChangedTicks);
+		writer.WriteBytes(chunk.Data, chunk.Count * sizeof(Entity));
+		for (const Column& column : m_columns)
+		{
+			writer.WriteBytes(chunk.Data + column.Offset, chunk.Count * column.TypeInfo.Size);
+		}
+	}
+}
+
+bool Archetype::LoadSnapshot(SnapshotReader& reader)
+{
+	// The archetype must be empty, and laid out the same as the one that was saved.
+	assert(m_chunks.empty());
+	uint64_t chunkCapacity = 0;
+	size_t chunkCount = 0;
+	if (!reader.Read(chunkCapacity) || chunkCapacity != m_chunkCapacity || !reader.ReadCount(3 * sizeof(uint64_t), chunkCount))
+	{
+		return false;
+	}
+
+	for (size_t chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+	{
+		// Every chunk holds at most a full set of rows, and a tick per column.
+		AllocateChunk();
+		ArchetypeChunk& chunk = m_chunks.back();
+		uint64_t count = 0;
+		if (!reader.Read(count) || count > m_chunkCapacity || !reader.ReadVector(chunk.AddedTicks) || !reader.ReadVector(chunk.ChangedTicks) ||
+			chunk.AddedTicks.size() != m_columns.size() || chunk.ChangedTicks.size() != m_columns.size())
+		{
+			return false;
+		}
+
+		// Read back the occupied rows of the owning entities and of every column.
+		const size_t rowCount = static_cast<size_t>(count);
+		if (!reader.ReadBytes(chunk.Data, rowCount * sizeof(Entity)))
+		{
+			return false;
+		}
+
+		for (const Column& column : m_columns)
+		{
+			if (!reader.ReadBytes(chunk.Data + column.Offset, rowCount * column.TypeInfo.Size))
+			{
+				return false;
+			}
+		}
+
+		chunk.Count = rowCount;
+		m_entityCount += chunk.Count;
+	}
+
+	return true;
+}
+
+void* Archetype::GetComponent(ComponentId componentId, size_t chunkIndex, size_t row)
+{
+	const Column& column = m_columns[m_columnIndices[componentId]];
+	return m_chunks[chunkIndex].Data + column.Offset + row * column.TypeInfo.Size;
+}
+
+void* Archetype::GetColumn(ComponentId componentId, size_t chunkIndex)
+{
+	const Column& column = m_columns[m_columnIndices[componentId]];
+	return m_chunks[chunkIndex].Data + column.Offset;
+}
+
+const Entity* Archetype::GetEntities(size_t chunkIndex) const
+{
+	// The entity column always sits at the start of the chunk.
+	return reinterpret_cast<const Entity*>(m_chunks[chunkIndex].Data);
+}
+
+void Archetype::ComputeLayout()
+{
+	// Sum the bytes a single row occupies across all columns, including the owning entity.
+	size_t rowSize = sizeof(Entity);
+	for (const Column& column : m_columns)
+	{
+		rowSize += column.TypeInfo.Size;
+	}
+
+	// Reserve worst case padding for aligning every column, and fit as many rows as possible in the remainder.
+	const size_t paddingSize = (m_columns.size() + 1) * ARCHETYPE_COLUMN_ALIGNMENT;
+	m_chunkCapacity = (ARCHETYPE_CHUNK_SIZE - paddingSize) / rowSize;
+	assert(m_chunkCapacity > 0);
+
+	// Lay the columns out one after the other, the entity column first.
+	size_t offset = AlignUp(m_chunkCapacity * sizeof(Entity), ARCHETYPE_COLUMN_ALIGNMENT);
+	for (Column& column : m_columns)
+	{
+		assert(column.TypeInfo.Alignment <= ARCHETYPE_COLUMN_ALIGNMENT);
+		column.Offset = offset;
+		offset = AlignUp(offset + m_chunkCapacity * column.TypeInfo.Size, ARCHETYPE_COLUMN_ALIGNMENT);
+	}
+
+	assert(offset <= ARCHETYPE_CHUNK_SIZE);
+}
+
+void Archetype::AllocateChunk()
+{
+	// Over-allocate so the chunk data can start on a column aligned address.
+	ArchetypeChunk chunk;
+	chunk.Allocation.reset(new unsigned char[ARCHETYPE_CHUNK_SIZE + ARCHETYPE_COLUMN_ALIGNMENT]);
+	chunk.Data = reinterpret_cast<unsigned char*>(AlignUp(reinterpret_cast<size_t>(chunk.Allocation.get()), ARCHETYPE_COLUMN_ALIGNMENT));
+	chunk.AddedTicks.resize(m_columns.size(), 0);
+	chunk.ChangedTicks.resize(m_columns.size(), 0);
+	m_chunks.push_back(std::move(chunk));
+}
+
+void Archetype::MarkAdded(ArchetypeChunk& chunk, ChangeTick tick)
+{
+	std::fill(chunk.AddedTicks.begin(), chunk.AddedTicks.end(), tick);
+	std::fill(chunk.ChangedTicks.begin(), chunk.ChangedTicks.end(), tick);
+}
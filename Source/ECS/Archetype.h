@@ -0,0 +1,90 @@
+#pragma once
+#include "PCH.h"
+#include "ComponentKey.h"
+#include "ComponentTypeInfo.h"
+#include "Snapshot.h"
+#include "Types.h"
+#include "Macros.h"
+
+constexpr size_t ARCHETYPE_CHUNK_SIZE = 16 * 1024;		// The size in bytes of a single archetype chunk.
+constexpr size_t ARCHETYPE_COLUMN_ALIGNMENT = 64;		// Every chunk column starts on its own cache line.
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// Where an entity's components live in archetype storage.
+struct EntityLocation
+{
+	size_t ArchetypeIndex = INVALID_INDEX;
+	size_t ChunkIndex = 0;
+	size_t Row = 0;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// A fixed size block of memory holding one SoA column per archetype component, plus a column of owning entities.
+// Change ticks are tracked per column for the whole chunk, so change filters visit a chunk if any of its rows changed.
+struct ArchetypeChunk
+{
+	std::unique_ptr<unsigned char[]> Allocation;	// The raw allocation, over-sized to allow aligning the chunk data.
+	unsigned char* Data = nullptr;					// The aligned start of the chunk data.
+	size_t Count = 0;								// The number of occupied rows.
+	std::vector<ChangeTick> AddedTicks;				// The tick a row was last added to the chunk at, per column.
+	std::vector<ChangeTick> ChangedTicks;			// The tick any row of the column was last written at, per column.
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// Stores every entity sharing the same component key together in chunks.
+class Archetype final
+{
+	NO_COPY(Archetype);
+	NO_MOVE(Archetype);
+
+	struct Column
+	{
+		ComponentId Id = 0;
+		ComponentTypeInfo TypeInfo;
+		size_t Offset = 0;	// The offset of the column from the start of the chunk data.
+	};
+
+public:
+	Archetype(const ComponentKey& componentKey, const std::vector<ComponentTypeInfo>& componentTypeInfos);
+	~Archetype();
+
+	EntityLocation AddEntity(Entity entity, size_t archetypeIndex, ChangeTick tick);
+	void AddEntities(const Entity* entities, size_t count, size_t archetypeIndex, const void* const* components, EntityLocation* locations, ChangeTick tick);
+	Entity RemoveEntity(const EntityLocation& location);
+	void SwapRows(const EntityLocation& first, const EntityLocation& second);
+	void SaveSnapshot(SnapshotWriter& writer) const;
+	bool LoadSnapshot(SnapshotReader& reader);
+
+	bool HaveColumn(ComponentId componentId) const { return m_columnIndices[componentId] != INVALID_INDEX; }
+	void* GetComponent(ComponentId componentId, size_t chunkIndex, size_t row);
+	void* GetColumn(ComponentId componentId, size_t chunkIndex);
+	const Entity* GetEntities(size_t chunkIndex) const;
+	const ComponentTypeInfo& GetTypeInfo(ComponentId componentId) const { return m_columns[m_columnIndices[componentId]].TypeInfo; }
+
+	ChangeTick GetAddedTick(ComponentId componentId, size_t chunkIndex) const { return m_chunks[chunkIndex].AddedTicks[m_columnIndices[componentId]]; }
+	ChangeTick GetChangedTick(ComponentId componentId, size_t chunkIndex) const { return m_chunks[chunkIndex].ChangedTicks[m_columnIndices[componentId]]; }
+	void MarkChanged(ComponentId componentId, size_t chunkIndex, ChangeTick tick) { m_chunks[chunkIndex].ChangedTicks[m_columnIndices[componentId]] = tick; }
+
+	const ComponentKey& GetComponentKey() const { return m_componentKey; }
+	size_t GetChunkCount() const { return m_chunks.size(); }
+	size_t GetChunkSize(size_t chunkIndex) const { return m_chunks[chunkIndex].Count; }
+	size_t GetChunkCapacity() const { return m_chunkCapacity; }
+	size_t GetEntityCount() const { return m_entityCount; }
+
+private:
+	void ComputeLayout();
+	void AllocateChunk();
+	void MarkAdded(ArchetypeChunk& chunk, ChangeTick tick);
+
+private:
+	ComponentKey m_componentKey;						// The set of components every entity in this archetype has.
+	std::vector<size_t> m_columnIndices;				// Maps a component id to its column, or INVALID_INDEX if not present.
+	std::vector<Column> m_columns;						// The per component columns of every chunk.
+	std::vector<ArchetypeChunk> m_chunks;				// All chunks, every chunk but the last is full.
+	size_t m_chunkCapacity = 0;							// The number of rows that fit in a single chunk.
+	size_t m_entityCount = 0;							// The number of entities across all chunks.
+	std::unique_ptr<unsigned char[]> m_swapBuffer;		// Holds a component while two rows are swapped, allocated on the first swap.
+};
@@ -0,0 +1,142 @@
+#include "PCH.h"
+#include "CommandBuffer.h"
+
+// The key of the commands recorded on the current thread.
+static thread_local CommandKey s_recordingKey;
+
+CommandBuffer::~CommandBuffer()
+{
+	// Destroy every command that was never replayed.
+	Reset();
+}
+
+void CommandBuffer::Execute(Registry& registry, std::vector<std::unique_ptr<CommandBuffer>>& commandBuffers)
+{
+	// Gather the runs of every buffer. Which buffer a run landed in depends on the thread that recorded it, its key does not.
+	std::vector<std::pair<CommandBuffer*, const CommandRun*>> runs;
+	for (std::unique_ptr<CommandBuffer>& commandBuffer : commandBuffers)
+	{
+		for (const CommandRun& run : commandBuffer->m_runs)
+		{
+			runs.emplace_back(commandBuffer.get(), &run);
+		}
+
+		commandBuffer->m_isExecuting = true;
+	}
+
+	// Replay the runs in key order. The sort is stable, so the runs a thread recorded under the same key keep their order.
+	std::stable_sort(runs.begin(), runs.end(), [](const std::pair<CommandBuffer*, const CommandRun*>& first, const std::pair<CommandBuffer*, const CommandRun*>& second)
+	{
+		return first.second->Key < second.second->Key;
+	});
+
+	for (const std::pair<CommandBuffer*, const CommandRun*>& run : runs)
+	{
+		run.first->ExecuteRun(registry, *run.second);
+	}
+
+	// The commands destroyed themselves, only the blocks need rewinding.
+	for (std::unique_ptr<CommandBuffer>& commandBuffer : commandBuffers)
+	{
+		commandBuffer->m_isExecuting = false;
+		commandBuffer->Rewind();
+	}
+}
+
+void CommandBuffer::Reset()
+{
+	// Destroy every recorded command without running it.
+	for (size_t blockIndex = 0; blockIndex < m_blocks.size(); ++blockIndex)
+	{
+		CommandBlock& block = m_blocks[blockIndex];
+		for (size_t offset = 0; offset < block.Size;)
+		{
+			CommandHeader* header = reinterpret_cast<CommandHeader*>(block.Data + offset);
+			offset += header->Size;
+			header->Destroy(header);
+		}
+	}
+
+	Rewind();
+}
+
+unsigned char* CommandBuffer::Allocate(size_t size)
+{
+	// Move to a fresh block if the current one cannot fit the command.
+	if (m_blocks.empty() || m_blocks[m_currentBlock].Size + size > m_blocks[m_currentBlock].Capacity)
+	{
+		// Blocks after the current one are empty, kept from earlier frames for reuse.
+		const size_t nextBlock = m_blocks.empty() || m_blocks[m_currentBlock].Size == 0 ? m_currentBlock : m_currentBlock + 1;
+
+		// Allocate a new block if no kept block is there or it is too small, large enough for oversized commands.
+		if (nextBlock == m_blocks.size() || m_blocks[nextBlock].Capacity < size)
+		{
+			CommandBlock block;
+			block.Capacity = std::max(COMMAND_BUFFER_BLOCK_SIZE, size);
+			block.Allocation.reset(new unsigned char[block.Capacity + COMMAND_BUFFER_ALIGNMENT]);
+			block.Data = reinterpret_cast<unsigned char*>(AlignUp(reinterpret_cast<size_t>(block.Allocation.get()), COMMAND_BUFFER_ALIGNMENT));
+			m_blocks.insert(m_blocks.begin() + nextBlock, std::move(block));
+		}
+
+		m_currentBlock = nextBlock;
+	}
+
+	// Start a new run when the command is recorded under another key than the previous one.
+	CommandBlock& block = m_blocks[m_currentBlock];
+	if (m_runs.empty() || !(m_runs.back().Key == s_recordingKey))
+	{
+		CommandRun run;
+		run.Key = s_recordingKey;
+		run.Block = m_currentBlock;
+		run.Offset = block.Size;
+		m_runs.push_back(run);
+	}
+
+	++m_runs.back().CommandCount;
+
+	// Bump allocate from the current block.
+	unsigned char* memory = block.Data + block.Size;
+	block.Size += size;
+	return memory;
+}
+
+void CommandBuffer::ExecuteRun(Registry& registry, const CommandRun& run)
+{
+	// Replay the commands of the run in recording order, moving to the next block at the end of a block.
+	size_t blockIndex = run.Block;
+	size_t offset = run.Offset;
+	for (size_t commandIndex = 0; commandIndex < run.CommandCount; ++commandIndex)
+	{
+		if (offset == m_blocks[blockIndex].Size)
+		{
+			++blockIndex;
+			offset = 0;
+		}
+
+		CommandHeader* header = reinterpret_cast<CommandHeader*>(m_blocks[blockIndex].Data + offset);
+		offset += header->Size;
+		header->Execute(registry, header);
+	}
+}
+
+const CommandKey& CommandBuffer::GetRecordingKey()
+{
+	return s_recordingKey;
+}
+
+void CommandBuffer::SetRecordingKey(const CommandKey& key)
+{
+	s_recordingKey = key;
+}
+
+void CommandBuffer::Rewind()
+{
+	// Keep every block for the next frame, but mark them all as empty.
+	for (CommandBlock& block : m_blocks)
+	{
+		block.Size = 0;
+	}
+
+	m_runs.clear();
+	m_currentBlock = 0;
+}
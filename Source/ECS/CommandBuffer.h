@@ -0,0 +1,179 @@
+#pragma once
+#include "PCH.h"
+#include "Types.h"
+#include "Macros.h"
+#include "JobSystem/JobSystem.h"
+
+class Registry;
+
+constexpr size_t COMMAND_BUFFER_BLOCK_SIZE = 64 * 1024;	// The size in bytes of a single command buffer block.
+constexpr size_t COMMAND_BUFFER_ALIGNMENT = 16;			// Every recorded command starts on this alignment.
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// Names the code that recorded a command, whichever thread happened to run it. Commands replay in key order, and in recording
+// order within a key, which is the order a single thread running every system and every batch in turn would record them in.
+struct CommandKey
+{
+	uint32_t Producer = 0;	// The system within its update phase plus one, zero outside of system updates.
+	uint32_t Loop = 0;		// The number of parallel loops the producer started so far.
+	size_t Item = 0;		// The first item of the recording batch, INVALID_INDEX once the loop of the batch completed.
+	bool IsInBatch = false;	// Is the command recorded from a batch of a parallel loop.
+};
+
+inline bool operator==(const CommandKey& first, const CommandKey& second)
+{
+	return first.Producer == second.Producer && first.Loop == second.Loop && first.Item == second.Item;
+}
+
+inline bool operator<(const CommandKey& first, const CommandKey& second)
+{
+	return std::tie(first.Producer, first.Loop, first.Item) < std::tie(second.Producer, second.Loop, second.Item);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// A linear stream of type erased deferred registry commands. Commands are written inline into bump allocated blocks,
+// replayed in recording order through a function pointer, and the blocks are kept for reuse once the buffer is replayed.
+class CommandBuffer final
+{
+	NO_COPY(CommandBuffer);
+	NO_MOVE(CommandBuffer);
+
+	// Precedes every command in the stream.
+	struct CommandHeader
+	{
+		void (*Execute)(Registry& registry, CommandHeader* header);	// Runs the command, then destroys it.
+		void (*Destroy)(CommandHeader* header);						// Destroys a command discarded without running.
+		size_t Size;												// The size in bytes of the header and command together.
+	};
+
+	// A sequence of consecutive commands recorded under the same key.
+	struct CommandRun
+	{
+		CommandKey Key;
+		size_t Block = 0;			// The block holding the first command of the run.
+		size_t Offset = 0;			// The offset of the first command within its block.
+		size_t CommandCount = 0;
+	};
+
+	struct CommandBlock
+	{
+		std::unique_ptr<unsigned char[]> Allocation;	// The raw allocation, over-sized to allow aligning the block data.
+		unsigned char* Data = nullptr;					// The aligned start of the block data.
+		size_t Capacity = 0;							// The number of usable bytes in the block.
+		size_t Size = 0;								// The number of bytes recorded in the block.
+	};
+
+public:
+	CommandBuffer() = default;
+	~CommandBuffer();
+
+	template<typename TCommand> void Record(TCommand command);
+	static void Execute(Registry& registry, std::vector<std::unique_ptr<CommandBuffer>>& commandBuffers);
+	void Reset();
+
+	bool IsEmpty() const { return m_runs.empty(); }
+
+	static const CommandKey& GetRecordingKey();
+	static void SetRecordingKey(const CommandKey& key);
+
+private:
+	template<typename TCommand> static TCommand* GetCommand(CommandHeader* header);
+	unsigned char* Allocate(size_t size);
+	void ExecuteRun(Registry& registry, const CommandRun& run);
+	void Rewind();
+
+private:
+	std::vector<CommandBlock> m_blocks;	// Every block allocated so far, only blocks up to the current one hold commands.
+	std::vector<CommandRun> m_runs;		// The recorded commands, split wherever the recording key changed.
+	size_t m_currentBlock = 0;			// The block commands are currently recorded into.
+	bool m_isExecuting = false;			// Is the buffer in the middle of replaying its commands.
+};
+
+// Sets the key of the commands the calling thread records, and restores the previous key when it goes out of scope.
+class CommandKeyScope final
+{
+	NO_COPY(CommandKeyScope);
+	NO_MOVE(CommandKeyScope);
+
+public:
+	explicit CommandKeyScope(const CommandKey& key) : m_previousKey(CommandBuffer::GetRecordingKey()) { CommandBuffer::SetRecordingKey(key); }
+	~CommandKeyScope() { CommandBuffer::SetRecordingKey(m_previousKey); }
+
+private:
+	CommandKey m_previousKey;
+};
+
+template<typename TFunction> void ParallelForOrdered(size_t count, size_t batchAlignment, TFunction function);
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+template<typename TCommand>
+inline void CommandBuffer::Record(TCommand command)
+{
+	static_assert(alignof(TCommand) <= COMMAND_BUFFER_ALIGNMENT, "Command is over-aligned for the command buffer.");
+
+	// Commands cannot be recorded into a buffer that is being replayed, they would be lost when it rewinds.
+	assert(!m_isExecuting);
+
+	// Reserve room for the header followed by the command, aligned as the command requires.
+	const size_t size = AlignUp(AlignUp(sizeof(CommandHeader), alignof(TCommand)) + sizeof(TCommand), COMMAND_BUFFER_ALIGNMENT);
+	CommandHeader* header = reinterpret_cast<CommandHeader*>(Allocate(size));
+
+	// Store the type erased operations of the command, and copy the command itself inline after the header.
+	header->Execute = [](Registry& registry, CommandHeader* header)
+	{
+		TCommand* command = GetCommand<TCommand>(header);
+		(*command)(registry);
+		command->~TCommand();
+	};
+	header->Destroy = [](CommandHeader* header) { GetCommand<TCommand>(header)->~TCommand(); };
+	header->Size = size;
+
+	new (GetCommand<TCommand>(header)) TCommand(std::move(command));
+}
+
+template<typename TCommand>
+inline TCommand* CommandBuffer::GetCommand(CommandHeader* header)
+{
+	// The command follows its header, at the first offset satisfying its alignment.
+	return reinterpret_cast<TCommand*>(reinterpret_cast<unsigned char*>(header) + AlignUp(sizeof(CommandHeader), alignof(TCommand)));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// Runs a parallel loop of the job system, where the commands recorded by every batch replay in the order of the items the batch covers.
+template<typename TFunction>
+inline void ParallelForOrdered(size_t count, size_t batchAlignment, TFunction function)
+{
+	// A loop started by a producer gets the next loop number. A loop nested in a batch keeps the key of that batch,
+	// so the inner batches replay after each other in no particular order.
+	CommandKey loopKey = CommandBuffer::GetRecordingKey();
+	const bool isNested = loopKey.IsInBatch;
+	if (!isNested)
+	{
+		++loopKey.Loop;
+		loopKey.IsInBatch = true;
+	}
+
+	JobSystem::GetInstanceWrite().ParallelFor(count, batchAlignment, [&function, &loopKey, isNested](size_t begin, size_t end)
+	{
+		CommandKey batchKey = loopKey;
+		if (!isNested)
+		{
+			batchKey.Item = begin;
+		}
+
+		CommandKeyScope scope(batchKey);
+		function(begin, end);
+	});
+
+	// What the producer records once the loop is done replays after every batch of the loop.
+	if (!isNested)
+	{
+		loopKey.Item = INVALID_INDEX;
+		loopKey.IsInBatch = false;
+		CommandBuffer::SetRecordingKey(loopKey);
+	}
+}
@@ -1,5 +1,55 @@
 #include "PCH.h"
 #include "ComponentIdGenerator.h"
+#include "ComponentKey.h"
 
-ComponentId ComponentIdGenerator::m_nextComponentId = 0;
+void ComponentIdGenerator::PublishIds()
+{
+	// Write the id of every component type registered so far, in hash order.
+	TypeIdTable& idTable = GetIdTable();
+	idTable.Publish();
+	assert(idTable.GetHashes().size() <= COMPONENT_COUNT && "Raise COMPONENT_COUNT to register more component types.");
 
+	// Index the type erased operations of every component type by its id.
+	const std::vector<TypeHash>& componentHashes = idTable.GetHashes();
+	std::vector<ComponentTypeInfo>& typeInfos = GetTypeInfos();
+	for (ComponentId componentId = 0; componentId < componentHashes.size(); ++componentId)
+	{
+		typeInfos[componentId] = GetRegisteredTypeInfos()[componentHashes[componentId]];
+	}
+}
+
+bool ComponentIdGenerator::RegisterComponent(TypeHash typeHash, ComponentId* componentId, const ComponentTypeInfo& componentTypeInfo)
+{
+	GetRegisteredTypeInfos()[typeHash] = componentTypeInfo;
+	GetIdTable().Register(typeHash, componentId);
+
+	// A component type registering after the ids were published gets its id right away.
+	if (*componentId != INVALID_INDEX)
+	{
+		assert(*componentId < COMPONENT_COUNT && "Raise COMPONENT_COUNT to register more component types.");
+		GetTypeInfos()[*componentId] = componentTypeInfo;
+	}
+
+	return true;
+}
+
+TypeIdTable& ComponentIdGenerator::GetIdTable()
+{
+	// Constructed on first use, component types register during static initialization in no particular order.
+	static TypeIdTable idTable;
+	return idTable;
+}
+
+std::unordered_map<TypeHash, ComponentTypeInfo>& ComponentIdGenerator::GetRegisteredTypeInfos()
+{
+	// The type erased operations of every registered component type, by type hash.
+	static std::unordered_map<TypeHash, ComponentTypeInfo> registeredTypeInfos;
+	return registeredTypeInfos;
+}
+
+std::vector<ComponentTypeInfo>& ComponentIdGenerator::GetTypeInfos()
+{
+	// The type erased operations of every component type, indexed by component id once the ids are published.
+	static std::vector<ComponentTypeInfo> typeInfos(COMPONENT_COUNT);
+	return typeInfos;
+}
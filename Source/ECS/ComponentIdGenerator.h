@@ -1,20 +1,45 @@
 #pragma once
+#include "ComponentTypeInfo.h"
 #include "Types.h"
+#include "TypeHash.h"
 #include "Macros.h"
 
+// Hands out component ids. The type hash is the stable id of a component type, the same in every build and known at compile
+// time. The dense id the registry indexes storage with is published once at engine initialization, in hash order over every
+// type registered during static initialization, so it never depends on link order and looking it up is a plain load.
+// Every component type registers its type erased operations along with its hash, so any registry can create storage for
+// any component type, including ones it has never seen before, such as when it loads a snapshot.
 class ComponentIdGenerator final
 {
 public:
+	template<typename TComponent> static constexpr TypeHash GetComponentHash() { return GetTypeHash<TComponent>(); }
 	template<typename TComponent> static ComponentId GetComponentId();
+	static const std::vector<TypeHash>& GetComponentHashes() { return GetIdTable().GetHashes(); }
+	static const std::vector<ComponentTypeInfo>& GetComponentTypeInfos() { return GetTypeInfos(); }
+	static void PublishIds();
 
 private:
-	static ComponentId m_nextComponentId;
+	static bool RegisterComponent(TypeHash typeHash, ComponentId* componentId, const ComponentTypeInfo& componentTypeInfo);
+	static TypeIdTable& GetIdTable();
+	static std::unordered_map<TypeHash, ComponentTypeInfo>& GetRegisteredTypeInfos();
+	static std::vector<ComponentTypeInfo>& GetTypeInfos();
+
+private:
+	template<typename TComponent> static ComponentId m_componentId;					// The dense id of each component type, written when the ids are published.
+	template<typename TComponent> static const bool m_isComponentRegistered;	// Registers each component type during static initialization.
 };
 
 template<typename TComponent>
-static ComponentId ComponentIdGenerator::GetComponentId()
+ComponentId ComponentIdGenerator::m_componentId = INVALID_INDEX;
+
+template<typename TComponent>
+const bool ComponentIdGenerator::m_isComponentRegistered = ComponentIdGenerator::RegisterComponent(std::integral_constant<TypeHash, GetTypeHash<TComponent>()>::value, &ComponentIdGenerator::m_componentId<TComponent>, MakeComponentTypeInfo<TComponent>());
+
+template<typename TComponent>
+inline ComponentId ComponentIdGenerator::GetComponentId()
 {
-	const static ComponentId componentId = m_nextComponentId++;
-	return componentId;
+	// Naming the registration makes every component type used anywhere register before main.
+	static_cast<void>(&m_isComponentRegistered<TComponent>);
+	assert(m_componentId<TComponent> != INVALID_INDEX && "Component ids are published at engine initialization.");
+	return m_componentId<TComponent>;
 }
-
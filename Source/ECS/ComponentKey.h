@@ -0,0 +1,292 @@
+#pragma once
+#include "PCH.h"
+#include "Types.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define COMPONENT_KEY_AVX2
+#elif defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMPONENT_KEY_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+constexpr size_t COMPONENT_COUNT = 256;							// The maximum number of component types.
+constexpr size_t COMPONENT_KEY_WORD_COUNT = COMPONENT_COUNT / 64;	// The number of 64 bit words in a component key.
+
+static_assert(COMPONENT_COUNT % 256 == 0, "Component keys are processed 256 bits at a time.");
+
+// A fixed width mask of component ids. Subset, intersection and equality tests, and hashing, run on 128 or 256 bit lanes.
+class ComponentKey final
+{
+public:
+	void Set(ComponentId componentId) { m_words[componentId / 64] |= uint64_t(1) << (componentId % 64); }
+	void Reset(ComponentId componentId) { m_words[componentId / 64] &= ~(uint64_t(1) << (componentId % 64)); }
+	void Clear() { *this = ComponentKey(); }
+	bool Test(ComponentId componentId) const { return (m_words[componentId / 64] & (uint64_t(1) << (componentId % 64))) != 0; }
+
+	bool Any() const { return !None(); }
+	bool None() const { return *this == ComponentKey(); }
+	bool Contains(const ComponentKey& other) const;
+	bool Intersects(const ComponentKey& other) const;
+	size_t GetHash() const;
+
+	template<typename TFunction> void ForEachComponent(TFunction function) const;
+
+	ComponentKey operator&(const ComponentKey& other) const;
+	ComponentKey operator|(const ComponentKey& other) const;
+	ComponentKey operator^(const ComponentKey& other) const;
+	bool operator==(const ComponentKey& other) const;
+	bool operator!=(const ComponentKey& other) const { return !(*this == other); }
+
+private:
+	uint64_t m_words[COMPONENT_KEY_WORD_COUNT] = { };	// Bit n of word w is set when the component id w * 64 + n is present.
+};
+
+namespace std
+{
+	template<>
+	struct hash<ComponentKey>
+	{
+		size_t operator()(const ComponentKey& componentKey) const { return componentKey.GetHash(); }
+	};
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+#if defined(COMPONENT_KEY_AVX2)
+
+#define COMPONENT_KEY_LANE_WORD_COUNT 4
+#define COMPONENT_KEY_FOLD_WORD_COUNT 4
+#define COMPONENT_KEY_LOAD(WORDS) _mm256_loadu_si256(reinterpret_cast<const __m256i*>(WORDS))
+#define COMPONENT_KEY_STORE(WORDS, LANE) _mm256_storeu_si256(reinterpret_cast<__m256i*>(WORDS), LANE)
+#define COMPONENT_KEY_AND(A, B) _mm256_and_si256(A, B)
+#define COMPONENT_KEY_OR(A, B) _mm256_or_si256(A, B)
+#define COMPONENT_KEY_XOR(A, B) _mm256_xor_si256(A, B)
+
+#elif defined(COMPONENT_KEY_SSE2)
+
+#define COMPONENT_KEY_LANE_WORD_COUNT 2
+#define COMPONENT_KEY_FOLD_WORD_COUNT 2
+#define COMPONENT_KEY_LOAD(WORDS) _mm_loadu_si128(reinterpret_cast<const __m128i*>(WORDS))
+#define COMPONENT_KEY_STORE(WORDS, LANE) _mm_storeu_si128(reinterpret_cast<__m128i*>(WORDS), LANE)
+#define COMPONENT_KEY_AND(A, B) _mm_and_si128(A, B)
+#define COMPONENT_KEY_OR(A, B) _mm_or_si128(A, B)
+#define COMPONENT_KEY_XOR(A, B) _mm_xor_si128(A, B)
+
+#else
+
+#define COMPONENT_KEY_FOLD_WORD_COUNT 1
+
+#endif
+
+inline bool ComponentKey::Contains(const ComponentKey& other) const
+{
+#if defined(COMPONENT_KEY_AVX2)
+	// The other key is a subset when none of its bits are missing from this key.
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		if (!_mm256_testc_si256(COMPONENT_KEY_LOAD(m_words + word), COMPONENT_KEY_LOAD(other.m_words + word)))
+		{
+			return false;
+		}
+	}
+	return true;
+#elif defined(COMPONENT_KEY_SSE2)
+	// Gather the bits of the other key missing from this key, and check none are set.
+	__m128i missing = _mm_setzero_si128();
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		missing = _mm_or_si128(missing, _mm_andnot_si128(COMPONENT_KEY_LOAD(m_words + word), COMPONENT_KEY_LOAD(other.m_words + word)));
+	}
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF;
+#else
+	uint64_t missing = 0;
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; ++word)
+	{
+		missing |= ~m_words[word] & other.m_words[word];
+	}
+	return missing == 0;
+#endif
+}
+
+inline bool ComponentKey::Intersects(const ComponentKey& other) const
+{
+#if defined(COMPONENT_KEY_AVX2)
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		if (!_mm256_testz_si256(COMPONENT_KEY_LOAD(m_words + word), COMPONENT_KEY_LOAD(other.m_words + word)))
+		{
+			return true;
+		}
+	}
+	return false;
+#elif defined(COMPONENT_KEY_SSE2)
+	__m128i shared = _mm_setzero_si128();
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		shared = _mm_or_si128(shared, _mm_and_si128(COMPONENT_KEY_LOAD(m_words + word), COMPONENT_KEY_LOAD(other.m_words + word)));
+	}
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(shared, _mm_setzero_si128())) != 0xFFFF;
+#else
+	uint64_t shared = 0;
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; ++word)
+	{
+		shared |= m_words[word] & other.m_words[word];
+	}
+	return shared != 0;
+#endif
+}
+
+inline size_t ComponentKey::GetHash() const
+{
+	// Multiply the low and high halves of every word by distinct odd constants, and fold the products together.
+	const uint64_t lowMultiplier = 0x9E3779B1u;
+	const uint64_t highMultiplier = 0x85EBCA77u;
+	uint64_t folded[COMPONENT_KEY_FOLD_WORD_COUNT] = { };
+
+#if defined(COMPONENT_KEY_AVX2)
+	__m256i accumulator = _mm256_setzero_si256();
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		const __m256i lane = _mm256_add_epi64(COMPONENT_KEY_LOAD(m_words + word), _mm256_set1_epi64x(static_cast<long long>(word + 1)));
+		const __m256i low = _mm256_mul_epu32(lane, _mm256_set1_epi64x(lowMultiplier));
+		const __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(lane, 32), _mm256_set1_epi64x(highMultiplier));
+		accumulator = _mm256_xor_si256(_mm256_add_epi64(accumulator, low), high);
+	}
+	COMPONENT_KEY_STORE(folded, accumulator);
+#elif defined(COMPONENT_KEY_SSE2)
+	__m128i accumulator = _mm_setzero_si128();
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		const __m128i lane = _mm_add_epi64(COMPONENT_KEY_LOAD(m_words + word), _mm_set_epi32(0, static_cast<int>(word + 2), 0, static_cast<int>(word + 1)));
+		const __m128i low = _mm_mul_epu32(lane, _mm_set_epi32(0, static_cast<int>(lowMultiplier), 0, static_cast<int>(lowMultiplier)));
+		const __m128i high = _mm_mul_epu32(_mm_srli_epi64(lane, 32), _mm_set_epi32(0, static_cast<int>(highMultiplier), 0, static_cast<int>(highMultiplier)));
+		accumulator = _mm_xor_si128(_mm_add_epi64(accumulator, low), high);
+	}
+	COMPONENT_KEY_STORE(folded, accumulator);
+#else
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; ++word)
+	{
+		const uint64_t lane = m_words[word] + word + 1;
+		folded[0] = ((folded[0] + (lane & 0xFFFFFFFFu) * lowMultiplier)) ^ ((lane >> 32) * highMultiplier);
+	}
+#endif
+
+	// Mix the folded lanes into a single value.
+	uint64_t hash = 0;
+	for (const uint64_t value : folded)
+	{
+		hash = (hash ^ value) * 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 33;
+	}
+
+	return static_cast<size_t>(hash);
+}
+
+template<typename TFunction>
+inline void ComponentKey::ForEachComponent(TFunction function) const
+{
+	// Visit the set bits of every word, lowest first.
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; ++word)
+	{
+		uint64_t bits = m_words[word];
+		while (bits != 0)
+		{
+#if defined(_MSC_VER)
+			unsigned long bit = 0;
+			_BitScanForward64(&bit, bits);
+#else
+			const unsigned long bit = static_cast<unsigned long>(__builtin_ctzll(bits));
+#endif
+			function(static_cast<ComponentId>(word * 64 + bit));
+			bits &= bits - 1;
+		}
+	}
+}
+
+inline ComponentKey ComponentKey::operator&(const ComponentKey& other) const
+{
+	ComponentKey result;
+#if defined(COMPONENT_KEY_LANE_WORD_COUNT)
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		COMPONENT_KEY_STORE(result.m_words + word, COMPONENT_KEY_AND(COMPONENT_KEY_LOAD(m_words + word), COMPONENT_KEY_LOAD(other.m_words + word)));
+	}
+#else
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; ++word)
+	{
+		result.m_words[word] = m_words[word] & other.m_words[word];
+	}
+#endif
+	return result;
+}
+
+inline ComponentKey ComponentKey::operator|(const ComponentKey& other) const
+{
+	ComponentKey result;
+#if defined(COMPONENT_KEY_LANE_WORD_COUNT)
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		COMPONENT_KEY_STORE(result.m_words + word, COMPONENT_KEY_OR(COMPONENT_KEY_LOAD(m_words + word), COMPONENT_KEY_LOAD(other.m_words + word)));
+	}
+#else
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; ++word)
+	{
+		result.m_words[word] = m_words[word] | other.m_words[word];
+	}
+#endif
+	return result;
+}
+
+inline ComponentKey ComponentKey::operator^(const ComponentKey& other) const
+{
+	ComponentKey result;
+#if defined(COMPONENT_KEY_LANE_WORD_COUNT)
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		COMPONENT_KEY_STORE(result.m_words + word, COMPONENT_KEY_XOR(COMPONENT_KEY_LOAD(m_words + word), COMPONENT_KEY_LOAD(other.m_words + word)));
+	}
+#else
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; ++word)
+	{
+		result.m_words[word] = m_words[word] ^ other.m_words[word];
+	}
+#endif
+	return result;
+}
+
+inline bool ComponentKey::operator==(const ComponentKey& other) const
+{
+#if defined(COMPONENT_KEY_AVX2)
+	// Keys are equal when they have no differing bits.
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		const __m256i difference = _mm256_xor_si256(COMPONENT_KEY_LOAD(m_words + word), COMPONENT_KEY_LOAD(other.m_words + word));
+		if (!_mm256_testz_si256(difference, difference))
+		{
+			return false;
+		}
+	}
+	return true;
+#elif defined(COMPONENT_KEY_SSE2)
+	__m128i difference = _mm_setzero_si128();
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; word += COMPONENT_KEY_LANE_WORD_COUNT)
+	{
+		difference = _mm_or_si128(difference, _mm_xor_si128(COMPONENT_KEY_LOAD(m_words + word), COMPONENT_KEY_LOAD(other.m_words + word)));
+	}
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(difference, _mm_setzero_si128())) == 0xFFFF;
+#else
+	for (size_t word = 0; word < COMPONENT_KEY_WORD_COUNT; ++word)
+	{
+		if (m_words[word] != other.m_words[word])
+		{
+			return false;
+		}
+	}
+	return true;
+#endif
+}
@@ -1,8 +1,35 @@
 #pragma once
 #include "PCH.h"
+#include "AlignedAllocator.h"
+#include "Snapshot.h"
 #include "Types.h"
+#include "VirtualVector.h"
 #include "Macros.h"
 
+// Selects the container holding the packed data of a component type. Component types that grow to millions of instances,
+// or whose references must stay valid while more are added, opt into virtual memory storage by specializing it:
+// template<> struct ComponentStorage<ParticleComponent> : VirtualComponentStorage<ParticleComponent> {};
+template<typename TComponent>
+struct ComponentStorage
+{
+	using Type = AlignedVector<TComponent>;
+};
+
+template<typename TComponent>
+struct VirtualComponentStorage
+{
+	using Type = VirtualVector<TComponent>;
+};
+
+// The memory held by the packed data of a component type. Heap storage commits all it reserves.
+struct ComponentStorageStats
+{
+	ComponentId Id = 0;
+	size_t Count = 0;
+	size_t ReservedBytes = 0;
+	size_t CommittedBytes = 0;
+};
+
 class IComponentSet
 {
 public:
@@ -13,7 +40,17 @@ public:
 	virtual ~IComponentSet() = default;
 
 	virtual bool HaveComponent(Entity entity) const = 0;
+	virtual const void* GetComponent(Entity entity) const = 0;
+	virtual void AddComponents(const Entity* entities, size_t count, const void* component, ChangeTick tick) = 0;
 	virtual void RemoveComponent(Entity entity) = 0;
+	virtual void RemoveComponents(const Entity* entities, size_t count) = 0;
+	virtual void Reorder(const Entity* entities, size_t count) = 0;
+	virtual size_t GetComponentIndex(Entity entity) const = 0;
+	virtual const std::vector<Entity>& GetPackedEntities() const = 0;
+	virtual void SwapComponents(size_t first, size_t second) = 0;
+	virtual void SaveSnapshot(SnapshotWriter& writer) const = 0;
+	virtual bool LoadSnapshot(SnapshotReader& reader, size_t entitySlotCount) = 0;
+	virtual ComponentStorageStats GetStorageStats() const = 0;
 };
 
 template<typename TComponent>
@@ -23,102 +60,342 @@ public:
 	ComponentSet() = default;
 	~ComponentSet() = default;
 
-	void AddComponent(Entity entity, const TComponent& component);
+	void AddComponent(Entity entity, const TComponent& component, ChangeTick tick);
 	bool HaveComponent(Entity entity) const override;
+	const void* GetComponent(Entity entity) const override { return &GetComponentRead(entity); }
+	void AddComponents(const Entity* entities, size_t count, const void* component, ChangeTick tick) override;
 	const TComponent& GetComponentRead(Entity entity) const;
-	TComponent& GetComponentWrite(Entity entity);
+	TComponent& GetComponentWrite(Entity entity, ChangeTick tick);
 	void RemoveComponent(Entity entity) override;
+	void RemoveComponents(const Entity* entities, size_t count) override;
+	void Reorder(const Entity* entities, size_t count) override;
+	size_t GetComponentIndex(Entity entity) const override { return ComponentSet::HaveComponent(entity) ? GetDenseIndex(entity) : INVALID_INDEX; }
+	void SwapComponents(size_t first, size_t second) override;
+	void SaveSnapshot(SnapshotWriter& writer) const override;
+	bool LoadSnapshot(SnapshotReader& reader, size_t entitySlotCount) override;
+	ComponentStorageStats GetStorageStats() const override;
 
 	bool IsEmpty() const { return m_packedComponentData.empty(); }
+	size_t GetSize() const { return m_packedComponentData.size(); }
+
+	size_t GetDenseIndex(Entity entity) const;
+	const std::vector<Entity>& GetPackedEntities() const override { return m_packedEntities; }
+	TComponent& GetPackedComponentWrite(size_t index) { return m_packedComponentData[index]; }
+	ChangeTick GetAddedTick(size_t index) const { return m_packedAddedTicks[index]; }
+	ChangeTick GetChangedTick(size_t index) const { return m_packedChangedTicks[index]; }
+	void MarkChanged(size_t index, ChangeTick tick) { m_packedChangedTicks[index] = tick; }
+
+private:
+	void SetDenseIndex(Entity entity, size_t index);
+	void SavePackedComponents(SnapshotWriter& writer, std::true_type isTriviallyCopyable) const;
+	void SavePackedComponents(SnapshotWriter& writer, std::false_type isTriviallyCopyable) const;
+	bool LoadPackedComponents(SnapshotReader& reader, std::true_type isTriviallyCopyable);
+	bool LoadPackedComponents(SnapshotReader& reader, std::false_type isTriviallyCopyable);
+	static void GetStorageBytes(const AlignedVector<TComponent>& components, size_t& reservedBytes, size_t& committedBytes);
+	static void GetStorageBytes(const VirtualVector<TComponent>& components, size_t& reservedBytes, size_t& committedBytes);
 
 private:
-	std::unordered_map<Entity, size_t> m_entityIdToIndexMap;	// Book keeping map to help with lookup and erasing.
-	std::unordered_map<Entity, size_t> m_indexToEntityIdMap;	// Book keeping map to help with lookup and erasing.
-	std::vector<TComponent> m_packedComponentData;				// The contiguous vector of components.
+	std::vector<std::unique_ptr<size_t[]>> m_sparsePages;	// Pages of entity to dense index slots, allocated on first use.
+	std::vector<Entity> m_packedEntities;					// The owning entity of each component, parallel to the packed component vector.
+	typename ComponentStorage<TComponent>::Type m_packedComponentData;	// The contiguous vector of components, aligned as the component requires.
+	std::vector<ChangeTick> m_packedAddedTicks;				// The tick each component was added at, parallel to the packed component vector.
+	std::vector<ChangeTick> m_packedChangedTicks;			// The tick each component was last written at, parallel to the packed component vector.
 };
 
 template<typename TComponent>
-inline void ComponentSet<TComponent>::AddComponent(Entity entity, const TComponent& component)
+inline void ComponentSet<TComponent>::AddComponent(Entity entity, const TComponent& component, ChangeTick tick)
 {
-	// Check if the component already exists for this entity.
-	const auto iterator = m_entityIdToIndexMap.find(entity);
+	// Check if the component already exists for this entity, a slot owned by another generation means a stale handle.
+	const size_t index = GetDenseIndex(entity);
+	assert(index == INVALID_INDEX || m_packedEntities[index] == entity);
 
 	// If the entity does not have this component...
-	if (iterator == m_entityIdToIndexMap.end())
+	if (index == INVALID_INDEX)
 	{
-		// Add the component and update the book keeping maps.
+		// Add the component and update the book keeping arrays.
+		SetDenseIndex(entity, m_packedComponentData.size());
+		m_packedEntities.push_back(entity);
 		m_packedComponentData.push_back(component);
-		m_entityIdToIndexMap[entity] = m_packedComponentData.size() - 1;
-		m_indexToEntityIdMap[m_packedComponentData.size() - 1] = entity;
+		m_packedAddedTicks.push_back(tick);
+		m_packedChangedTicks.push_back(tick);
 	}
 
-	// Else overwrite this component.
+	// Else overwrite this component, which counts as a write.
 	else
 	{
-		const size_t index = iterator->second;
-		m_packedComponentData[index] = std::move(component);
+		m_packedComponentData[index] = component;
+		m_packedChangedTicks[index] = tick;
+	}
+}
+
+template<typename TComponent>
+inline void ComponentSet<TComponent>::AddComponents(const Entity* entities, size_t count, const void* component, ChangeTick tick)
+{
+	// Copy the source first, it may live in this very set and move when the set grows.
+	const TComponent source = *static_cast<const TComponent*>(component);
+
+	// Grow the packed vectors once, filling every new slot with a copy of the source.
+	const size_t firstIndex = m_packedComponentData.size();
+	m_packedEntities.insert(m_packedEntities.end(), entities, entities + count);
+	m_packedComponentData.resize(firstIndex + count, source);
+	m_packedAddedTicks.insert(m_packedAddedTicks.end(), count, tick);
+	m_packedChangedTicks.insert(m_packedChangedTicks.end(), count, tick);
+
+	// Point every entity at its new slot. The entities must not have the component yet.
+	for (size_t index = 0; index < count; ++index)
+	{
+		assert(GetDenseIndex(entities[index]) == INVALID_INDEX);
+		SetDenseIndex(entities[index], firstIndex + index);
 	}
 }
 
 template<typename TComponent>
 bool ComponentSet<TComponent>::HaveComponent(Entity entity) const
 {
-	return m_entityIdToIndexMap.find(entity) != m_entityIdToIndexMap.end();
+	// The slot may belong to a newer entity reusing the same index, so compare the full handle.
+	const size_t index = GetDenseIndex(entity);
+	return index != INVALID_INDEX && m_packedEntities[index] == entity;
 }
 
 template<typename TComponent>
 const TComponent& ComponentSet<TComponent>::GetComponentRead(Entity entity) const
 {
-	// Ensure the component is present, and return it.
-	const auto iterator = m_entityIdToIndexMap.find(entity);
-	assert(iterator != m_entityIdToIndexMap.end());
-	const size_t index = iterator->second;
+	// Ensure the component is present for this very entity, and not for an older or newer one reusing its index, and return it.
+	const size_t index = GetDenseIndex(entity);
+	assert(index != INVALID_INDEX && m_packedEntities[index] == entity);
 	return m_packedComponentData[index];
 }
 
-
 template<typename TComponent>
-TComponent& ComponentSet<TComponent>::GetComponentWrite(Entity entity)
+TComponent& ComponentSet<TComponent>::GetComponentWrite(Entity entity, ChangeTick tick)
 {
-	// Ensure the component is present, and return it.
-	const auto iterator = m_entityIdToIndexMap.find(entity);
-	assert(iterator != m_entityIdToIndexMap.end());
-	const size_t index = iterator->second;
+	// Ensure the component is present for this very entity, mark it as changed, and return it.
+	const size_t index = GetDenseIndex(entity);
+	assert(index != INVALID_INDEX && m_packedEntities[index] == entity);
+	m_packedChangedTicks[index] = tick;
 	return m_packedComponentData[index];
 }
 
 template<typename TComponent>
 void ComponentSet<TComponent>::RemoveComponent(Entity entity)
 {
-	// If the component is present for this entity...
-	const auto iterator = m_entityIdToIndexMap.find(entity);
-	if (iterator != m_entityIdToIndexMap.end())
+	// If the component is present for this entity, compare the full handle so a stale one cannot erase a newer entity's component...
+	const size_t toEraseComponentIndex = GetDenseIndex(entity);
+	if (toEraseComponentIndex != INVALID_INDEX && m_packedEntities[toEraseComponentIndex] == entity)
 	{
-		// Get the index and component to remove. Also get the component's owning entity.
-		const size_t toEraseComponentIndex = iterator->second;
-		TComponent& toEraseComponent = m_packedComponentData[toEraseComponentIndex];
-		const Entity toEraseComponentEntity = iterator->first;
-
-		// Get the last component and its index. Also get the component's owning entity.
+		// Get the last component's index and its owning entity.
 		const size_t toKeepComponentIndex = m_packedComponentData.size() - 1;
-		TComponent& toKeepComponent = m_packedComponentData[toKeepComponentIndex];
-		const Entity toKeepComponentEntity = m_indexToEntityIdMap[toKeepComponentIndex];
+		const Entity toKeepComponentEntity = m_packedEntities[toKeepComponentIndex];
 
-		// Swap the component to be erased with the last component.
-		std::swap(toEraseComponent, toKeepComponent);
+		// Move the last component and its owning entity into the slot being erased.
+		m_packedComponentData[toEraseComponentIndex] = std::move(m_packedComponentData[toKeepComponentIndex]);
+		m_packedEntities[toEraseComponentIndex] = toKeepComponentEntity;
+		m_packedAddedTicks[toEraseComponentIndex] = m_packedAddedTicks[toKeepComponentIndex];
+		m_packedChangedTicks[toEraseComponentIndex] = m_packedChangedTicks[toKeepComponentIndex];
 
-		// Swap the entity-index map contents.
-		std::swap(m_entityIdToIndexMap[toEraseComponentEntity], m_entityIdToIndexMap[toKeepComponentEntity]);
+		// Point the kept entity at its new slot, and invalidate the erased entity's slot.
+		SetDenseIndex(toKeepComponentEntity, toEraseComponentIndex);
+		SetDenseIndex(entity, INVALID_INDEX);
 
-		// Swap the index-entity map contents.
-		std::swap(m_indexToEntityIdMap[toEraseComponentIndex], m_indexToEntityIdMap[toKeepComponentIndex]);
+		// Erase the now duplicated last component and entity from the packed vectors.
+		m_packedComponentData.pop_back();
+		m_packedEntities.pop_back();
+		m_packedAddedTicks.pop_back();
+		m_packedChangedTicks.pop_back();
+	}
+}
 
-		// Erase the last component from the packed vector.
-		m_packedComponentData.erase(m_packedComponentData.end() - 1);
+template<typename TComponent>
+void ComponentSet<TComponent>::RemoveComponents(const Entity* entities, size_t count)
+{
+	// Swap and pop every entity in turn, with a single virtual call for the whole batch.
+	for (size_t index = 0; index < count; ++index)
+	{
+		ComponentSet::RemoveComponent(entities[index]);
+	}
+}
+
+template<typename TComponent>
+void ComponentSet<TComponent>::Reorder(const Entity* entities, size_t count)
+{
+	// Move the components of the given entities to the front of the packed vectors, in the given order. Entities without
+	// the component are skipped, the components of entities not given follow in no particular order.
+	size_t nextIndex = 0;
+	for (size_t index = 0; index < count; ++index)
+	{
+		const Entity entity = entities[index];
+		if (!ComponentSet::HaveComponent(entity))
+		{
+			continue;
+		}
 
-		// Erase the book keeping of data of the erased component.
-		m_entityIdToIndexMap.erase(toEraseComponentEntity); // Component for this entity no longer exists after the erase.
-		m_indexToEntityIdMap.erase(toKeepComponentIndex); // toKeepComponentIndex is no longer valid after erase.
+		// Everything before the next slot is already in place, an entity found there was given twice.
+		const size_t currentIndex = GetDenseIndex(entity);
+		if (currentIndex < nextIndex)
+		{
+			continue;
+		}
+
+		// Swap the entity into the next slot.
+		ComponentSet::SwapComponents(currentIndex, nextIndex);
+		++nextIndex;
 	}
 }
 
+template<typename TComponent>
+void ComponentSet<TComponent>::SwapComponents(size_t first, size_t second)
+{
+	if (first == second)
+	{
+		return;
+	}
+
+	// Swap the two slots of every packed vector, and point both entities at their new slots.
+	std::swap(m_packedComponentData[first], m_packedComponentData[second]);
+	std::swap(m_packedEntities[first], m_packedEntities[second]);
+	std::swap(m_packedAddedTicks[first], m_packedAddedTicks[second]);
+	std::swap(m_packedChangedTicks[first], m_packedChangedTicks[second]);
+	SetDenseIndex(m_packedEntities[first], first);
+	SetDenseIndex(m_packedEntities[second], second);
+}
+
+template<typename TComponent>
+void ComponentSet<TComponent>::SaveSnapshot(SnapshotWriter& writer) const
+{
+	// The sparse pages are not saved, they are rebuilt from the packed entities on load.
+	writer.WriteVector(m_packedEntities);
+	writer.WriteVector(m_packedAddedTicks);
+	writer.WriteVector(m_packedChangedTicks);
+	SavePackedComponents(writer, std::is_trivially_copyable<TComponent>());
+}
+
+template<typename TComponent>
+bool ComponentSet<TComponent>::LoadSnapshot(SnapshotReader& reader, size_t entitySlotCount)
+{
+	// The set must be empty, so every entity slot can be pointed at the dense index it was saved at.
+	assert(IsEmpty());
+	if (!reader.ReadVector(m_packedEntities) || !reader.ReadVector(m_packedAddedTicks) || !reader.ReadVector(m_packedChangedTicks) ||
+		!LoadPackedComponents(reader, std::is_trivially_copyable<TComponent>()))
+	{
+		return false;
+	}
+
+	// The packed vectors run in parallel.
+	const size_t count = m_packedEntities.size();
+	if (m_packedAddedTicks.size() != count || m_packedChangedTicks.size() != count || m_packedComponentData.size() != count)
+	{
+		return false;
+	}
+
+	// Every entity must name a saved entity slot, and own at most one component.
+	for (size_t index = 0; index < count; ++index)
+	{
+		const Entity entity = m_packedEntities[index];
+		if (GetEntityIndex(entity) >= entitySlotCount || GetDenseIndex(entity) != INVALID_INDEX)
+		{
+			return false;
+		}
+
+		SetDenseIndex(entity, index);
+	}
+
+	return true;
+}
+
+template<typename TComponent>
+ComponentStorageStats ComponentSet<TComponent>::GetStorageStats() const
+{
+	// The id is filled in by the registry, which knows where the set lives.
+	ComponentStorageStats stats;
+	stats.Count = m_packedComponentData.size();
+	GetStorageBytes(m_packedComponentData, stats.ReservedBytes, stats.CommittedBytes);
+	return stats;
+}
+
+template<typename TComponent>
+inline void ComponentSet<TComponent>::SavePackedComponents(SnapshotWriter& writer, std::true_type) const
+{
+	// Laid out like a vector written by the snapshot writer, whichever container holds the components.
+	writer.Write<uint64_t>(m_packedComponentData.size());
+	writer.WriteBytes(m_packedComponentData.data(), m_packedComponentData.size() * sizeof(TComponent));
+}
+
+template<typename TComponent>
+inline void ComponentSet<TComponent>::SavePackedComponents(SnapshotWriter& writer, std::false_type) const
+{
+	// Components owning resources cannot be restored from raw bytes, only an empty set can be saved.
+	assert(IsEmpty() && "Only trivially copyable components can be saved to a snapshot.");
+	writer.Write<uint64_t>(0);
+}
+
+template<typename TComponent>
+inline bool ComponentSet<TComponent>::LoadPackedComponents(SnapshotReader& reader, std::true_type)
+{
+	size_t count = 0;
+	if (!reader.ReadCount(sizeof(TComponent), count))
+	{
+		return false;
+	}
+
+	m_packedComponentData.resize(count);
+	return reader.ReadBytes(m_packedComponentData.data(), count * sizeof(TComponent));
+}
+
+template<typename TComponent>
+inline bool ComponentSet<TComponent>::LoadPackedComponents(SnapshotReader& reader, std::false_type)
+{
+	// Components owning resources cannot be restored from raw bytes, only an empty set was saved.
+	uint64_t componentCount = 0;
+	return reader.Read(componentCount) && componentCount == 0;
+}
+
+template<typename TComponent>
+inline void ComponentSet<TComponent>::GetStorageBytes(const AlignedVector<TComponent>& components, size_t& reservedBytes, size_t& committedBytes)
+{
+	reservedBytes = components.capacity() * sizeof(TComponent);
+	committedBytes = reservedBytes;
+}
+
+template<typename TComponent>
+inline void ComponentSet<TComponent>::GetStorageBytes(const VirtualVector<TComponent>& components, size_t& reservedBytes, size_t& committedBytes)
+{
+	reservedBytes = components.GetReservedBytes();
+	committedBytes = components.GetCommittedBytes();
+}
+
+template<typename TComponent>
+inline size_t ComponentSet<TComponent>::GetDenseIndex(Entity entity) const
+{
+	// Find the page holding the entity slot.
+	const size_t entityIndex = GetEntityIndex(entity);
+	const size_t page = entityIndex / SPARSE_PAGE_SIZE;
+
+	// An entity whose page was never allocated has no component in this set.
+	if (page >= m_sparsePages.size() || m_sparsePages[page] == nullptr)
+	{
+		return INVALID_INDEX;
+	}
+
+	return m_sparsePages[page][entityIndex & (SPARSE_PAGE_SIZE - 1)];
+}
+
+template<typename TComponent>
+inline void ComponentSet<TComponent>::SetDenseIndex(Entity entity, size_t index)
+{
+	// Find the page holding the entity slot, and make room for it if necessary.
+	const size_t entityIndex = GetEntityIndex(entity);
+	const size_t page = entityIndex / SPARSE_PAGE_SIZE;
+	if (page >= m_sparsePages.size())
+	{
+		m_sparsePages.resize(page + 1);
+	}
+
+	// Allocate the page on first use, with every slot marked as empty.
+	if (m_sparsePages[page] == nullptr)
+	{
+		m_sparsePages[page].reset(new size_t[SPARSE_PAGE_SIZE]);
+		std::fill_n(m_sparsePages[page].get(), SPARSE_PAGE_SIZE, INVALID_INDEX);
+	}
+
+	m_sparsePages[page][entityIndex & (SPARSE_PAGE_SIZE - 1)] = index;
+}
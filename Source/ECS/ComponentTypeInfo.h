@@ -0,0 +1,47 @@
+#pragma once
+#include "PCH.h"
+#include "ComponentSet.h"
+#include "SharedComponent.h"
+
+using SharedComponentTableFactory = ISharedComponentTable* (*)();
+
+// Type erased description of a component, used to create, copy and relocate components without knowing their type.
+struct ComponentTypeInfo
+{
+	size_t Size = 0;
+	size_t Alignment = 0;
+	bool IsTriviallyCopyable = false;	// Can the component be copied with memcpy.
+	void (*CopyConstruct)(void* destination, const void* source) = nullptr;
+	void (*MoveConstruct)(void* destination, void* source) = nullptr;
+	void (*Destroy)(void* component) = nullptr;
+	IComponentSet* (*CreateComponentSet)() = nullptr;
+	SharedComponentTableFactory CreateSharedComponentTable = nullptr;	// Only set for SharedComponent types, creates their table of values.
+};
+
+// Components have no value table, the SharedComponent of a value type has the table of its distinct values.
+template<typename TComponent>
+SharedComponentTableFactory GetSharedComponentTableFactory(const TComponent*)
+{
+	return nullptr;
+}
+
+template<typename TComponent>
+SharedComponentTableFactory GetSharedComponentTableFactory(const SharedComponent<TComponent>*)
+{
+	return []() { return static_cast<ISharedComponentTable*>(new SharedComponentTable<TComponent>()); };
+}
+
+template<typename TComponent>
+ComponentTypeInfo MakeComponentTypeInfo()
+{
+	ComponentTypeInfo componentTypeInfo;
+	componentTypeInfo.Size = sizeof(TComponent);
+	componentTypeInfo.Alignment = alignof(TComponent);
+	componentTypeInfo.IsTriviallyCopyable = std::is_trivially_copyable<TComponent>::value;
+	componentTypeInfo.CopyConstruct = [](void* destination, const void* source) { new (destination) TComponent(*static_cast<const TComponent*>(source)); };
+	componentTypeInfo.MoveConstruct = [](void* destination, void* source) { new (destination) TComponent(std::move(*static_cast<TComponent*>(source))); };
+	componentTypeInfo.Destroy = [](void* component) { static_cast<TComponent*>(component)->~TComponent(); };
+	componentTypeInfo.CreateComponentSet = []() { return static_cast<IComponentSet*>(new ComponentSet<TComponent>()); };
+	componentTypeInfo.CreateSharedComponentTable = GetSharedComponentTableFactory(static_cast<const TComponent*>(nullptr));
+	return componentTypeInfo;
+}
@@ -0,0 +1,517 @@
+#pragma once
+#include "PCH.h"
+#include "Archetype.h"
+#include "CommandBuffer.h"
+#include "ComponentIdGenerator.h"
+#include "ComponentKey.h"
+#include "ComponentSet.h"
+#include "JobSystem/JobSystem.h"
+#include "Types.h"
+
+// Is a type one of the types of a pack.
+template<typename T, typename... TTypes> struct IsAnyOf : std::false_type {};
+template<typename T, typename TFirst, typename... TTypes> struct IsAnyOf<T, TFirst, TTypes...> : std::conditional_t<std::is_same<T, TFirst>::value, std::true_type, IsAnyOf<T, TTypes...>> {};
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// A typed query over every entity that has all of the view components. Components requested as const are read only.
+// The parallel variants call the function concurrently from several threads, so it must only touch the visited entity.
+// Visiting a component requested as non const marks it as changed at the view tick, whether the function writes it or not.
+// The Added and Changed filters compare against per slot ticks in sparse set storage mode, and against per chunk ticks
+// in archetype storage mode, where every row of a chunk holding a single added or changed row is visited.
+// In sparse set storage mode, a view over exactly the components of an owned group walks the group's co-sorted prefix of
+// every component set in lockstep, without probing any sparse array. The group's arrays can then also be visited as a
+// single chunk, without filters. Other sparse set views visit chunks of a single entity.
+template<typename... TComponents>
+class ComponentView final
+{
+	using ComponentSets = std::tuple<ComponentSet<std::remove_const_t<TComponents>>*...>;
+
+public:
+	ComponentView(ChangeTick changeTick, ComponentSet<std::remove_const_t<TComponents>>*... componentSets);
+	ComponentView(ChangeTick changeTick, const std::vector<std::unique_ptr<Archetype>>& archetypes);
+
+	template<typename TComponent> ComponentView& Added(ChangeTick sinceTick);
+	template<typename TComponent> ComponentView& Changed(ChangeTick sinceTick);
+	void SetGroupSize(size_t groupSize) { m_groupSize = groupSize; }
+
+	template<typename TFunction> void Each(TFunction function);
+	template<typename TFunction> void EachChunk(TFunction function);
+	template<typename TFunction> void ParallelEach(TFunction function, size_t serialThreshold = PARALLEL_FOR_SERIAL_THRESHOLD);
+	template<typename TFunction> void ParallelEachChunk(TFunction function, size_t serialThreshold = PARALLEL_FOR_SERIAL_THRESHOLD);
+
+private:
+	template<typename TFunction, size_t... Indices> void EachComponentSet(TFunction& function, std::index_sequence<Indices...>);
+	template<typename TFunction, size_t... Indices> void ParallelEachComponentSet(TFunction& function, size_t serialThreshold, std::index_sequence<Indices...>);
+	template<typename TFunction, size_t... Indices> void EachComponentSetRange(TFunction& function, size_t drivingComponentSet, size_t begin, size_t end, std::index_sequence<Indices...>);
+	template<typename TFunction, size_t... Indices> void EachGroupRange(TFunction& function, size_t begin, size_t end, std::index_sequence<Indices...>);
+	template<typename TFunction, size_t... Indices> void VisitGroupChunk(TFunction& function, size_t begin, size_t end, std::index_sequence<Indices...>);
+	bool IsGrouped() const { return m_archetypes == nullptr && m_groupSize != INVALID_INDEX; }
+	template<size_t... Indices> bool PassesFilters(const size_t* denseIndices, std::index_sequence<Indices...>) const;
+	template<size_t Index> bool PassesFilters(size_t denseIndex) const;
+	template<size_t Index> void MarkChanged(size_t denseIndex);
+	bool PassesFilters(const Archetype& archetype, size_t chunkIndex) const;
+	template<typename TFunction> void VisitChunk(TFunction& function, Archetype& archetype, size_t chunkIndex);
+	bool HasFilters() const { return m_addedComponents.Any() || m_changedComponents.Any(); }
+	size_t GetSmallestComponentSet(std::index_sequence<>) const { return INVALID_INDEX; }
+	template<size_t... Indices> size_t GetSmallestComponentSet(std::index_sequence<Indices...>) const;
+
+private:
+	ComponentSets m_componentSets;										// The component sets to join in sparse set storage mode.
+	const std::vector<std::unique_ptr<Archetype>>* m_archetypes = nullptr;	// The archetypes to walk in archetype storage mode.
+	ComponentKey m_requiredComponents;									// The components a visited archetype must contain.
+	ComponentKey m_writtenComponents;									// The components requested as non const.
+	ComponentKey m_addedComponents;										// The components that must have been added since the filter tick.
+	ComponentKey m_changedComponents;									// The components that must have been written since the filter tick.
+	ChangeTick m_changeTick = 0;										// The tick written components are marked as changed at.
+	ChangeTick m_sinceTick = 0;											// Only additions and writes after this tick pass the filters.
+	size_t m_groupSize = INVALID_INDEX;									// The size of the owned group the view components match exactly, if any.
+};
+
+template<typename... TComponents>
+inline ComponentView<TComponents...>::ComponentView(ChangeTick changeTick, ComponentSet<std::remove_const_t<TComponents>>*... componentSets)
+	: m_componentSets(componentSets...)
+	, m_changeTick(changeTick)
+{
+}
+
+template<typename... TComponents>
+inline ComponentView<TComponents...>::ComponentView(ChangeTick changeTick, const std::vector<std::unique_ptr<Archetype>>& archetypes)
+	: m_archetypes(&archetypes)
+	, m_changeTick(changeTick)
+{
+	// Build the component key every visited archetype must contain, and the key of the columns visits write to.
+	const ComponentId componentIds[] = { ComponentIdGenerator::GetComponentId<std::remove_const_t<TComponents>>()... };
+	const bool isWritten[] = { !std::is_const<TComponents>::value... };
+	for (size_t index = 0; index < sizeof...(TComponents); ++index)
+	{
+		m_requiredComponents.Set(componentIds[index]);
+		if (isWritten[index])
+		{
+			m_writtenComponents.Set(componentIds[index]);
+		}
+	}
+}
+
+template<typename... TComponents>
+template<typename TComponent>
+inline ComponentView<TComponents...>& ComponentView<TComponents...>::Added(ChangeTick sinceTick)
+{
+	static_assert(IsAnyOf<TComponent, std::remove_const_t<TComponents>...>::value, "Only view components can be filtered on.");
+
+	// All filters of a view share the same tick, usually the last tick the querying system ran at.
+	assert(!HasFilters() || m_sinceTick == sinceTick);
+	m_addedComponents.Set(ComponentIdGenerator::GetComponentId<TComponent>());
+	m_sinceTick = sinceTick;
+	return *this;
+}
+
+template<typename... TComponents>
+template<typename TComponent>
+inline ComponentView<TComponents...>& ComponentView<TComponents...>::Changed(ChangeTick sinceTick)
+{
+	static_assert(IsAnyOf<TComponent, std::remove_const_t<TComponents>...>::value, "Only view components can be filtered on.");
+
+	// All filters of a view share the same tick, usually the last tick the querying system ran at.
+	assert(!HasFilters() || m_sinceTick == sinceTick);
+	m_changedComponents.Set(ComponentIdGenerator::GetComponentId<TComponent>());
+	m_sinceTick = sinceTick;
+	return *this;
+}
+
+template<typename... TComponents>
+template<typename TFunction>
+inline void ComponentView<TComponents...>::Each(TFunction function)
+{
+	// In sparse set storage mode join the component sets directly.
+	if (m_archetypes == nullptr)
+	{
+		EachComponentSet(function, std::index_sequence_for<TComponents...>());
+		return;
+	}
+
+	// In archetype storage mode walk every matching chunk row by row.
+	EachChunk([&function](size_t count, const Entity* entities, TComponents*... components)
+	{
+		for (size_t row = 0; row < count; ++row)
+		{
+			function(entities[row], components[row]...);
+		}
+	});
+}
+
+template<typename... TComponents>
+template<typename TFunction>
+inline void ComponentView<TComponents...>::EachChunk(TFunction function)
+{
+	// An owned group is a single chunk of co-sorted arrays.
+	if (IsGrouped())
+	{
+		VisitGroupChunk(function, 0, m_groupSize, std::index_sequence_for<TComponents...>());
+		return;
+	}
+
+	// Component sets outside a group are not co-sorted, so every entity is a chunk of its own.
+	if (m_archetypes == nullptr)
+	{
+		auto visitEntity = [&function](Entity entity, TComponents&... components)
+		{
+			function(size_t(1), &entity, &components...);
+		};
+		EachComponentSet(visitEntity, std::index_sequence_for<TComponents...>());
+		return;
+	}
+
+	// For each archetype that has all the view components...
+	for (const std::unique_ptr<Archetype>& archetype : *m_archetypes)
+	{
+		if (!archetype->GetComponentKey().Contains(m_requiredComponents))
+		{
+			continue;
+		}
+
+		// Hand every chunk passing the filters to the function.
+		for (size_t chunkIndex = 0; chunkIndex < archetype->GetChunkCount(); ++chunkIndex)
+		{
+			if (PassesFilters(*archetype, chunkIndex))
+			{
+				VisitChunk(function, *archetype, chunkIndex);
+			}
+		}
+	}
+}
+
+template<typename... TComponents>
+template<typename TFunction>
+inline void ComponentView<TComponents...>::ParallelEach(TFunction function, size_t serialThreshold)
+{
+	// In sparse set storage mode split the driving set's dense range in batches.
+	if (m_archetypes == nullptr)
+	{
+		ParallelEachComponentSet(function, serialThreshold, std::index_sequence_for<TComponents...>());
+		return;
+	}
+
+	// In archetype storage mode hand out whole chunks, and walk every chunk row by row.
+	ParallelEachChunk([&function](size_t count, const Entity* entities, TComponents*... components)
+	{
+		for (size_t row = 0; row < count; ++row)
+		{
+			function(entities[row], components[row]...);
+		}
+	}, serialThreshold);
+}
+
+template<typename... TComponents>
+template<typename TFunction>
+inline void ComponentView<TComponents...>::ParallelEachChunk(TFunction function, size_t serialThreshold)
+{
+	// An owned group splits in batches of its co-sorted arrays.
+	if (IsGrouped())
+	{
+		if (m_groupSize < serialThreshold)
+		{
+			VisitGroupChunk(function, 0, m_groupSize, std::index_sequence_for<TComponents...>());
+			return;
+		}
+
+		ParallelForOrdered(m_groupSize, PARALLEL_FOR_BATCH_ALIGNMENT, [this, &function](size_t begin, size_t end)
+		{
+			VisitGroupChunk(function, begin, end, std::index_sequence_for<TComponents...>());
+		});
+		return;
+	}
+
+	// Component sets outside a group are not co-sorted, so every entity is a chunk of its own.
+	if (m_archetypes == nullptr)
+	{
+		auto visitEntity = [&function](Entity entity, TComponents&... components)
+		{
+			function(size_t(1), &entity, &components...);
+		};
+		ParallelEachComponentSet(visitEntity, serialThreshold, std::index_sequence_for<TComponents...>());
+		return;
+	}
+
+	// Gather every matching chunk passing the filters up front, so they can be split between threads.
+	std::vector<std::pair<Archetype*, size_t>> chunks;
+	size_t entityCount = 0;
+	for (const std::unique_ptr<Archetype>& archetype : *m_archetypes)
+	{
+		if (!archetype->GetComponentKey().Contains(m_requiredComponents))
+		{
+			continue;
+		}
+
+		for (size_t chunkIndex = 0; chunkIndex < archetype->GetChunkCount(); ++chunkIndex)
+		{
+			if (PassesFilters(*archetype, chunkIndex))
+			{
+				chunks.emplace_back(archetype.get(), chunkIndex);
+				entityCount += archetype->GetChunkSize(chunkIndex);
+			}
+		}
+	}
+
+	// Small views are cheaper to walk on the calling thread.
+	if (entityCount < serialThreshold)
+	{
+		for (const std::pair<Archetype*, size_t>& chunk : chunks)
+		{
+			VisitChunk(function, *chunk.first, chunk.second);
+		}
+		return;
+	}
+
+	// Chunks are already cache line aligned, so any chunk boundary is a valid batch boundary.
+	ParallelForOrdered(chunks.size(), 1, [this, &function, &chunks](size_t begin, size_t end)
+	{
+		for (size_t index = begin; index < end; ++index)
+		{
+			VisitChunk(function, *chunks[index].first, chunks[index].second);
+		}
+	});
+}
+
+template<typename... TComponents>
+template<typename TFunction, size_t... Indices>
+inline void ComponentView<TComponents...>::EachComponentSet(TFunction& function, std::index_sequence<Indices...> indices)
+{
+	// An owned group is walked in lockstep.
+	if (IsGrouped())
+	{
+		EachGroupRange(function, 0, m_groupSize, indices);
+		return;
+	}
+
+	// Drive the iteration from the smallest set, every other set is probed through its sparse array.
+	const size_t smallestComponentSet = GetSmallestComponentSet(indices);
+	if (smallestComponentSet == INVALID_INDEX)
+	{
+		return;
+	}
+
+	const size_t sizes[] = { std::get<Indices>(m_componentSets)->GetSize()... };
+	EachComponentSetRange(function, smallestComponentSet, 0, sizes[smallestComponentSet], indices);
+}
+
+template<typename... TComponents>
+template<typename TFunction, size_t... Indices>
+inline void ComponentView<TComponents...>::ParallelEachComponentSet(TFunction& function, size_t serialThreshold, std::index_sequence<Indices...> indices)
+{
+	// An owned group is split in batches walked in lockstep.
+	if (IsGrouped())
+	{
+		if (m_groupSize < serialThreshold)
+		{
+			EachGroupRange(function, 0, m_groupSize, indices);
+			return;
+		}
+
+		ParallelForOrdered(m_groupSize, PARALLEL_FOR_BATCH_ALIGNMENT, [this, &function, indices](size_t begin, size_t end)
+		{
+			EachGroupRange(function, begin, end, indices);
+		});
+		return;
+	}
+
+	const size_t smallestComponentSet = GetSmallestComponentSet(indices);
+	if (smallestComponentSet == INVALID_INDEX)
+	{
+		return;
+	}
+
+	// Small views are cheaper to walk on the calling thread.
+	const size_t sizes[] = { std::get<Indices>(m_componentSets)->GetSize()... };
+	const size_t count = sizes[smallestComponentSet];
+	if (count < serialThreshold)
+	{
+		EachComponentSetRange(function, smallestComponentSet, 0, count, indices);
+		return;
+	}
+
+	// Batches hold a multiple of the batch alignment, so neighboring threads rarely write to the same cache line.
+	ParallelForOrdered(count, PARALLEL_FOR_BATCH_ALIGNMENT, [this, &function, smallestComponentSet, indices](size_t begin, size_t end)
+	{
+		EachComponentSetRange(function, smallestComponentSet, begin, end, indices);
+	});
+}
+
+template<typename... TComponents>
+template<typename TFunction, size_t... Indices>
+inline void ComponentView<TComponents...>::EachComponentSetRange(TFunction& function, size_t drivingComponentSet, size_t begin, size_t end, std::index_sequence<Indices...> indices)
+{
+	const std::vector<Entity>* packedEntitiesPerSet[] = { &std::get<Indices>(m_componentSets)->GetPackedEntities()... };
+	const std::vector<Entity>& packedEntities = *packedEntitiesPerSet[drivingComponentSet];
+	const bool hasFilters = HasFilters();
+
+	for (size_t index = begin; index < end; ++index)
+	{
+		const Entity entity = packedEntities[index];
+
+		// Look up the entity's slot in every set, and skip it if any of the components is missing.
+		const size_t denseIndices[] = { std::get<Indices>(m_componentSets)->GetDenseIndex(entity)... };
+		if (std::find(std::begin(denseIndices), std::end(denseIndices), INVALID_INDEX) != std::end(denseIndices))
+		{
+			continue;
+		}
+
+		// Skip the entity if its components were not added or written since the filter tick.
+		if (hasFilters && !PassesFilters(denseIndices, indices))
+		{
+			continue;
+		}
+
+		// Mark the components handed out for writing as changed.
+		const int marks[] = { (MarkChanged<Indices>(denseIndices[Indices]), 0)... };
+		(void)marks;
+
+		function(entity, static_cast<TComponents&>(std::get<Indices>(m_componentSets)->GetPackedComponentWrite(denseIndices[Indices]))...);
+	}
+}
+
+template<typename... TComponents>
+template<typename TFunction, size_t... Indices>
+inline void ComponentView<TComponents...>::EachGroupRange(TFunction& function, size_t begin, size_t end, std::index_sequence<Indices...> indices)
+{
+	// The component sets of an empty group may not exist yet.
+	if (begin == end)
+	{
+		return;
+	}
+
+	// Every entity of the group sits at the same dense index in every component set.
+	const std::vector<Entity>& packedEntities = std::get<0>(m_componentSets)->GetPackedEntities();
+	const bool hasFilters = HasFilters();
+
+	for (size_t index = begin; index < end; ++index)
+	{
+		const size_t denseIndices[] = { (static_cast<void>(Indices), index)... };
+		if (hasFilters && !PassesFilters(denseIndices, indices))
+		{
+			continue;
+		}
+
+		// Mark the components handed out for writing as changed.
+		const int marks[] = { (MarkChanged<Indices>(index), 0)... };
+		(void)marks;
+
+		function(packedEntities[index], static_cast<TComponents&>(std::get<Indices>(m_componentSets)->GetPackedComponentWrite(index))...);
+	}
+}
+
+template<typename... TComponents>
+template<typename TFunction, size_t... Indices>
+inline void ComponentView<TComponents...>::VisitGroupChunk(TFunction& function, size_t begin, size_t end, std::index_sequence<Indices...>)
+{
+	// Filters are per slot, they cannot be applied to whole arrays.
+	assert(!HasFilters());
+	if (begin == end)
+	{
+		return;
+	}
+
+	// Mark the components handed out for writing as changed.
+	for (size_t index = begin; index < end; ++index)
+	{
+		const int marks[] = { (MarkChanged<Indices>(index), 0)... };
+		(void)marks;
+	}
+
+	// Hand the group's entities and component arrays to the function.
+	function(
+		end - begin,
+		std::get<0>(m_componentSets)->GetPackedEntities().data() + begin,
+		static_cast<TComponents*>(&std::get<Indices>(m_componentSets)->GetPackedComponentWrite(begin))...
+	);
+}
+
+template<typename... TComponents>
+template<size_t... Indices>
+inline bool ComponentView<TComponents...>::PassesFilters(const size_t* denseIndices, std::index_sequence<Indices...>) const
+{
+	const bool passes[] = { PassesFilters<Indices>(denseIndices[Indices])... };
+	return std::find(std::begin(passes), std::end(passes), false) == std::end(passes);
+}
+
+template<typename... TComponents>
+template<size_t Index>
+inline bool ComponentView<TComponents...>::PassesFilters(size_t denseIndex) const
+{
+	using TComponent = std::remove_const_t<std::tuple_element_t<Index, std::tuple<TComponents...>>>;
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+
+	// Every filter on the component must see a tick newer than the filter tick.
+	const ComponentSet<TComponent>* componentSet = std::get<Index>(m_componentSets);
+	if (m_addedComponents.Test(componentId) && componentSet->GetAddedTick(denseIndex) <= m_sinceTick)
+	{
+		return false;
+	}
+
+	return !m_changedComponents.Test(componentId) || componentSet->GetChangedTick(denseIndex) > m_sinceTick;
+}
+
+template<typename... TComponents>
+template<size_t Index>
+inline void ComponentView<TComponents...>::MarkChanged(size_t denseIndex)
+{
+	// Only components requested as non const can be written through the view.
+	if (!std::is_const<std::tuple_element_t<Index, std::tuple<TComponents...>>>::value)
+	{
+		std::get<Index>(m_componentSets)->MarkChanged(denseIndex, m_changeTick);
+	}
+}
+
+template<typename... TComponents>
+inline bool ComponentView<TComponents...>::PassesFilters(const Archetype& archetype, size_t chunkIndex) const
+{
+	if (!HasFilters())
+	{
+		return true;
+	}
+
+	// Every filtered column of the chunk must have seen a tick newer than the filter tick.
+	bool passes = true;
+	m_addedComponents.ForEachComponent([this, &archetype, chunkIndex, &passes](ComponentId componentId)
+	{
+		passes = passes && archetype.GetAddedTick(componentId, chunkIndex) > m_sinceTick;
+	});
+	m_changedComponents.ForEachComponent([this, &archetype, chunkIndex, &passes](ComponentId componentId)
+	{
+		passes = passes && archetype.GetChangedTick(componentId, chunkIndex) > m_sinceTick;
+	});
+	return passes;
+}
+
+template<typename... TComponents>
+template<typename TFunction>
+inline void ComponentView<TComponents...>::VisitChunk(TFunction& function, Archetype& archetype, size_t chunkIndex)
+{
+	// Mark the columns handed out for writing as changed.
+	m_writtenComponents.ForEachComponent([this, &archetype, chunkIndex](ComponentId componentId)
+	{
+		archetype.MarkChanged(componentId, chunkIndex, m_changeTick);
+	});
+
+	// Hand the chunk's entities and component columns to the function.
+	function(
+		archetype.GetChunkSize(chunkIndex),
+		archetype.GetEntities(chunkIndex),
+		static_cast<TComponents*>(archetype.GetColumn(ComponentIdGenerator::GetComponentId<std::remove_const_t<TComponents>>(), chunkIndex))...
+	);
+}
+
+template<typename... TComponents>
+template<size_t... Indices>
+inline size_t ComponentView<TComponents...>::GetSmallestComponentSet(std::index_sequence<Indices...>) const
+{
+	// A view over a component no entity ever had is empty.
+	const IComponentSet* componentSets[] = { std::get<Indices>(m_componentSets)... };
+	if (std::find(std::begin(componentSets), std::end(componentSets), nullptr) != std::end(componentSets))
+	{
+		return INVALID_INDEX;
+	}
+
+	const size_t sizes[] = { std::get<Indices>(m_componentSets)->GetSize()... };
+	return std::min_element(std::begin(sizes), std::end(sizes)) - std::begin(sizes);
+}
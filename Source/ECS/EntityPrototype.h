@@ -0,0 +1,31 @@
+#pragma once
+#include "PCH.h"
+#include "AlignedAllocator.h"
+#include "ComponentIdGenerator.h"
+#include "ComponentKey.h"
+#include "Types.h"
+
+// A set of component values to instantiate many identical entities from in one go.
+class EntityPrototype final
+{
+public:
+	template<typename TComponent> void AddComponent(const TComponent& component);
+
+	const ComponentKey& GetComponentKey() const { return m_componentKey; }
+	const void* GetComponent(ComponentId componentId) const { return m_components[componentId].get(); }
+
+private:
+	ComponentKey m_componentKey;																				// The set of components every instance gets.
+	std::vector<std::shared_ptr<void>> m_components = std::vector<std::shared_ptr<void>>(COMPONENT_COUNT);	// The component values, indexed by component id.
+};
+
+template<typename TComponent>
+inline void EntityPrototype::AddComponent(const TComponent& component)
+{
+	// Get the component id to index into the component arrays.
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+
+	// Store an aligned copy of the component, replacing any previous value.
+	m_components[componentId] = std::allocate_shared<TComponent>(AlignedAllocator<TComponent>(), component);
+	m_componentKey.Set(componentId);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "PCH.h"
+
+constexpr uint32_t MORTON_COORDINATE_BITS = 21;								// The bits of every coordinate that fit in a 64 bit code.
+constexpr uint32_t MORTON_COORDINATE_MAX = (1u << MORTON_COORDINATE_BITS) - 1;
+constexpr uint32_t MORTON_COORDINATE_BIAS = 1u << (MORTON_COORDINATE_BITS - 1);	// Centers the grid on the origin, so negative positions keep their order.
+
+// Spreads the low 21 bits of the value so two zero bits follow each of them.
+inline uint64_t SpreadMortonBits(uint32_t value)
+{
+	uint64_t bits = value & MORTON_COORDINATE_MAX;
+	bits = (bits | (bits << 32)) & 0x001f00000000ffffULL;
+	bits = (bits | (bits << 16)) & 0x001f0000ff0000ffULL;
+	bits = (bits | (bits << 8)) & 0x100f00f00f00f00fULL;
+	bits = (bits | (bits << 4)) & 0x10c30c30c30c30c3ULL;
+	bits = (bits | (bits << 2)) & 0x1249249249249249ULL;
+	return bits;
+}
+
+// Interleaves the bits of three grid coordinates, so cells close in space mostly get codes close in value.
+inline uint64_t GetMortonCode(uint32_t x, uint32_t y, uint32_t z)
+{
+	return SpreadMortonBits(x) | (SpreadMortonBits(y) << 1) | (SpreadMortonBits(z) << 2);
+}
+
+// Quantizes a position to a grid of the given cell size, clamping positions that fall outside of the grid to its edge.
+inline uint64_t GetMortonCode(float x, float y, float z, float cellSize)
+{
+	const auto quantize = [cellSize](float value)
+	{
+		// Clamp before converting, far away and invalid positions do not fit in an integer.
+		const double cell = std::floor(static_cast<double>(value) / cellSize) + MORTON_COORDINATE_BIAS;
+		if (!(cell > 0.0))
+		{
+			return 0u;
+		}
+
+		return cell < MORTON_COORDINATE_MAX ? static_cast<uint32_t>(cell) : MORTON_COORDINATE_MAX;
+	};
+
+	return GetMortonCode(quantize(x), quantize(y), quantize(z));
+}
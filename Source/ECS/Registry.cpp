@@ -1,6 +1,30 @@
 #include "PCH.h"
 #include "Registry.h"
 
+Registry::Registry()
+	: m_ownedEventManager(std::make_unique<EventManager>())
+	, m_eventManager(*m_ownedEventManager)
+{
+}
+
+Registry::Registry(EventManager& eventManager)
+	: m_eventManager(eventManager)
+{
+}
+
+Registry::~Registry()
+{
+	// A background sort may still be writing the component order.
+	m_jobSystem.Wait(m_componentOrderJobCount);
+}
+
+Registry& Registry::GetInstance()
+{
+	// The engine world delivers its events through the shared event manager.
+	static Registry instance(EventManager::GetInstanceWrite());
+	return instance;
+}
+
 void Registry::RunSystemsInitialize()
 {
 	// Process all initial entity, component, and tag creation requests.
@@ -17,18 +41,61 @@ void Registry::RunSystemsInitialize()
 
 void Registry::RunSystemsUpdate(float delatTime)
 {
-	// Run the update routine of a system, then process all pending events and requests it may have emitted.
-	for (const std::unique_ptr<ISystem>& system : m_systems)
+	// Make sure every thread that may run a system has its own command buffers.
+	ReserveCommandBuffers();
+
+	// Reorder the component storage if a requested order finished sorting, before any system holds on to component positions.
+	ApplyComponentOrder();
+
+	// Regroup the systems into phases if systems were added since the last update.
+	if (m_isSystemScheduleDirty)
+	{
+		BuildSystemSchedule();
+	}
+
+	// Run the update routine of every system in a phase, then process all pending events and requests they may have emitted.
+	for (const std::vector<ISystem*>& systemPhase : m_systemPhases)
 	{
+		// Every phase gets its own tick, so a system sees the changes of the systems that ran after it on its next update.
+		const ChangeTick tick = ++m_changeTick;
+
 		m_eventManager.Update();
 		ProcessPendingComponents();
 		ProcessPendingEntities();
 		ProcessPendingTags();
 
+		// Systems within a phase do not touch each other's components, so they update concurrently.
+		std::vector<Job> systemJobs;
+		systemJobs.reserve(systemPhase.size());
+		for (size_t systemIndex = 0; systemIndex < systemPhase.size(); ++systemIndex)
+		{
+			// Commands are keyed by the position of their system in the phase, and replayed in that order.
+			CommandKey commandKey;
+			commandKey.Producer = static_cast<uint32_t>(systemIndex + 1);
+
+			ISystem* system = systemPhase[systemIndex];
+			systemJobs.push_back([system, delatTime, tick, commandKey]()
+			{
+				CommandKeyScope commandKeyScope(commandKey);
+				system->Update(delatTime);
+				system->SetLastUpdateTick(tick);
+			});
+		}
+
 		m_isInSystemUpdate = true;
-		system->Update(delatTime);
+		m_jobSystem.Execute(systemJobs);
 		m_isInSystemUpdate = false;
 	}
+
+	// Apply what the last phase emitted, and hand the frame's component additions and removals to their observers.
+	m_eventManager.Update();
+	ProcessPendingComponents();
+	ProcessPendingEntities();
+	ProcessPendingTags();
+	NotifyComponentObservers();
+
+	// Changes made outside of the update must be newer than the last update tick of every system.
+	++m_changeTick;
 }
 
 void Registry::RunSystemsRender()
@@ -36,6 +103,8 @@ void Registry::RunSystemsRender()
 	// Run the render routine of a system, then process all pending events and requests it may have emitted.
 	for (const std::unique_ptr<ISystem>& system : m_systems)
 	{
+		const ChangeTick tick = ++m_changeTick;
+
 		m_eventManager.Update();
 		ProcessPendingComponents();
 		ProcessPendingEntities();
@@ -43,8 +112,168 @@ void Registry::RunSystemsRender()
 
 		m_isInSystemRender = true;
 		system->Render();
+		system->SetLastRenderTick(tick);
 		m_isInSystemRender = false;
 	}
+
+	// Changes made outside of the render must be newer than the last render tick of every system.
+	++m_changeTick;
+}
+
+static bool SystemsConflict(const ISystem& firstSystem, const ISystem& secondSystem)
+{
+	// Systems that did not declare their component access conflict with everything.
+	if (!firstSystem.CanRunInParallel() || !secondSystem.CanRunInParallel())
+	{
+		return true;
+	}
+
+	// Otherwise they conflict when one writes a component the other reads or writes.
+	const ComponentKey firstAccess = firstSystem.GetReadComponents() | firstSystem.GetWriteComponents();
+	const ComponentKey secondAccess = secondSystem.GetReadComponents() | secondSystem.GetWriteComponents();
+	return firstSystem.GetWriteComponents().Intersects(secondAccess) || secondSystem.GetWriteComponents().Intersects(firstAccess);
+}
+
+void Registry::BuildSystemSchedule()
+{
+	m_systemPhases.clear();
+
+	// Every system depends on the earlier systems it conflicts with, and goes in the phase right after the latest of them.
+	std::vector<size_t> systemPhaseIndices(m_systems.size(), 0);
+	for (size_t systemIndex = 0; systemIndex < m_systems.size(); ++systemIndex)
+	{
+		size_t phaseIndex = 0;
+		for (size_t earlierSystemIndex = 0; earlierSystemIndex < systemIndex; ++earlierSystemIndex)
+		{
+			if (SystemsConflict(*m_systems[systemIndex], *m_systems[earlierSystemIndex]))
+			{
+				phaseIndex = std::max(phaseIndex, systemPhaseIndices[earlierSystemIndex] + 1);
+			}
+		}
+
+		// Make room for the phase if necessary, and add the system to it.
+		if (phaseIndex >= m_systemPhases.size())
+		{
+			m_systemPhases.resize(phaseIndex + 1);
+		}
+
+		systemPhaseIndices[systemIndex] = phaseIndex;
+		m_systemPhases[phaseIndex].push_back(m_systems[systemIndex].get());
+	}
+
+	m_isSystemScheduleDirty = false;
+}
+
+void Registry::ApplyComponentOrder()
+{
+	// Nothing to apply until a requested order is done sorting.
+	if (!m_isComponentOrderPending || m_componentOrderJobCount.load(std::memory_order_acquire) > 0)
+	{
+		return;
+	}
+
+	m_isComponentOrderPending = false;
+
+	// In archetype mode fill every archetype from its first row on, in the sorted order. Every chunk but the last is
+	// full, so the n-th entity placed in an archetype belongs in chunk n / capacity, at row n % capacity.
+	if (m_storageMode == StorageMode::Archetype)
+	{
+		std::vector<size_t> placedCounts(m_archetypes.size(), 0);
+		for (const std::pair<uint64_t, Entity>& sortedEntity : m_componentOrder)
+		{
+			// Skip entities destroyed since the order was requested, and entities left without any components.
+			const Entity entity = sortedEntity.second;
+			const size_t entityIndex = GetEntityIndex(entity);
+			if (!IsAlive(entity) || entityIndex >= m_entityLocations.size() || m_entityLocations[entityIndex].ArchetypeIndex == INVALID_INDEX)
+			{
+				continue;
+			}
+
+			// An entity found before the next row of its archetype was already placed.
+			EntityLocation& location = m_entityLocations[entityIndex];
+			Archetype& archetype = *m_archetypes[location.ArchetypeIndex];
+			const size_t chunkCapacity = archetype.GetChunkCapacity();
+			size_t& placedCount = placedCounts[location.ArchetypeIndex];
+			if (location.ChunkIndex * chunkCapacity + location.Row < placedCount)
+			{
+				continue;
+			}
+
+			// Swap the entity into the next row, and the entity occupying it into the entity's old row.
+			EntityLocation nextLocation = location;
+			nextLocation.ChunkIndex = placedCount / chunkCapacity;
+			nextLocation.Row = placedCount % chunkCapacity;
+			if (nextLocation.ChunkIndex != location.ChunkIndex || nextLocation.Row != location.Row)
+			{
+				const Entity displacedEntity = archetype.GetEntities(nextLocation.ChunkIndex)[nextLocation.Row];
+				archetype.SwapRows(location, nextLocation);
+				m_entityLocations[GetEntityIndex(displacedEntity)] = location;
+				location = nextLocation;
+			}
+
+			++placedCount;
+		}
+	}
+
+	// In sparse set mode reorder every component set, so all components of the entities share the sorted order.
+	else
+	{
+		std::vector<Entity> sortedEntities;
+		sortedEntities.reserve(m_componentOrder.size());
+		for (const std::pair<uint64_t, Entity>& sortedEntity : m_componentOrder)
+		{
+			sortedEntities.push_back(sortedEntity.second);
+		}
+
+		for (const std::unique_ptr<IComponentSet>& componentSet : m_componentSets)
+		{
+			if (componentSet)
+			{
+				componentSet->Reorder(sortedEntities.data(), sortedEntities.size());
+			}
+		}
+
+		// Reordering scattered the owned groups, gather them again in the new order.
+		RebuildGroups();
+	}
+
+	m_componentOrder.clear();
+}
+
+void Registry::ReserveCommandBuffers()
+{
+	// Create a command buffer per thread, buffers are kept alive and reused across frames.
+	const size_t threadCount = m_jobSystem.GetThreadCount();
+	while (m_componentCommandBuffers.size() < threadCount)
+	{
+		m_componentCommandBuffers.push_back(std::make_unique<CommandBuffer>());
+	}
+
+	while (m_tagCommandBuffers.size() < threadCount)
+	{
+		m_tagCommandBuffers.push_back(std::make_unique<CommandBuffer>());
+	}
+}
+
+CommandBuffer& Registry::GetCommandBuffer(std::vector<std::unique_ptr<CommandBuffer>>& commandBuffers)
+{
+	const size_t threadIndex = JobSystem::GetThreadIndex();
+
+	// Worker buffers exist before systems update, the main thread may create its buffers on first use.
+	if (threadIndex >= commandBuffers.size())
+	{
+		assert(threadIndex == 0);
+		ReserveCommandBuffers();
+	}
+
+	return *commandBuffers[threadIndex];
+}
+
+void Registry::ExecuteCommandBuffers(std::vector<std::unique_ptr<CommandBuffer>>& commandBuffers)
+{
+	// Merge the commands of every thread by the system and batch that recorded them, so the merged order does not depend on
+	// which thread happened to run what.
+	CommandBuffer::Execute(*this, commandBuffers);
 }
 
 void Registry::ProcessPendingEntities()
@@ -55,181 +284,1225 @@ void Registry::ProcessPendingEntities()
 
 void Registry::ProcessPendingComponents()
 {
-	ProcessComponentAdditions();
-	ProcessComponnetRemovals();
+	ExecuteCommandBuffers(m_componentCommandBuffers);
 }
 
 void Registry::ProcessPendingTags()
 {
-	ProcessTagAdditions();
-	ProcessTagRemovals();
+	ExecuteCommandBuffers(m_tagCommandBuffers);
 }
 
 void Registry::Shutdown()
 {
-	// Reset the next available entity Id.
-	m_nextEntity = 0;
-
-	// Clear our queue of recyclable entity Ids.
-	while (!m_deletedEntities.empty())
-	{
-		m_deletedEntities.pop();
-	}
+	// Let a background sort finish before discarding the order it sorts.
+	m_jobSystem.Wait(m_componentOrderJobCount);
+	m_componentOrder.clear();
+	m_isComponentOrderPending = false;
 
-	// Clear the sets of pending entity, component, and tag addition requests.
-	m_addedEntities.clear();
-	m_addComponentRequests.clear();
-	m_addTagRequests.clear();
+	// Clear every entity slot, and the list of recyclable slots.
+	m_entities.clear();
+	m_freeEntityIndex = INVALID_ENTITY_INDEX;
 
-	// Clear the set of pending entity, component, and tag removal requests.
+	// Clear the sets of pending entity membership updates and entity removals, and discard every pending command.
+	m_changedEntities.clear();
 	m_removedEntities.clear();
-	m_removeComponentRequests.clear();
-	m_removeTagRequests.clear();
+	m_componentCommandBuffers.clear();
+	m_tagCommandBuffers.clear();
 
-	// Clear all component sets, entity component key sets, and systems.
+	// Clear all component sets, archetypes, groups, tag sets, shared component values, entity component key sets, and systems.
 	m_componentSets.clear();
+	m_archetypes.clear();
+	m_archetypeLookup.clear();
+	m_entityLocations.clear();
+	m_groups.clear();
+	m_componentGroups.assign(COMPONENT_COUNT, INVALID_INDEX);
+	m_tagSets.clear();
+	m_sharedComponentTables.clear();
 	m_entityComponentKeys.clear();
+	m_entitySystemKeys.clear();
 	m_systems.clear();
+	m_systemPhases.clear();
+	m_matchingSystems.clear();
+	m_isSystemScheduleDirty = true;
+	m_changeTick = 1;
+
+	// Clear every component observer along with its undelivered entities.
+	m_componentObservers = std::vector<ComponentObservers>(COMPONENT_COUNT);
+	m_pendingObservedComponents.Clear();
 }
 
-Entity Registry::CreateEntity()
+std::vector<unsigned char> Registry::SaveSnapshot()
 {
-	Entity newEntity;
+	// The world cannot be saved while systems may be changing it.
+	assert(!m_isInSystemUpdate && !m_isInSystemRender);
+
+	// Apply every pending request first, so the snapshot captures a settled world.
+	ProcessPendingComponents();
+	ProcessPendingEntities();
+	ProcessPendingTags();
+
+	// The entity slots and keys alone take this much room, reserving it up front saves most of the regrowth.
+	std::vector<unsigned char> snapshot;
+	snapshot.reserve(m_entities.size() * (sizeof(Entity) + sizeof(ComponentKey)));
+	SnapshotWriter writer(snapshot);
+
+	// Write the header identifying the snapshot layout.
+	writer.Write(SNAPSHOT_MAGIC);
+	writer.Write(SNAPSHOT_VERSION);
+	writer.Write<uint64_t>(COMPONENT_COUNT);
+
+	// Write the type hash behind every component and tag id, so a snapshot from a build with different ids is refused.
+	writer.WriteVector(ComponentIdGenerator::GetComponentHashes());
+	writer.WriteVector(TagIdGenerator::GetTagHashes());
+	writer.Write(m_storageMode);
 
-	// Create a new entity if we have non to recycle.
-	if (m_deletedEntities.empty())
+	// Write every entity slot, including the free list threaded through them, and the entity component keys.
+	writer.WriteVector(m_entities);
+	writer.Write(m_freeEntityIndex);
+	writer.Write(m_changeTick);
+	writer.WriteVector(m_entityComponentKeys);
+
+	// Write every archetype along with its component key, so it can be recreated with the same layout.
+	if (m_storageMode == StorageMode::Archetype)
 	{
-		newEntity = m_nextEntity++;
+		writer.Write<uint64_t>(m_archetypes.size());
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypes)
+		{
+			writer.Write(archetype->GetComponentKey());
+			archetype->SaveSnapshot(writer);
+		}
 	}
 
-	// Otherwise reuse a previously created entity.
+	// Or write every component set along with its component id and component size.
 	else
 	{
-		newEntity = m_deletedEntities.front();
-		m_deletedEntities.pop();
+		const size_t componentSetCount = std::count_if(m_componentSets.begin(), m_componentSets.end(), [](const std::unique_ptr<IComponentSet>& componentSet) { return componentSet != nullptr; });
+		writer.Write<uint64_t>(componentSetCount);
+		for (ComponentId componentId = 0; componentId < m_componentSets.size(); ++componentId)
+		{
+			if (m_componentSets[componentId])
+			{
+				writer.Write<uint64_t>(componentId);
+				writer.Write<uint64_t>(ComponentIdGenerator::GetComponentTypeInfos()[componentId].Size);
+				m_componentSets[componentId]->SaveSnapshot(writer);
+			}
+		}
 	}
 
-	// Queue the entity for potential addition into all current systems.
-	m_addedEntities.push_back(newEntity);
+	// Write the tagged entities of every tag.
+	writer.Write<uint64_t>(m_tagSets.size());
+	for (const TagSet& tagSet : m_tagSets)
+	{
+		writer.WriteVector(tagSet.GetEntities());
+	}
 
-	return newEntity;
+	// Write the distinct values of every shared component, so the saved indices resolve in any registry.
+	const size_t sharedComponentTableCount = std::count_if(m_sharedComponentTables.begin(), m_sharedComponentTables.end(), [](const std::unique_ptr<ISharedComponentTable>& sharedComponentTable) { return sharedComponentTable != nullptr; });
+	writer.Write<uint64_t>(sharedComponentTableCount);
+	for (ComponentId componentId = 0; componentId < m_sharedComponentTables.size(); ++componentId)
+	{
+		if (m_sharedComponentTables[componentId])
+		{
+			writer.Write<uint64_t>(componentId);
+			m_sharedComponentTables[componentId]->SaveSnapshot(writer);
+		}
+	}
+
+	return snapshot;
 }
 
-void Registry::RemoveEntity(Entity entity)
+bool Registry::LoadSnapshot(const std::vector<unsigned char>& snapshot)
 {
-	// Queue the entity for removal for complete removal.
-	m_removedEntities.push_back(entity);
+	// The world cannot be replaced while systems may be reading it.
+	assert(!m_isInSystemUpdate && !m_isInSystemRender);
+
+	// Snapshots only restore into the same build, component ids and layouts must match the ones saved.
+	SnapshotReader reader(snapshot.data(), snapshot.size());
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint64_t componentCount = 0;
+	if (!reader.Read(magic) || magic != SNAPSHOT_MAGIC || !reader.Read(version) || version != SNAPSHOT_VERSION || !reader.Read(componentCount) || componentCount != COMPONENT_COUNT)
+	{
+		return false;
+	}
+
+	// Every component and tag id must name the same type it named when saved. The current world is kept if anything differs.
+	std::vector<TypeHash> componentHashes;
+	std::vector<TypeHash> tagHashes;
+	if (!reader.ReadVector(componentHashes) || !reader.ReadVector(tagHashes) ||
+		componentHashes != ComponentIdGenerator::GetComponentHashes() || tagHashes != TagIdGenerator::GetTagHashes())
+	{
+		return false;
+	}
+
+	// Deliver what the observers are owed by the current world, then report every one of its components as removed.
+	NotifyComponentObservers();
+	NotifyWorldComponentObservers(&ComponentObservers::OnRemove);
+
+	// Discard the current world along with every pending request. Systems and observers are kept.
+	DiscardWorld();
+
+	// From here on a malformed snapshot leaves an empty world behind.
+	if (!LoadSnapshotWorld(reader, componentHashes.size(), tagHashes.size()))
+	{
+		DiscardWorld();
+		m_entities.clear();
+		m_entityComponentKeys.clear();
+		m_entitySystemKeys.clear();
+		m_freeEntityIndex = INVALID_ENTITY_INDEX;
+		return false;
+	}
+
+	// The sets were saved with their groups in front, find where each group ends.
+	RebuildGroups();
+
+	// Group the live entities by component key, and hand every group to its matching systems in one go.
+	std::unordered_map<ComponentKey, std::vector<Entity>> entitiesPerComponentKey;
+	for (size_t entityIndex = 0; entityIndex < m_entities.size(); ++entityIndex)
+	{
+		// Free slots link to another slot, live slots hold their own index.
+		const Entity entity = m_entities[entityIndex];
+		if (GetEntityIndex(entity) == entityIndex && entityIndex < m_entityComponentKeys.size() && m_entityComponentKeys[entityIndex].Any())
+		{
+			entitiesPerComponentKey[m_entityComponentKeys[entityIndex]].push_back(entity);
+		}
+	}
+
+	for (const auto& componentKeyEntities : entitiesPerComponentKey)
+	{
+		for (ISystem* system : GetMatchingSystems(componentKeyEntities.first))
+		{
+			system->AddEntities(componentKeyEntities.second.data(), componentKeyEntities.second.size());
+		}
+	}
+
+	// Report every loaded component as added.
+	NotifyWorldComponentObservers(&ComponentObservers::OnAdd);
+	return true;
 }
 
-void Registry::ProcessEntityAdditions()
+void Registry::DiscardWorld()
+{
+	// Drop every pending request.
+	for (std::unique_ptr<CommandBuffer>& commandBuffer : m_componentCommandBuffers)
+	{
+		commandBuffer->Reset();
+	}
+
+	for (std::unique_ptr<CommandBuffer>& commandBuffer : m_tagCommandBuffers)
+	{
+		commandBuffer->Reset();
+	}
+
+	for (ComponentObservers& observers : m_componentObservers)
+	{
+		observers.AddedEntities.clear();
+		observers.RemovedEntities.clear();
+	}
+
+	m_pendingObservedComponents.Clear();
+	m_changedEntities.clear();
+	m_removedEntities.clear();
+
+	// Drop every component, archetype, tag and shared value. Systems are kept, but lose their entities.
+	m_componentSets.clear();
+	m_archetypes.clear();
+	m_archetypeLookup.clear();
+	m_entityLocations.clear();
+	m_tagSets.clear();
+	m_sharedComponentTables.clear();
+
+	for (const std::unique_ptr<ISystem>& system : m_systems)
+	{
+		system->ClearEntities();
+	}
+}
+
+bool Registry::LoadSnapshotWorld(SnapshotReader& reader, size_t componentTypeCount, size_t tagTypeCount)
 {
-	for (const Entity entity : m_addedEntities)
+	// Read back every entity slot and component key. Every entity is matched against the systems once the world is loaded.
+	if (!reader.Read(m_storageMode) || (m_storageMode != StorageMode::SparseSet && m_storageMode != StorageMode::Archetype) ||
+		!reader.ReadVector(m_entities) || !reader.Read(m_freeEntityIndex) || !reader.Read(m_changeTick) || !reader.ReadVector(m_entityComponentKeys))
+	{
+		return false;
+	}
+
+	m_entitySystemKeys = m_entityComponentKeys;
+
+	// Live slots hold their own index, free slots link to another slot or end the free list.
+	const size_t entitySlotCount = m_entities.size();
+	for (const Entity entity : m_entities)
+	{
+		if (GetEntityIndex(entity) >= entitySlotCount && GetEntityIndex(entity) != INVALID_ENTITY_INDEX)
+		{
+			return false;
+		}
+	}
+
+	if (m_freeEntityIndex >= entitySlotCount && m_freeEntityIndex != INVALID_ENTITY_INDEX)
+	{
+		return false;
+	}
+
+	// Recreate every archetype, and rebuild the entity locations from the rows of its chunks.
+	if (m_storageMode == StorageMode::Archetype)
 	{
-		// Consider the entity for addition into all systems in the registry.
-		for (std::unique_ptr<ISystem>& genericSystem : m_systems)
+		m_entityLocations.resize(entitySlotCount);
+		size_t archetypeCount = 0;
+		if (!reader.ReadCount(sizeof(ComponentKey), archetypeCount))
+		{
+			return false;
+		}
+
+		for (size_t index = 0; index < archetypeCount; ++index)
 		{
-			if (genericSystem != nullptr)
+			// Every component of the archetype must be registered, and every archetype saved once.
+			ComponentKey componentKey;
+			if (!reader.Read(componentKey) || !IsSnapshotComponentKeyValid(componentKey, componentTypeCount) || m_archetypeLookup.count(componentKey) > 0)
 			{
-				// Get the required component key of the system.
-				const ComponentKey& requiredComponents = genericSystem->GetRequiredComponents();
+				return false;
+			}
+
+			const size_t archetypeIndex = GetOrCreateArchetype(componentKey);
+			Archetype& archetype = *m_archetypes[archetypeIndex];
+			if (!archetype.LoadSnapshot(reader))
+			{
+				return false;
+			}
 
-				// If the entity component key has all the bits for system component set, add the entity to the system.
-				if ((m_entityComponentKeys[entity] & requiredComponents) == requiredComponents)
+			for (size_t chunkIndex = 0; chunkIndex < archetype.GetChunkCount(); ++chunkIndex)
+			{
+				const Entity* entities = archetype.GetEntities(chunkIndex);
+				for (size_t row = 0; row < archetype.GetChunkSize(chunkIndex); ++row)
 				{
-					genericSystem->AddEntity(entity);
+					if (GetEntityIndex(entities[row]) >= entitySlotCount)
+					{
+						return false;
+					}
+
+					EntityLocation& location = m_entityLocations[GetEntityIndex(entities[row])];
+					location.ArchetypeIndex = archetypeIndex;
+					location.ChunkIndex = chunkIndex;
+					location.Row = row;
 				}
 			}
 		}
 	}
-	
-	// Clear the list of pending entities.
-	m_addedEntities.clear();
-}
 
-void Registry::ProcessEntityRemovals()
-{
-	for (const Entity entity : m_removedEntities)
+	// Or recreate every component set from its registered type erased operations.
+	else
 	{
-		// Remove all components belonging to the entity from every non empty component set.
-		for (std::unique_ptr<IComponentSet>& genericComponentSet : m_componentSets)
+		size_t componentSetCount = 0;
+		if (!reader.ReadCount(2 * sizeof(uint64_t), componentSetCount))
 		{
-			if (genericComponentSet)
-			{
-				genericComponentSet->RemoveComponent(entity);
-			}
+			return false;
 		}
 
-		// Remove all entity tags.
-		std::vector<TagId>& entityTags = m_entityToTagMap[entity];
-		for (const TagId tagId : entityTags)
+		for (size_t index = 0; index < componentSetCount; ++index)
 		{
-			std::vector<TagId>& entitiesWithTag = m_tagToEntityMap[tagId];
-			m_tagToEntityMap[tagId].erase(std::find(entitiesWithTag.begin(), entitiesWithTag.end(), entity));
+			// The component must be registered with the same size, and every set saved once.
+			const std::vector<ComponentTypeInfo>& componentTypeInfos = ComponentIdGenerator::GetComponentTypeInfos();
+			uint64_t componentId = 0;
+			uint64_t componentSize = 0;
+			if (!reader.Read(componentId) || !reader.Read(componentSize) || componentId >= componentTypeCount ||
+				componentTypeInfos[componentId].CreateComponentSet == nullptr || componentTypeInfos[componentId].Size != componentSize ||
+				(componentId < m_componentSets.size() && m_componentSets[componentId] != nullptr))
+			{
+				return false;
+			}
+
+			if (componentId >= m_componentSets.size())
+			{
+				m_componentSets.resize(componentId * 2 + 1);
+			}
+
+			m_componentSets[componentId].reset(componentTypeInfos[componentId].CreateComponentSet());
+			if (!m_componentSets[componentId]->LoadSnapshot(reader, entitySlotCount))
+			{
+				return false;
+			}
 		}
-		entityTags.clear();
+	}
 
-		// Remove the entity from all systems.
-		for (std::unique_ptr<ISystem>& genericSystem : m_systems)
+	// Retag every tagged entity.
+	size_t tagSetCount = 0;
+	if (!reader.ReadCount(sizeof(uint64_t), tagSetCount) || tagSetCount > tagTypeCount)
+	{
+		return false;
+	}
+
+	m_tagSets.resize(tagSetCount);
+	for (TagSet& tagSet : m_tagSets)
+	{
+		std::vector<Entity> entities;
+		if (!reader.ReadVector(entities))
 		{
-			genericSystem->RemoveEntity(entity);
+			return false;
 		}
 
-		// Reset the entity component key set.
-		m_entityComponentKeys[entity].reset();
+		for (const Entity entity : entities)
+		{
+			if (GetEntityIndex(entity) >= entitySlotCount)
+			{
+				return false;
+			}
 
-		// Add the entityId to the queue of recyclable entities.
-		m_deletedEntities.push(entity);
+			tagSet.AddEntity(entity);
+		}
 	}
 
-	// Clear the set of removed entities.
-	m_removedEntities.clear();
-}
-
-void Registry::ProcessTagAdditions()
-{
-	// Execute each pending entity tag add request.
-	for (std::unique_ptr<IRegistryRequestTag>& addTagRequest : m_addTagRequests)
+	// Restore the values of every shared component.
+	size_t sharedComponentTableCount = 0;
+	if (!reader.ReadCount(2 * sizeof(uint64_t), sharedComponentTableCount))
 	{
-		addTagRequest->Execute();
+		return false;
 	}
 
-	// Clear the list of pending tag requests.
-	m_addTagRequests.clear();
-}
-
-void Registry::ProcessTagRemovals()
-{
-	// Execute each pending entity tag remove request.
-	for (std::unique_ptr<IRegistryRequestTag>& removeTagRequest : m_removeTagRequests)
+	for (size_t index = 0; index < sharedComponentTableCount; ++index)
 	{
-		removeTagRequest->Execute();
-	}
+		// The component must be a registered shared component, and every table saved once.
+		uint64_t componentId = 0;
+		if (!reader.Read(componentId) || componentId >= componentTypeCount ||
+			ComponentIdGenerator::GetComponentTypeInfos()[componentId].CreateSharedComponentTable == nullptr ||
+			(componentId < m_sharedComponentTables.size() && m_sharedComponentTables[componentId] != nullptr))
+		{
+			return false;
+		}
 
-	// Clear the list of pending tag removal requests.
-	m_removeTagRequests.clear();
-}
+		if (componentId >= m_sharedComponentTables.size())
+		{
+			m_sharedComponentTables.resize(componentId + 1);
+		}
 
-void Registry::ProcessComponentAdditions()
-{
-	// Execute each pending component addition request.
-	for (std::unique_ptr<IRegistryRequestAddComponent>& addComponentRequest : m_addComponentRequests)
-	{
-		addComponentRequest->Execute();
+		m_sharedComponentTables[componentId].reset(ComponentIdGenerator::GetComponentTypeInfos()[componentId].CreateSharedComponentTable());
+		if (!m_sharedComponentTables[componentId]->LoadSnapshot(reader))
+		{
+			return false;
+		}
 	}
 
-	// Clear the set of pending component addition requests.
-	m_addComponentRequests.clear();
+	// Trailing bytes mean the snapshot was not written by this layout.
+	return reader.IsAtEnd() && IsSnapshotWorldConsistent() && AreSnapshotSharedIndicesValid();
 }
 
-void Registry::ProcessComponnetRemovals()
+bool Registry::AreSnapshotSharedIndicesValid() const
 {
-	// Execute each pending component removal request.
-	for (std::unique_ptr<IRegistryRequestRemoveComponent>& removeComponentRequest : m_removeComponentRequests)
+	// Every shared component must reference a restored value, or no value at all.
+	const std::vector<ComponentTypeInfo>& componentTypeInfos = ComponentIdGenerator::GetComponentTypeInfos();
+	for (ComponentId componentId = 0; componentId < COMPONENT_COUNT; ++componentId)
 	{
-		removeComponentRequest->Execute();
-	}
+		if (componentTypeInfos[componentId].CreateSharedComponentTable == nullptr)
+		{
+			continue;
+		}
 
-	// Clear the set of pending component removal requests.
-	m_removeComponentRequests.clear();
-}
+		const size_t valueCount = componentId < m_sharedComponentTables.size() && m_sharedComponentTables[componentId] ? m_sharedComponentTables[componentId]->GetValueCount() : 0;
+		const auto isIndexValid = [valueCount](const void* sharedComponent)
+		{
+			const SharedIndex sharedIndex = GetSharedIndex(sharedComponent);
+			return sharedIndex < valueCount || sharedIndex == INVALID_SHARED_INDEX;
+		};
+
+		// Walk the column of every archetype holding the shared component.
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypes)
+		{
+			if (!archetype->GetComponentKey().Test(componentId))
+			{
+				continue;
+			}
 
+			for (size_t chunkIndex = 0; chunkIndex < archetype->GetChunkCount(); ++chunkIndex)
+			{
+				const unsigned char* column = static_cast<const unsigned char*>(archetype->GetColumn(componentId, chunkIndex));
+				for (size_t row = 0; row < archetype->GetChunkSize(chunkIndex); ++row)
+				{
+					if (!isIndexValid(column + row * componentTypeInfos[componentId].Size))
+					{
+						return false;
+					}
+				}
+			}
+		}
+
+		// Or every entity of its component set.
+		if (componentId < m_componentSets.size() && m_componentSets[componentId])
+		{
+			const IComponentSet& componentSet = *m_componentSets[componentId];
+			for (const Entity entity : componentSet.GetPackedEntities())
+			{
+				if (!isIndexValid(componentSet.GetComponent(entity)))
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool Registry::IsSnapshotWorldConsistent() const
+{
+	// Every live entity must be stored exactly where its component key says.
+	size_t keyedComponentCount = 0;
+	for (size_t entityIndex = 0; entityIndex < m_entities.size(); ++entityIndex)
+	{
+		const Entity entity = m_entities[entityIndex];
+		if (GetEntityIndex(entity) != entityIndex || entityIndex >= m_entityComponentKeys.size() || m_entityComponentKeys[entityIndex].None())
+		{
+			continue;
+		}
+
+		// An archetype entity must sit in the row its location points at, in the archetype of its component key.
+		const ComponentKey& componentKey = m_entityComponentKeys[entityIndex];
+		if (m_storageMode == StorageMode::Archetype)
+		{
+			const EntityLocation& location = m_entityLocations[entityIndex];
+			if (location.ArchetypeIndex >= m_archetypes.size() || m_archetypes[location.ArchetypeIndex]->GetComponentKey() != componentKey ||
+				m_archetypes[location.ArchetypeIndex]->GetEntities(location.ChunkIndex)[location.Row] != entity)
+			{
+				return false;
+			}
+
+			++keyedComponentCount;
+			continue;
+		}
+
+		// A sparse set entity must be in the set of every component of its key.
+		bool isStored = true;
+		componentKey.ForEachComponent([this, entity, &isStored, &keyedComponentCount](ComponentId componentId)
+		{
+			isStored = isStored && componentId < m_componentSets.size() && m_componentSets[componentId] != nullptr && m_componentSets[componentId]->HaveComponent(entity);
+			++keyedComponentCount;
+		});
+
+		if (!isStored)
+		{
+			return false;
+		}
+	}
+
+	// Every entity appears once per set or archetype, so matching totals leave no stored entity unaccounted for.
+	size_t storedComponentCount = 0;
+	for (const std::unique_ptr<Archetype>& archetype : m_archetypes)
+	{
+		storedComponentCount += archetype->GetEntityCount();
+	}
+
+	for (const std::unique_ptr<IComponentSet>& componentSet : m_componentSets)
+	{
+		storedComponentCount += componentSet != nullptr ? componentSet->GetPackedEntities().size() : 0;
+	}
+
+	return storedComponentCount == keyedComponentCount;
+}
+
+bool Registry::IsSnapshotComponentKeyValid(const ComponentKey& componentKey, size_t componentTypeCount) const
+{
+	// Every component of the key must be registered, along with its type erased operations.
+	bool isValid = componentKey.Any();
+	componentKey.ForEachComponent([this, componentTypeCount, &isValid](ComponentId componentId)
+	{
+		isValid = isValid && componentId < componentTypeCount && ComponentIdGenerator::GetComponentTypeInfos()[componentId].CreateComponentSet != nullptr;
+	});
+
+	return isValid;
+}
+
+void Registry::SetStorageMode(StorageMode storageMode)
+{
+	// Components cannot be migrated between storage modes, so the mode must be chosen before any are added.
+	assert(m_componentSets.empty() && m_archetypes.empty());
+	m_storageMode = storageMode;
+}
+
+std::vector<ComponentStorageStats> Registry::GetComponentStorageStats() const
+{
+	std::vector<ComponentStorageStats> stats;
+
+	// Archetype chunks are allocated whole, every chunk holds a full column for each of its components.
+	if (m_storageMode == StorageMode::Archetype)
+	{
+		std::vector<ComponentStorageStats> statsPerComponent(COMPONENT_COUNT);
+		ComponentKey storedComponents;
+		for (const std::unique_ptr<Archetype>& archetype : m_archetypes)
+		{
+			const Archetype& currentArchetype = *archetype;
+			storedComponents = storedComponents | currentArchetype.GetComponentKey();
+			currentArchetype.GetComponentKey().ForEachComponent([&statsPerComponent, &currentArchetype](ComponentId componentId)
+			{
+				const size_t columnBytes = currentArchetype.GetChunkCount() * currentArchetype.GetChunkCapacity() * currentArchetype.GetTypeInfo(componentId).Size;
+				ComponentStorageStats& componentStats = statsPerComponent[componentId];
+				componentStats.Count += currentArchetype.GetEntityCount();
+				componentStats.ReservedBytes += columnBytes;
+				componentStats.CommittedBytes += columnBytes;
+			});
+		}
+
+		storedComponents.ForEachComponent([&stats, &statsPerComponent](ComponentId componentId)
+		{
+			statsPerComponent[componentId].Id = componentId;
+			stats.push_back(statsPerComponent[componentId]);
+		});
+	}
+
+	// Otherwise every component set reports on the container holding its components.
+	else
+	{
+		for (ComponentId componentId = 0; componentId < m_componentSets.size(); ++componentId)
+		{
+			if (m_componentSets[componentId])
+			{
+				stats.push_back(m_componentSets[componentId]->GetStorageStats());
+				stats.back().Id = componentId;
+			}
+		}
+	}
+
+	return stats;
+}
+
+size_t Registry::GetOrCreateArchetype(const ComponentKey& componentKey)
+{
+	// Return the existing archetype for this component key if there is one.
+	const auto iterator = m_archetypeLookup.find(componentKey);
+	if (iterator != m_archetypeLookup.end())
+	{
+		return iterator->second;
+	}
+
+	// Otherwise create it from the registered component type operations.
+	const size_t archetypeIndex = m_archetypes.size();
+	m_archetypes.push_back(std::make_unique<Archetype>(componentKey, ComponentIdGenerator::GetComponentTypeInfos()));
+	m_archetypeLookup[componentKey] = archetypeIndex;
+
+	return archetypeIndex;
+}
+
+void Registry::MoveEntityToArchetype(Entity entity, const ComponentKey& componentKey)
+{
+	// Make room for the entity location if necessary.
+	const size_t entityIndex = GetEntityIndex(entity);
+	if (entityIndex >= m_entityLocations.size())
+	{
+		m_entityLocations.resize(entityIndex * 2 + 1);
+	}
+
+	// Entities without any components do not live in any archetype.
+	const EntityLocation oldLocation = m_entityLocations[entityIndex];
+	EntityLocation newLocation;
+
+	if (componentKey.Any())
+	{
+		// Claim a row in the archetype matching the new component key.
+		const size_t newArchetypeIndex = GetOrCreateArchetype(componentKey);
+		Archetype& newArchetype = *m_archetypes[newArchetypeIndex];
+		newLocation = newArchetype.AddEntity(entity, newArchetypeIndex, m_changeTick);
+
+		// Move every component the old and new archetypes have in common into the new row.
+		if (oldLocation.ArchetypeIndex != INVALID_INDEX)
+		{
+			Archetype& oldArchetype = *m_archetypes[oldLocation.ArchetypeIndex];
+			const ComponentKey sharedComponents = oldArchetype.GetComponentKey() & componentKey;
+
+			sharedComponents.ForEachComponent([&newArchetype, &oldArchetype, &newLocation, &oldLocation](ComponentId componentId)
+			{
+				newArchetype.GetTypeInfo(componentId).MoveConstruct(
+					newArchetype.GetComponent(componentId, newLocation.ChunkIndex, newLocation.Row),
+					oldArchetype.GetComponent(componentId, oldLocation.ChunkIndex, oldLocation.Row)
+				);
+			});
+		}
+	}
+
+	// Release the old row. The archetype fills the hole with its last row, whose owner has to be pointed at the hole.
+	if (oldLocation.ArchetypeIndex != INVALID_INDEX)
+	{
+		const Entity movedEntity = m_archetypes[oldLocation.ArchetypeIndex]->RemoveEntity(oldLocation);
+		if (movedEntity != INVALID_ENTITY)
+		{
+			m_entityLocations[GetEntityIndex(movedEntity)] = oldLocation;
+		}
+	}
+
+	m_entityLocations[entityIndex] = newLocation;
+}
+
+Entity Registry::CreateEntity()
+{
+	Entity newEntity;
+
+	// Create a new entity slot if we have non to recycle.
+	if (m_freeEntityIndex == INVALID_ENTITY_INDEX)
+	{
+		newEntity = MakeEntity(static_cast<uint32_t>(m_entities.size()), 0);
+		m_entities.push_back(newEntity);
+	}
+
+	// Otherwise reuse a previously freed slot. The free slot links to the next free slot and holds the generation to reuse it with.
+	else
+	{
+		Entity& freeSlot = m_entities[m_freeEntityIndex];
+		newEntity = MakeEntity(m_freeEntityIndex, GetEntityGeneration(freeSlot));
+		m_freeEntityIndex = GetEntityIndex(freeSlot);
+		freeSlot = newEntity;
+	}
+
+	// The entity joins systems once components are added to it.
+	return newEntity;
+}
+
+std::vector<Entity> Registry::CreateEntities(size_t count, const EntityPrototype& prototype)
+{
+	const ComponentKey& componentKey = prototype.GetComponentKey();
+	const void* components[COMPONENT_COUNT] = { };
+
+	// Gather the component values.
+	componentKey.ForEachComponent([&prototype, &components](ComponentId componentId)
+	{
+		components[componentId] = prototype.GetComponent(componentId);
+	});
+
+	return InstantiateEntities(count, componentKey, components);
+}
+
+std::vector<Entity> Registry::Clone(Entity entity, size_t count)
+{
+	// Only live entities can be cloned.
+	assert(IsAlive(entity));
+
+	const uint32_t entityIndex = GetEntityIndex(entity);
+	const ComponentKey componentKey = entityIndex < m_entityComponentKeys.size() ? m_entityComponentKeys[entityIndex] : ComponentKey();
+	const void* components[COMPONENT_COUNT] = { };
+
+	// Gather the entity's components, from its archetype row or from every component set.
+	componentKey.ForEachComponent([this, entity, entityIndex, &components](ComponentId componentId)
+	{
+		if (m_storageMode == StorageMode::Archetype)
+		{
+			const EntityLocation& location = m_entityLocations[entityIndex];
+			components[componentId] = m_archetypes[location.ArchetypeIndex]->GetComponent(componentId, location.ChunkIndex, location.Row);
+		}
+		else
+		{
+			components[componentId] = m_componentSets[componentId]->GetComponent(entity);
+		}
+	});
+
+	return InstantiateEntities(count, componentKey, components);
+}
+
+bool Registry::IsAlive(Entity entity) const
+{
+	// A live slot holds exactly the handle it handed out, a freed slot holds a newer generation.
+	const uint32_t entityIndex = GetEntityIndex(entity);
+	return entityIndex < m_entities.size() && m_entities[entityIndex] == entity;
+}
+
+void Registry::RemoveEntity(Entity entity)
+{
+	// Systems may remove entities concurrently, so while they update the removal goes through the calling thread's command buffer.
+	if (m_isInSystemUpdate)
+	{
+		GetCommandBuffer(m_componentCommandBuffers).Record([entity](Registry& registry) { registry.RemoveEntity(entity); });
+		return;
+	}
+
+	// Queue the entity for removal for complete removal.
+	m_removedEntities.push_back(entity);
+}
+
+void Registry::ProcessEntityAdditions()
+{
+	// Match every entity whose component key changed against the systems affected by the change.
+	for (const Entity entity : m_changedEntities)
+	{
+		UpdateSystemMembership(entity);
+	}
+	
+	// Clear the list of pending entities.
+	m_changedEntities.clear();
+}
+
+std::vector<Entity> Registry::InstantiateEntities(size_t count, const ComponentKey& componentKey, const void* const* components)
+{
+	// We cannot add new components when in the middle of a system update or render routine.
+	assert(!m_isInSystemUpdate && !m_isInSystemRender);
+
+	// Create every entity handle up front, recycling freed slots first.
+	std::vector<Entity> entities;
+	entities.reserve(count);
+	m_entities.reserve(m_entities.size() + count);
+
+	size_t maxEntityIndex = 0;
+	for (size_t index = 0; index < count; ++index)
+	{
+		const Entity entity = CreateEntity();
+		maxEntityIndex = std::max<size_t>(maxEntityIndex, GetEntityIndex(entity));
+		entities.push_back(entity);
+	}
+
+	// Entities without components do not live in any storage nor system.
+	if (count == 0 || componentKey.None())
+	{
+		return entities;
+	}
+
+	// Make room for the entity component and system keys once.
+	if (maxEntityIndex >= m_entityComponentKeys.size())
+	{
+		m_entityComponentKeys.resize(maxEntityIndex + 1);
+	}
+
+	if (maxEntityIndex >= m_entitySystemKeys.size())
+	{
+		m_entitySystemKeys.resize(maxEntityIndex + 1);
+	}
+
+	// In archetype mode every entity lands in the same archetype, filled chunk by chunk.
+	if (m_storageMode == StorageMode::Archetype)
+	{
+		std::vector<EntityLocation> locations(count);
+		const size_t archetypeIndex = GetOrCreateArchetype(componentKey);
+		m_archetypes[archetypeIndex]->AddEntities(entities.data(), count, archetypeIndex, components, locations.data(), m_changeTick);
+
+		// Record where each entity went.
+		if (maxEntityIndex >= m_entityLocations.size())
+		{
+			m_entityLocations.resize(maxEntityIndex + 1);
+		}
+
+		for (size_t index = 0; index < count; ++index)
+		{
+			m_entityLocations[GetEntityIndex(entities[index])] = locations[index];
+		}
+	}
+
+	// Otherwise append to every component set in one go each, creating missing sets.
+	else
+	{
+		componentKey.ForEachComponent([this, count, &entities, components](ComponentId componentId)
+		{
+			if (componentId >= m_componentSets.size())
+			{
+				m_componentSets.resize(componentId * 2 + 1);
+			}
+
+			if (m_componentSets[componentId] == nullptr)
+			{
+				m_componentSets[componentId].reset(ComponentIdGenerator::GetComponentTypeInfos()[componentId].CreateComponentSet());
+			}
+
+			m_componentSets[componentId]->AddComponents(entities.data(), count, components[componentId], m_changeTick);
+		});
+	}
+
+	// Every new entity shares the same component key, and is matched against the systems right away.
+	for (const Entity entity : entities)
+	{
+		m_entityComponentKeys[GetEntityIndex(entity)] = componentKey;
+		m_entitySystemKeys[GetEntityIndex(entity)] = componentKey;
+	}
+
+	// Move the entities into the groups their components complete.
+	componentKey.ForEachComponent([this, count, &entities](ComponentId componentId)
+	{
+		AddToGroup(componentId, entities.data(), count);
+	});
+
+	// Append the entities to every system they match in one pass.
+	for (ISystem* system : GetMatchingSystems(componentKey))
+	{
+		system->AddEntities(entities.data(), count);
+	}
+
+	// Queue the entities for the add observers of every component.
+	componentKey.ForEachComponent([this, count, &entities](ComponentId componentId)
+	{
+		RecordComponentsAdded(componentId, entities.data(), count);
+	});
+
+	return entities;
+}
+
+void Registry::NotifyComponentObservers()
+{
+	// Observers may add or remove components themselves, those are delivered on the next notification.
+	const ComponentKey pendingComponents = m_pendingObservedComponents;
+	m_pendingObservedComponents.Clear();
+
+	pendingComponents.ForEachComponent([this](ComponentId componentId)
+	{
+		std::vector<Entity> addedEntities;
+		std::vector<Entity> removedEntities;
+		addedEntities.swap(m_componentObservers[componentId].AddedEntities);
+		removedEntities.swap(m_componentObservers[componentId].RemovedEntities);
+
+		// An entity may be queued several times, and both ways, within a frame. Only its latest state is reported.
+		std::sort(addedEntities.begin(), addedEntities.end());
+		addedEntities.erase(std::unique(addedEntities.begin(), addedEntities.end()), addedEntities.end());
+		addedEntities.erase(std::remove_if(addedEntities.begin(), addedEntities.end(), [this, componentId](Entity entity)
+		{
+			return !IsAlive(entity) || !m_entityComponentKeys[GetEntityIndex(entity)].Test(componentId);
+		}), addedEntities.end());
+
+		std::sort(removedEntities.begin(), removedEntities.end());
+		removedEntities.erase(std::unique(removedEntities.begin(), removedEntities.end()), removedEntities.end());
+		removedEntities.erase(std::remove_if(removedEntities.begin(), removedEntities.end(), [this, componentId](Entity entity)
+		{
+			return IsAlive(entity) && m_entityComponentKeys[GetEntityIndex(entity)].Test(componentId);
+		}), removedEntities.end());
+
+		// Hand every observer the whole span at once. Observers are copied, as they may register further observers.
+		if (!addedEntities.empty())
+		{
+			const std::vector<ComponentObserver> observers = m_componentObservers[componentId].OnAdd;
+			for (const ComponentObserver& observer : observers)
+			{
+				observer(addedEntities.data(), addedEntities.size());
+			}
+		}
+
+		if (!removedEntities.empty())
+		{
+			const std::vector<ComponentObserver> observers = m_componentObservers[componentId].OnRemove;
+			for (const ComponentObserver& observer : observers)
+			{
+				observer(removedEntities.data(), removedEntities.size());
+			}
+		}
+	});
+}
+
+void Registry::RecordComponentsAdded(ComponentId componentId, const Entity* entities, size_t count)
+{
+	// Only components someone observes are recorded.
+	ComponentObservers& observers = m_componentObservers[componentId];
+	if (observers.OnAdd.empty())
+	{
+		return;
+	}
+
+	observers.AddedEntities.insert(observers.AddedEntities.end(), entities, entities + count);
+	m_pendingObservedComponents.Set(componentId);
+}
+
+void Registry::RecordComponentsRemoved(ComponentId componentId, const Entity* entities, size_t count)
+{
+	// Only components someone observes are recorded.
+	ComponentObservers& observers = m_componentObservers[componentId];
+	if (observers.OnRemove.empty())
+	{
+		return;
+	}
+
+	observers.RemovedEntities.insert(observers.RemovedEntities.end(), entities, entities + count);
+	m_pendingObservedComponents.Set(componentId);
+}
+
+void Registry::NotifyWorldComponentObservers(std::vector<ComponentObserver> ComponentObservers::* observerList)
+{
+	// Find the components someone observes this way.
+	ComponentKey observedComponents;
+	for (ComponentId componentId = 0; componentId < COMPONENT_COUNT; ++componentId)
+	{
+		if (!(m_componentObservers[componentId].*observerList).empty())
+		{
+			observedComponents.Set(componentId);
+		}
+	}
+
+	if (observedComponents.None())
+	{
+		return;
+	}
+
+	// Gather every live entity carrying each observed component.
+	std::vector<std::vector<Entity>> entitiesPerComponent(COMPONENT_COUNT);
+	for (size_t entityIndex = 0; entityIndex < m_entities.size() && entityIndex < m_entityComponentKeys.size(); ++entityIndex)
+	{
+		const Entity entity = m_entities[entityIndex];
+		if (GetEntityIndex(entity) == entityIndex)
+		{
+			(m_entityComponentKeys[entityIndex] & observedComponents).ForEachComponent([&entitiesPerComponent, entity](ComponentId componentId)
+			{
+				entitiesPerComponent[componentId].push_back(entity);
+			});
+		}
+	}
+
+	// Hand every observer the whole span at once, like a regular notification. Observers are copied, as they may register
+	// further observers.
+	observedComponents.ForEachComponent([this, observerList, &entitiesPerComponent](ComponentId componentId)
+	{
+		const std::vector<Entity>& entities = entitiesPerComponent[componentId];
+		if (entities.empty())
+		{
+			return;
+		}
+
+		const std::vector<ComponentObserver> observers = m_componentObservers[componentId].*observerList;
+		for (const ComponentObserver& observer : observers)
+		{
+			observer(entities.data(), entities.size());
+		}
+	});
+}
+
+void Registry::AddToGroup(ComponentId componentId, const Entity* entities, size_t count)
+{
+	// Only sparse set storage keeps groups, archetypes already store the components of an entity side by side.
+	if (m_storageMode != StorageMode::SparseSet || m_componentGroups[componentId] == INVALID_INDEX)
+	{
+		return;
+	}
+
+	ComponentGroup& group = m_groups[m_componentGroups[componentId]];
+	for (size_t index = 0; index < count; ++index)
+	{
+		// Skip entities missing an owned component, and entities already in the group.
+		const Entity entity = entities[index];
+		if (!m_entityComponentKeys[GetEntityIndex(entity)].Contains(group.OwnedComponents) || m_componentSets[componentId]->GetComponentIndex(entity) < group.Size)
+		{
+			continue;
+		}
+
+		// Swap the entity's components into the slot past the end of the group in every owned set, and grow the group over them.
+		group.OwnedComponents.ForEachComponent([this, entity, &group](ComponentId ownedComponentId)
+		{
+			IComponentSet& componentSet = *m_componentSets[ownedComponentId];
+			componentSet.SwapComponents(componentSet.GetComponentIndex(entity), group.Size);
+		});
+
+		++group.Size;
+	}
+}
+
+void Registry::RemoveFromGroup(ComponentId componentId, const Entity* entities, size_t count)
+{
+	// Only sparse set storage keeps groups. The entities must still have the component.
+	if (m_storageMode != StorageMode::SparseSet || m_componentGroups[componentId] == INVALID_INDEX)
+	{
+		return;
+	}
+
+	ComponentGroup& group = m_groups[m_componentGroups[componentId]];
+	for (size_t index = 0; index < count; ++index)
+	{
+		// Skip entities outside of the group.
+		const Entity entity = entities[index];
+		if (m_componentSets[componentId]->GetComponentIndex(entity) >= group.Size)
+		{
+			continue;
+		}
+
+		// Shrink the group, and swap the entity's components into the slot it gave up in every owned set.
+		--group.Size;
+		group.OwnedComponents.ForEachComponent([this, entity, &group](ComponentId ownedComponentId)
+		{
+			IComponentSet& componentSet = *m_componentSets[ownedComponentId];
+			componentSet.SwapComponents(componentSet.GetComponentIndex(entity), group.Size);
+		});
+	}
+}
+
+void Registry::RebuildGroups()
+{
+	if (m_storageMode != StorageMode::SparseSet)
+	{
+		return;
+	}
+
+	for (ComponentGroup& group : m_groups)
+	{
+		// A group is empty until every owned component has a set.
+		group.Size = 0;
+		ComponentId firstComponentId = COMPONENT_COUNT;
+		bool hasComponentSets = true;
+		group.OwnedComponents.ForEachComponent([this, &firstComponentId, &hasComponentSets](ComponentId componentId)
+		{
+			firstComponentId = std::min(firstComponentId, componentId);
+			hasComponentSets = hasComponentSets && componentId < m_componentSets.size() && m_componentSets[componentId];
+		});
+
+		if (!hasComponentSets)
+		{
+			continue;
+		}
+
+		// Gather the group in the order of its first set, so a reordered set keeps its order within the group.
+		const std::vector<Entity> entities = m_componentSets[firstComponentId]->GetPackedEntities();
+		AddToGroup(firstComponentId, entities.data(), entities.size());
+	}
+}
+
+void Registry::MarkEntityChanged(Entity entity)
+{
+	// Make room for the entity system key if necessary.
+	const size_t entityIndex = GetEntityIndex(entity);
+	if (entityIndex >= m_entitySystemKeys.size())
+	{
+		m_entitySystemKeys.resize(entityIndex * 2 + 1);
+	}
+
+	// An entity whose component key still matches its system key is not queued yet.
+	if (entityIndex >= m_entityComponentKeys.size() || m_entityComponentKeys[entityIndex] == m_entitySystemKeys[entityIndex])
+	{
+		m_changedEntities.push_back(entity);
+	}
+}
+
+const std::vector<ISystem*>& Registry::GetMatchingSystems(const ComponentKey& componentKey)
+{
+	// Return the systems previously matched against this component key, if any.
+	const auto iterator = m_matchingSystems.find(componentKey);
+	if (iterator != m_matchingSystems.end())
+	{
+		return iterator->second;
+	}
+
+	// Otherwise match the key against every system once, and remember the result.
+	std::vector<ISystem*>& matchingSystems = m_matchingSystems[componentKey];
+	for (std::unique_ptr<ISystem>& genericSystem : m_systems)
+	{
+		const ComponentKey& requiredComponents = genericSystem->GetRequiredComponents();
+		if (requiredComponents.Any() && componentKey.Contains(requiredComponents))
+		{
+			matchingSystems.push_back(genericSystem.get());
+		}
+	}
+
+	return matchingSystems;
+}
+
+void Registry::UpdateSystemMembership(Entity entity)
+{
+	// Make room for the entity system key if necessary.
+	const size_t entityIndex = GetEntityIndex(entity);
+	if (entityIndex >= m_entitySystemKeys.size())
+	{
+		m_entitySystemKeys.resize(entityIndex * 2 + 1);
+	}
+
+	// Nothing to do if no component was added or removed since the entity was last matched.
+	const ComponentKey& componentKey = m_entityComponentKeys[entityIndex];
+	ComponentKey& systemKey = m_entitySystemKeys[entityIndex];
+	if (componentKey == systemKey)
+	{
+		return;
+	}
+
+	// Leave the systems matched by the old key that the new key no longer satisfies.
+	for (ISystem* system : GetMatchingSystems(systemKey))
+	{
+		if (!componentKey.Contains(system->GetRequiredComponents()))
+		{
+			system->RemoveEntity(entity);
+		}
+	}
+
+	// Join the systems matched by the new key that the old key did not satisfy.
+	for (ISystem* system : GetMatchingSystems(componentKey))
+	{
+		if (!systemKey.Contains(system->GetRequiredComponents()))
+		{
+			system->AddEntity(entity);
+		}
+	}
+
+	systemKey = componentKey;
+}
+
+void Registry::ProcessEntityRemovals()
+{
+	// Group the removed entities by component key, so each group only visits the component sets and systems its key names.
+	std::unordered_map<ComponentKey, std::vector<Entity>> entitiesPerComponentKey;
+	for (const Entity entity : m_removedEntities)
+	{
+		// Skip entities that were already removed, possibly queued more than once.
+		if (!IsAlive(entity))
+		{
+			continue;
+		}
+
+		// Take the entity component key, leaving it cleared.
+		const uint32_t entityIndex = GetEntityIndex(entity);
+		ComponentKey componentKey;
+		if (entityIndex < m_entityComponentKeys.size())
+		{
+			componentKey = m_entityComponentKeys[entityIndex];
+			m_entityComponentKeys[entityIndex].Clear();
+
+			// An entity whose system membership is behind its component key leaves its systems on its own,
+			// the others leave the systems matched by their key together with the rest of their group.
+			if (entityIndex >= m_entitySystemKeys.size() || m_entitySystemKeys[entityIndex] != componentKey)
+			{
+				UpdateSystemMembership(entity);
+			}
+			else
+			{
+				m_entitySystemKeys[entityIndex].Clear();
+			}
+		}
+
+		entitiesPerComponentKey[componentKey].push_back(entity);
+
+		// Bump the slot generation so stale handles, and any later duplicate in the queue, stop matching, and push the slot onto the free list.
+		m_entities[entityIndex] = MakeEntity(m_freeEntityIndex, GetEntityGeneration(entity) + 1);
+		m_freeEntityIndex = entityIndex;
+	}
+
+	for (const auto& componentKeyEntities : entitiesPerComponentKey)
+	{
+		const ComponentKey& componentKey = componentKeyEntities.first;
+		const std::vector<Entity>& entities = componentKeyEntities.second;
+
+		// Queue the group for the remove observers of every component it has, and swap and pop it out of each component set in one pass.
+		componentKey.ForEachComponent([this, &entities](ComponentId componentId)
+		{
+			RecordComponentsRemoved(componentId, entities.data(), entities.size());
+
+			if (m_storageMode == StorageMode::SparseSet)
+			{
+				assert(m_componentSets[componentId]);
+				RemoveFromGroup(componentId, entities.data(), entities.size());
+				m_componentSets[componentId]->RemoveComponents(entities.data(), entities.size());
+			}
+		});
+
+		// The whole group shares one archetype, release each of its rows.
+		if (m_storageMode == StorageMode::Archetype && componentKey.Any())
+		{
+			for (const Entity entity : entities)
+			{
+				MoveEntityToArchetype(entity, ComponentKey());
+			}
+		}
+
+		// Leave the systems matched by the component key.
+		if (componentKey.Any())
+		{
+			for (ISystem* system : GetMatchingSystems(componentKey))
+			{
+				system->RemoveEntities(entities.data(), entities.size());
+			}
+		}
+	}
+
+	// Remove the entities from every tag set, skipping tags nobody carries.
+	for (TagSet& tagSet : m_tagSets)
+	{
+		if (tagSet.GetEntities().empty())
+		{
+			continue;
+		}
+
+		for (const auto& componentKeyEntities : entitiesPerComponentKey)
+		{
+			tagSet.RemoveEntities(componentKeyEntities.second.data(), componentKeyEntities.second.size());
+		}
+	}
+
+	// Clear the set of removed entities.
+	m_removedEntities.clear();
+}
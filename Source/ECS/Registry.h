@@ -1,11 +1,20 @@
 #pragma once
 #include "PCH.h"
+#include "Archetype.h"
+#include "CommandBuffer.h"
+#include "ComponentKey.h"
 #include "ComponentIdGenerator.h"
 #include "ComponentSet.h"
-#include "EventManager\EventManager.h"
+#include "ComponentView.h"
+#include "EntityPrototype.h"
+#include "EventManager/EventManager.h"
+#include "JobSystem/JobSystem.h"
 #include "Macros.h"
+#include "SharedComponent.h"
+#include "Snapshot.h"
 #include "System.h"
 #include "TagIdGenerator.h"
+#include "TagSet.h"
 #include "Types.h"
 
 //--------------------------------------------------------------------------------------------------------------------------------
@@ -19,106 +28,57 @@ enum class RequestPriority : unsigned char
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
-// Deferred add component request.
-class IRegistryRequestAddComponent
+// Registry component storage mode.
+enum class StorageMode : unsigned char
 {
-public:
-	virtual ~IRegistryRequestAddComponent() = default;
-	virtual void Execute() = 0;
-};
-
-template<typename TComponent, typename TRequestHandler>
-class RegistryRequestAddComponent final : public IRegistryRequestAddComponent
-{
-public:
-	RegistryRequestAddComponent(Registry* registry, const TRequestHandler requestHandler, Entity entity, const TComponent& component)
-		: m_component(component)
-		, m_entity(entity)
-		, m_registry(registry)
-		, m_requestHandler(requestHandler)
-	{
-	}
-
-	virtual ~RegistryRequestAddComponent() = default;
-
-	void Execute() override { (m_registry->*m_requestHandler)(m_entity, m_component); }
-
-private:
-	TComponent m_component;
-	Entity m_entity;
-	Registry* m_registry;
-	TRequestHandler m_requestHandler;
+	SparseSet = 0,	// Each component type lives in its own component set.
+	Archetype = 1	// Entities sharing a component key live together in chunks, one column per component.
 };
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
-// Deferred remove component request.
-class IRegistryRequestRemoveComponent
+// Receives a contiguous span of entities a component was added to or removed from since the last notification.
+using ComponentObserver = std::function<void(const Entity* entities, size_t count)>;
+
+// The observers of a single component type, and the entities awaiting delivery to them.
+struct ComponentObservers
 {
-public:
-	virtual ~IRegistryRequestRemoveComponent() = default;
-	virtual void Execute() = 0;
+	std::vector<ComponentObserver> OnAdd;
+	std::vector<ComponentObserver> OnRemove;
+	std::vector<Entity> AddedEntities;
+	std::vector<Entity> RemovedEntities;
 };
 
-template<typename TComponent, typename TRequestHandler>
-class RegistryRequestRemoveComponent final : public IRegistryRequestRemoveComponent
+// A set of components whose component sets keep the entities having all of them co-sorted at the front of their dense
+// arrays, so the n-th entity of the group sits at dense index n in every owned set.
+struct ComponentGroup
 {
-public:
-	RegistryRequestRemoveComponent(Registry* registry, const TRequestHandler requestHandler, Entity entity)
-		: m_entity(entity)
-		, m_registry(registry)
-		, m_requestHandler(requestHandler)
-	{
-	}
-
-	virtual ~RegistryRequestRemoveComponent() = default;
-
-	void Execute() override { (m_registry->*m_requestHandler)(m_entity); }
-
-private:
-	Entity m_entity;
-	Registry* m_registry;
-	TRequestHandler m_requestHandler;
+	ComponentKey OwnedComponents;
+	size_t Size = 0;	// The number of entities in the group.
 };
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
-// Deferred add tag request.
-class IRegistryRequestTag
+// A world of entities, their components and tags, and the systems updating them. Worlds are independent of each other
+// and may update concurrently, they only share the job system and the component, tag, and event ids.
+class Registry final
 {
-public:
-	virtual ~IRegistryRequestTag() = default;
-	virtual void Execute() = 0;
-};
+	NO_COPY(Registry);
+	NO_MOVE(Registry);
 
-template<typename TComponent, typename TRequestHandler>
-class RegistryRequestTag final : public IRegistryRequestTag
-{
 public:
-	RegistryRequestTag(Registry* registry, const TRequestHandler requestHandler, Entity entity)
-		: m_entity(entity)
-		, m_registry(registry)
-		, m_requestHandler(requestHandler)
-	{
-	}
-
-	virtual ~RegistryRequestTag() = default;
-
-	void Execute() override { (m_registry->*m_requestHandler)(m_entity); }
+//--------------------------------------------------------------------------------------------------------------------------------
 
-private:
-	Entity m_entity;
-	Registry* m_registry;
-	TRequestHandler m_requestHandler;
-};
+	Registry();
+	explicit Registry(EventManager& eventManager);
+	~Registry();
 
-//--------------------------------------------------------------------------------------------------------------------------------
+	// The world the engine runs, which uses the shared event manager.
+	static const Registry& GetInstanceRead() { return GetInstance(); }
+	static Registry& GetInstanceWrite() { return GetInstance(); }
 
-class Registry final
-{
-	SINGLETON(Registry);
+	EventManager& GetEventManager() { return m_eventManager; }
 
-public:
 //--------------------------------------------------------------------------------------------------------------------------------
 
 	void RunSystemsInitialize();
@@ -133,23 +93,36 @@ public:
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
-	Entity CreateEntity();
-	void RemoveEntity(Entity entity);
+	std::vector<unsigned char> SaveSnapshot();
+	bool LoadSnapshot(const std::vector<unsigned char>& snapshot);
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
-	void ProcessComponentAdditions();
-	void ProcessComponnetRemovals();
+	void SetStorageMode(StorageMode storageMode);
+	StorageMode GetStorageMode() const { return m_storageMode; }
+
+	ChangeTick GetChangeTick() const { return m_changeTick; }
+
+	std::vector<ComponentStorageStats> GetComponentStorageStats() const;
+
+	// Reorders the storage of every entity carrying the component by the key computed from it, e.g. a Morton code of its
+	// position, so entities close in key are close in memory. The keys are sorted on a background job, and the order is
+	// applied to every component of those entities at the start of a later system update.
+	template<typename TComponent, typename TGetSortKey> void RequestComponentOrder(TGetSortKey getSortKey);
+	bool IsComponentOrderPending() const { return m_isComponentOrderPending; }
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
-	void ProcessEntityAdditions();
-	void ProcessEntityRemovals();
+	Entity CreateEntity();
+	std::vector<Entity> CreateEntities(size_t count, const EntityPrototype& prototype);
+	std::vector<Entity> Clone(Entity entity, size_t count);
+	void RemoveEntity(Entity entity);
+	bool IsAlive(Entity entity) const;
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
-	void ProcessTagAdditions();
-	void ProcessTagRemovals();
+	void ProcessEntityAdditions();
+	void ProcessEntityRemovals();
 
 //--------------------------------------------------------------------------------------------------------------------------------
 	
@@ -159,18 +132,43 @@ public:
 	template<typename TComponent> TComponent& GetComponentWrite(Entity entity);
 	template<typename TComponent> void RemoveComponent(Entity entity, RequestPriority priority = RequestPriority::Deferred);
 
+//--------------------------------------------------------------------------------------------------------------------------------
+
+	template<typename TComponent> void OnAdd(ComponentObserver observer);
+	template<typename TComponent> void OnRemove(ComponentObserver observer);
+	void NotifyComponentObservers();
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+	template<typename... TComponents> ComponentView<TComponents...> View();
+	template<typename... TComponents, typename TFunction> void ForEachChunk(TFunction function);
+
+	// Owned groups keep the given components co-sorted in sparse set storage mode, so views over exactly these components
+	// walk their arrays in lockstep. Every component can be owned by a single group, archetype storage needs no groups.
+	// Adding a group that already exists does nothing.
+	template<typename... TComponents> void AddGroup();
+
 //--------------------------------------------------------------------------------------------------------------------------------
 
 	template<typename TTag> void AddTag(Entity entity, RequestPriority priority = RequestPriority::Deferred);
 	template<typename TTag> bool HaveTag(Entity entity) const;
-	template<typename TTag> const std::vector<Entity>& GetEntitiesWithTag();
+	template<typename TTag> const std::vector<Entity>& GetEntitiesWithTag() const;
 	template<typename TTag> void RemoveTag(Entity entity, RequestPriority priority = RequestPriority::Deferred);
 
+//--------------------------------------------------------------------------------------------------------------------------------
+
+	// Shared components store each distinct value once, entities carry a SharedComponent<TComponent> index to it.
+	template<typename TComponent> void AddSharedComponent(Entity entity, const TComponent& component, RequestPriority priority = RequestPriority::Deferred);
+	template<typename TComponent> bool HaveSharedComponent(Entity entity) const;
+	template<typename TComponent> const TComponent& GetSharedComponentRead(Entity entity) const;
+	template<typename TComponent> void RemoveSharedComponent(Entity entity, RequestPriority priority = RequestPriority::Deferred);
+	template<typename TComponent, typename... TComponents, typename TFunction> void ForEachSharedComponentGroup(TFunction function);
+
 //--------------------------------------------------------------------------------------------------------------------------------
 
 	template<typename TSystem> void AddSystem();
 	const std::vector<std::unique_ptr<ISystem>>& GetSystemsRead() const { return m_systems; }
-	std::vector<std::unique_ptr<ISystem>>& GetSystemsWrite() { return m_systems; }
+	std::vector<std::unique_ptr<ISystem>>& GetSystemsWrite() { m_isSystemScheduleDirty = true; m_matchingSystems.clear(); return m_systems; }
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
@@ -191,28 +189,87 @@ public:
 //--------------------------------------------------------------------------------------------------------------------------------
 
 private:
-	Entity m_nextEntity = 0;
+	static Registry& GetInstance();
+
+	void BuildSystemSchedule();
+
+	void ApplyComponentOrder();
+
+	void ReserveCommandBuffers();
+	CommandBuffer& GetCommandBuffer(std::vector<std::unique_ptr<CommandBuffer>>& commandBuffers);
+	void ExecuteCommandBuffers(std::vector<std::unique_ptr<CommandBuffer>>& commandBuffers);
+
+	void DiscardWorld();
+	bool LoadSnapshotWorld(SnapshotReader& reader, size_t componentTypeCount, size_t tagTypeCount);
+	bool IsSnapshotComponentKeyValid(const ComponentKey& componentKey, size_t componentTypeCount) const;
+	bool IsSnapshotWorldConsistent() const;
+	bool AreSnapshotSharedIndicesValid() const;
 
-	std::queue<Entity> m_deletedEntities; // The set of recyclable entities.
+	std::vector<Entity> InstantiateEntities(size_t count, const ComponentKey& componentKey, const void* const* components);
+
+	void RecordComponentsAdded(ComponentId componentId, const Entity* entities, size_t count);
+	void RecordComponentsRemoved(ComponentId componentId, const Entity* entities, size_t count);
+	void NotifyWorldComponentObservers(std::vector<ComponentObserver> ComponentObservers::* observerList);
+
+	void AddToGroup(ComponentId componentId, const Entity* entities, size_t count);
+	void RemoveFromGroup(ComponentId componentId, const Entity* entities, size_t count);
+	void RebuildGroups();
+
+	void MarkEntityChanged(Entity entity);
+	void UpdateSystemMembership(Entity entity);
+	const std::vector<ISystem*>& GetMatchingSystems(const ComponentKey& componentKey);
+
+	size_t GetOrCreateArchetype(const ComponentKey& componentKey);
+	void MoveEntityToArchetype(Entity entity, const ComponentKey& componentKey);
+	template<typename TComponent> TComponent* GetArchetypeComponent(Entity entity, ComponentId componentId) const;
+	template<typename TComponent> ComponentSet<TComponent>* GetComponentSet() const;
+	template<typename TComponent> SharedComponentTable<TComponent>& GetSharedComponentTable();
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+private:
+	std::vector<Entity> m_entities; // Every entity slot. Live slots hold their entity, free slots link to the next free slot.
+	uint32_t m_freeEntityIndex = INVALID_ENTITY_INDEX; // The head of the intrusive list of recyclable entity slots.
 	std::vector<std::unique_ptr<IComponentSet>> m_componentSets; // All component sets.
 
 	std::vector<ComponentKey> m_entityComponentKeys; // Set bits indicate which components are currently present on the entity.
+	std::vector<ComponentKey> m_entitySystemKeys; // The component key each entity's current system membership was matched against.
 
-	std::unordered_map<TagId, std::vector<Entity>> m_tagToEntityMap; // The set of all entities a tag belongs to.
-	std::unordered_map<Entity, std::vector<TagId>> m_entityToTagMap; // The set of all tags an entity has.
+	StorageMode m_storageMode = StorageMode::SparseSet; // How components are stored.
+	std::vector<std::unique_ptr<Archetype>> m_archetypes; // All archetypes created so far.
+	std::unordered_map<ComponentKey, size_t> m_archetypeLookup; // Maps a component key to its archetype index.
+	std::vector<EntityLocation> m_entityLocations; // Where each entity's components live in archetype storage.
+
+	std::vector<ComponentGroup> m_groups; // The owned groups, only maintained in sparse set storage mode.
+	std::vector<size_t> m_componentGroups = std::vector<size_t>(COMPONENT_COUNT, INVALID_INDEX); // The group owning each component, indexed by component id.
+
+	std::vector<TagSet> m_tagSets; // The set of entities carrying each tag, indexed by tag id.
+
+	std::vector<std::unique_ptr<ISharedComponentTable>> m_sharedComponentTables; // The distinct values of every shared component type, indexed by the component id of its SharedComponent.
+
+	ChangeTick m_changeTick = 1; // Stamped on every component addition and write, advanced around every system phase.
+
+	std::vector<ComponentObservers> m_componentObservers = std::vector<ComponentObservers>(COMPONENT_COUNT); // The lifecycle observers of every component type, indexed by component id.
+	ComponentKey m_pendingObservedComponents; // The components with additions or removals awaiting delivery to their observers.
 
 	std::vector<std::unique_ptr<ISystem>> m_systems; // The set of all entity updating and rendering systems.
+	std::vector<std::vector<ISystem*>> m_systemPhases; // Systems grouped into phases whose members can update concurrently.
+	bool m_isSystemScheduleDirty = true; // Are the system phases out of date with the set of systems.
+	std::unordered_map<ComponentKey, std::vector<ISystem*>> m_matchingSystems; // Caches the systems whose required components each component key contains.
 
-	std::vector<Entity> m_addedEntities; // The set of new entities awaiting addition into existing systems.
+	std::vector<Entity> m_changedEntities; // The set of entities whose component key changed since their system membership was last matched.
 	std::vector<Entity> m_removedEntities; // The set of entities awaiting complete removal.
 
-	EventManager& m_eventManager = EventManager::GetInstanceWrite();
+	std::vector<std::pair<uint64_t, Entity>> m_componentOrder; // The sort key of every entity being reordered, sorted in place by a background job.
+	std::atomic<size_t> m_componentOrderJobCount{ 0 }; // The number of unfinished background jobs sorting the component order.
+	bool m_isComponentOrderPending = false; // Is a requested component order still being sorted or waiting to be applied.
 
-	std::vector<std::unique_ptr<IRegistryRequestAddComponent>> m_addComponentRequests; // The set of pending add component to entity requests.
-	std::vector<std::unique_ptr<IRegistryRequestRemoveComponent>> m_removeComponentRequests; // The set of pending remove component from entity requests.
+	std::unique_ptr<EventManager> m_ownedEventManager; // The event manager of a world created without one.
+	EventManager& m_eventManager; // The event manager delivering the events emitted in this world.
+	JobSystem& m_jobSystem = JobSystem::GetInstanceWrite();
 
-	std::vector<std::unique_ptr<IRegistryRequestTag>> m_addTagRequests; // The set of pending add tag to entity requests.
-	std::vector<std::unique_ptr<IRegistryRequestTag>> m_removeTagRequests; // The set of pending remove tag from entity requests.
+	std::vector<std::unique_ptr<CommandBuffer>> m_componentCommandBuffers; // Pending component and entity removal commands, one buffer per thread.
+	std::vector<std::unique_ptr<CommandBuffer>> m_tagCommandBuffers; // Pending tag commands, one buffer per thread.
 
 	bool m_isInSystemUpdate = false; // Is the registry in the middle of some system update routine.
 	bool m_isInSystemRender = false; // Is the registry in the middle of some system render routine.
@@ -239,14 +296,42 @@ inline void Registry::AddComponent(Entity entity, const TComponent& component, R
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
+template<typename TComponent, typename TGetSortKey>
+inline void Registry::RequestComponentOrder(TGetSortKey getSortKey)
+{
+	// The components are read right away, so systems must not be writing them.
+	assert(!m_isInSystemUpdate && !m_isInSystemRender);
+
+	// Only one order is sorted at a time, requests made while one is pending are dropped.
+	if (m_isComponentOrderPending)
+	{
+		return;
+	}
+
+	// Take the key of every entity carrying the component now, so the background sort never touches the components.
+	m_componentOrder.clear();
+	View<const TComponent>().Each([this, &getSortKey](Entity entity, const TComponent& component)
+	{
+		m_componentOrder.emplace_back(getSortKey(component), entity);
+	});
+
+	// Sort the keys on a background job, ties keep entities in handle order.
+	m_isComponentOrderPending = true;
+	std::vector<Job> sortJobs;
+	sortJobs.push_back([this]() { std::sort(m_componentOrder.begin(), m_componentOrder.end()); });
+	m_jobSystem.Submit(sortJobs, m_componentOrderJobCount);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
 template<typename TComponent>
 bool Registry::HaveComponent(Entity entity) const
 {
 	// Get the component id to index into the component sets array.
-	static const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
 
 	// Check the component key for presence of the corresponding component id.
-	return m_entityComponentKeys[entity].test(componentId);
+	return IsAlive(entity) && m_entityComponentKeys[GetEntityIndex(entity)].Test(componentId);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------
@@ -255,25 +340,39 @@ template<typename TComponent>
 TComponent& Registry::GetComponentWrite(Entity entity)
 {
 	// Get the component id to index into the component sets array.
-	static const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
 
-	// Ensure the entity has the component we are attempting to retrieve.
-	assert(m_entityComponentKeys[entity].test(componentId));
+	// Ensure the entity is alive and has the component we are attempting to retrieve.
+	assert(IsAlive(entity) && m_entityComponentKeys[GetEntityIndex(entity)].Test(componentId));
 
-	// Get the component for the corresponding entity.
+	// In archetype mode the component lives in the entity's archetype chunk.
+	if (m_storageMode == StorageMode::Archetype)
+	{
+		const EntityLocation& location = m_entityLocations[GetEntityIndex(entity)];
+		m_archetypes[location.ArchetypeIndex]->MarkChanged(componentId, location.ChunkIndex, m_changeTick);
+		return *GetArchetypeComponent<TComponent>(entity, componentId);
+	}
+
+	// Get the component for the corresponding entity, marking it as changed.
 	const std::unique_ptr<IComponentSet>& genericComponent = m_componentSets[componentId];
 	ComponentSet<TComponent>* specificComponentSet = static_cast<ComponentSet<TComponent>*>(genericComponent.get());
-	return specificComponentSet->GetComponentWrite(entity);
+	return specificComponentSet->GetComponentWrite(entity, m_changeTick);
 }
 
 template<typename TComponent>
 const TComponent& Registry::GetComponentRead(Entity entity) const
 {
 	// Get the component id to index into the component sets array.
-	static const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
 
-	// Ensure the entity has the component we are attempting to retrieve.
-	assert(m_entityComponentKeys[entity].test(componentId));
+	// Ensure the entity is alive and has the component we are attempting to retrieve.
+	assert(IsAlive(entity) && m_entityComponentKeys[GetEntityIndex(entity)].Test(componentId));
+
+	// In archetype mode the component lives in the entity's archetype chunk.
+	if (m_storageMode == StorageMode::Archetype)
+	{
+		return *GetArchetypeComponent<TComponent>(entity, componentId);
+	}
 
 	// Get the component for the corresponding entity.
 	const std::unique_ptr<IComponentSet>& genericComponent = m_componentSets[componentId];
@@ -302,6 +401,107 @@ void Registry::RemoveComponent(Entity entity, RequestPriority priority)
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
+template<typename TComponent>
+inline void Registry::OnAdd(ComponentObserver observer)
+{
+	// Observers cannot be registered while systems may be reading them.
+	assert(!m_isInSystemUpdate && !m_isInSystemRender);
+
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+	m_componentObservers[componentId].OnAdd.push_back(std::move(observer));
+}
+
+template<typename TComponent>
+inline void Registry::OnRemove(ComponentObserver observer)
+{
+	// Observers cannot be registered while systems may be reading them.
+	assert(!m_isInSystemUpdate && !m_isInSystemRender);
+
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+	m_componentObservers[componentId].OnRemove.push_back(std::move(observer));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+template<typename... TComponents>
+inline ComponentView<TComponents...> Registry::View()
+{
+	// In archetype mode the view walks the archetype chunks.
+	if (m_storageMode == StorageMode::Archetype)
+	{
+		return ComponentView<TComponents...>(m_changeTick, m_archetypes);
+	}
+
+	// Otherwise the view joins the component sets.
+	ComponentView<TComponents...> view(m_changeTick, GetComponentSet<std::remove_const_t<TComponents>>()...);
+
+	// A view over exactly the components of an owned group walks the group in lockstep, even while the group is empty.
+	if (!m_groups.empty())
+	{
+		const ComponentId componentIds[] = { ComponentIdGenerator::GetComponentId<std::remove_const_t<TComponents>>()... };
+		const size_t groupIndex = m_componentGroups[componentIds[0]];
+		if (groupIndex != INVALID_INDEX)
+		{
+			ComponentKey viewComponents;
+			for (const ComponentId componentId : componentIds)
+			{
+				viewComponents.Set(componentId);
+			}
+
+			if (viewComponents == m_groups[groupIndex].OwnedComponents)
+			{
+				view.SetGroupSize(m_groups[groupIndex].Size);
+			}
+		}
+	}
+
+	return view;
+}
+
+template<typename... TComponents>
+inline void Registry::AddGroup()
+{
+	static_assert(sizeof...(TComponents) > 1, "A group co-sorts at least two components.");
+
+	// Groups reorder component sets, so systems must not be iterating them.
+	assert(!m_isInSystemUpdate && !m_isInSystemRender);
+
+	// Gather the components the group owns.
+	ComponentGroup group;
+	const ComponentId componentIds[] = { ComponentIdGenerator::GetComponentId<std::remove_const_t<TComponents>>()... };
+	for (const ComponentId componentId : componentIds)
+	{
+		group.OwnedComponents.Set(componentId);
+	}
+
+	// Adding the same group again keeps the existing one.
+	const size_t existingGroupIndex = m_componentGroups[componentIds[0]];
+	if (existingGroupIndex != INVALID_INDEX && m_groups[existingGroupIndex].OwnedComponents == group.OwnedComponents)
+	{
+		return;
+	}
+
+	// Claim every component for the new group.
+	for (const ComponentId componentId : componentIds)
+	{
+		assert(m_componentGroups[componentId] == INVALID_INDEX && "A component can only be owned by one group.");
+		m_componentGroups[componentId] = m_groups.size();
+	}
+
+	m_groups.push_back(group);
+
+	// Gather the entities that already have every owned component.
+	RebuildGroups();
+}
+
+template<typename... TComponents, typename TFunction>
+inline void Registry::ForEachChunk(TFunction function)
+{
+	View<TComponents...>().EachChunk(function);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
 template<typename TTag>
 void Registry::AddTag(Entity entity, RequestPriority priority)
 {
@@ -324,35 +524,31 @@ void Registry::AddTag(Entity entity, RequestPriority priority)
 template<typename TTag>
 bool Registry::HaveTag(Entity entity) const
 {
-	bool foundTag = false;
-
-	// Search for an entry of this entity in the entity-tag map.
-	const auto iterator = m_entityToTagMap.find(entity);
-	if (iterator != m_entityToTagMap.end())
-	{
-		// Get the entity tag list.
-		const std::vector<TagId>& entityTagIds = iterator->second;
-
-		// Get the tag id.
-		static const TagId tagId = TagIdGenerator::GetTagId<TTag>();
-
-		// Search for the corresponding tag id in the entity's tag id list.
-		foundTag = std::find(entityTagIds.begin(), entityTagIds.end(), tagId) != entityTagIds.end();
-	}
+	// Get the tag id.
+	const TagId tagId = TagIdGenerator::GetTagId<TTag>();
 
-	return foundTag;
+	// Test the entity bit of the tag set. Tags are cleared when an entity is removed, so only stale handles need rejecting.
+	return tagId < m_tagSets.size() && IsAlive(entity) && m_tagSets[tagId].HaveEntity(entity);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
 template<typename TTag>
-inline const std::vector<Entity>& Registry::GetEntitiesWithTag()
+inline const std::vector<Entity>& Registry::GetEntitiesWithTag() const
 {
 	// Get the tag id.
-	static const TagId tagId = TagIdGenerator::GetTagId<TTag>();
+	const TagId tagId = TagIdGenerator::GetTagId<TTag>();
 
-	// Return the list of entities with this tag, even if its empty.
-	return m_tagToEntityMap[tagId];
+	// Systems in the same phase may query tags concurrently, so a tag nobody carried yet gets a shared empty list
+	// instead of growing the tag sets.
+	if (tagId >= m_tagSets.size())
+	{
+		static const std::vector<Entity> noEntities;
+		return noEntities;
+	}
+
+	// Return the packed list of entities with this tag, even if its empty.
+	return m_tagSets[tagId].GetEntities();
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------
@@ -376,28 +572,125 @@ void Registry::RemoveTag(Entity entity, RequestPriority priority)
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
+template<typename TComponent>
+void Registry::AddSharedComponent(Entity entity, const TComponent& component, RequestPriority priority)
+{
+	switch (priority)
+	{
+	case RequestPriority::Deferred:
+		// Interning waits for the command as well, systems may record shared components concurrently.
+		GetCommandBuffer(m_componentCommandBuffers).Record([entity, component](Registry& registry)
+		{
+			registry.AddSharedComponent<TComponent>(entity, component, RequestPriority::Immediate);
+		});
+		break;
+	case RequestPriority::Immediate:
+		// Store the value once, and give the entity its index.
+		assert(!m_isInSystemUpdate && !m_isInSystemRender);
+		HandleAddComponentImmediate<SharedComponent<TComponent>>(entity, SharedComponent<TComponent>{ GetSharedComponentTable<TComponent>().Intern(component) });
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+template<typename TComponent>
+bool Registry::HaveSharedComponent(Entity entity) const
+{
+	return HaveComponent<SharedComponent<TComponent>>(entity);
+}
+
+template<typename TComponent>
+const TComponent& Registry::GetSharedComponentRead(Entity entity) const
+{
+	// Resolve the entity's index into the table of shared values.
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<SharedComponent<TComponent>>();
+	const SharedComponent<TComponent>& sharedComponent = GetComponentRead<SharedComponent<TComponent>>(entity);
+	assert(componentId < m_sharedComponentTables.size() && m_sharedComponentTables[componentId]);
+	return static_cast<const SharedComponentTable<TComponent>*>(m_sharedComponentTables[componentId].get())->GetValue(sharedComponent.Index);
+}
+
+template<typename TComponent>
+void Registry::RemoveSharedComponent(Entity entity, RequestPriority priority)
+{
+	// The value stays in the table, other entities may still reference it.
+	RemoveComponent<SharedComponent<TComponent>>(entity, priority);
+}
+
+template<typename TComponent, typename... TComponents, typename TFunction>
+inline void Registry::ForEachSharedComponentGroup(TFunction function)
+{
+	// Group the entities carrying the shared component, and the other given components, by their shared value.
+	GetSharedComponentTable<TComponent>().ForEachGroup(View<const SharedComponent<TComponent>, const TComponents...>(), function);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+template<typename TComponent>
+inline TComponent* Registry::GetArchetypeComponent(Entity entity, ComponentId componentId) const
+{
+	// Find the entity's row in its archetype, and the component within the row.
+	const EntityLocation& location = m_entityLocations[GetEntityIndex(entity)];
+	Archetype* archetype = m_archetypes[location.ArchetypeIndex].get();
+	return static_cast<TComponent*>(archetype->GetComponent(componentId, location.ChunkIndex, location.Row));
+}
+
+template<typename TComponent>
+inline ComponentSet<TComponent>* Registry::GetComponentSet() const
+{
+	// Get the component id to index into the component sets array.
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+
+	// The component set does not exist until the component is first added to an entity.
+	if (componentId >= m_componentSets.size())
+	{
+		return nullptr;
+	}
+
+	return static_cast<ComponentSet<TComponent>*>(m_componentSets[componentId].get());
+}
+
+template<typename TComponent>
+inline SharedComponentTable<TComponent>& Registry::GetSharedComponentTable()
+{
+	// Get the component id of the index component, to index into the shared component tables.
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<SharedComponent<TComponent>>();
+
+	// Make room for the table if necessary, and create it on first use.
+	if (componentId >= m_sharedComponentTables.size())
+	{
+		m_sharedComponentTables.resize(componentId + 1);
+	}
+
+	if (!m_sharedComponentTables[componentId])
+	{
+		m_sharedComponentTables[componentId] = std::make_unique<SharedComponentTable<TComponent>>();
+	}
+
+	return *static_cast<SharedComponentTable<TComponent>*>(m_sharedComponentTables[componentId].get());
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
 template<typename TSystem>
 void Registry::AddSystem()
 {
 	auto system = new TSystem(*this);
 	std::unique_ptr<ISystem> genericSystem(static_cast<ISystem*>(system));
 	m_systems.push_back(std::move(genericSystem));
+	m_isSystemScheduleDirty = true;
+	m_matchingSystems.clear();
 }
 
 template<typename TComponent>
 inline void Registry::HandleAddComponentDeferred(Entity entity, const TComponent& component)
 {
-// Initially allocating a component on the heap my cause it to not be byte aligned as declared,
-// but this is temporary as the component will be placed in the appropriate array where they will reside byte aligned.
-#pragma warning(disable : 4316)
-	// Allocate the component addition request.
-	RegistryRequestAddComponent<TComponent, decltype(&Registry::HandleAddComponentImmediate<TComponent>)>* newRegistryRequest
-		= new RegistryRequestAddComponent<TComponent, decltype(&Registry::HandleAddComponentImmediate<TComponent>)>(this, &Registry::HandleAddComponentImmediate<TComponent>, entity, component);
-#pragma warning(default : 4316)
-
-	// Wrap the request in a unique pointer, and add it to the set of pending component additions.
-	std::unique_ptr<IRegistryRequestAddComponent> genericRequest(static_cast<IRegistryRequestAddComponent*>(newRegistryRequest));
-	m_addComponentRequests.push_back(std::move(genericRequest));
+	// Record the addition in the calling thread's command buffer, the component is copied inline with its declared alignment.
+	GetCommandBuffer(m_componentCommandBuffers).Record([entity, component](Registry& registry)
+	{
+		registry.HandleAddComponentImmediate<TComponent>(entity, component);
+	});
 }
 
 template<typename TComponent>
@@ -406,48 +699,84 @@ inline void Registry::HandleAddComponentImmediate(Entity entity, const TComponen
 	// We cannot add new components when in the middle of a system update or render routine.
 	assert(!m_isInSystemUpdate && !m_isInSystemRender);
 
+	// Components can only be added to live entities.
+	assert(IsAlive(entity));
+
 	// Get the component id to index into the component sets array.
-	static const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
 
-	// Make room for the new component set if necessary.
-	if (componentId >= m_componentSets.size())
+	// Make room for the entity component key if necessary.
+	const size_t entityIndex = GetEntityIndex(entity);
+	if (entityIndex >= m_entityComponentKeys.size())
 	{
-		m_componentSets.resize(componentId * 2 + 1);
+		m_entityComponentKeys.resize(entityIndex * 2 + 1);
 	}
 
-	// If there is no component set for this component, create one.
-	if (m_componentSets[componentId] == nullptr)
+	ComponentKey& componentKey = m_entityComponentKeys[entityIndex];
+
+	// Queue the entity for a system membership update once its new components are in place, and for its add observers.
+	if (!componentKey.Test(componentId))
 	{
-		ComponentSet<TComponent>* specificComponentSet = new ComponentSet<TComponent>();
-		std::unique_ptr<IComponentSet> setPointer(static_cast<IComponentSet*>(specificComponentSet));
-		m_componentSets[componentId] = std::move(setPointer);
+		MarkEntityChanged(entity);
+		RecordComponentsAdded(componentId, &entity, 1);
 	}
 
-	// Add the component to the proper set.
-	std::unique_ptr<IComponentSet>& genericComponentSet = m_componentSets[componentId];
-	ComponentSet<TComponent>* specificComponentSet = static_cast<ComponentSet<TComponent>*>(genericComponentSet.get());
-	specificComponentSet->AddComponent(entity, component);
+	// In archetype mode the entity moves to the archetype matching its new component key.
+	if (m_storageMode == StorageMode::Archetype)
+	{
+		// Overwrite the component if the entity already has it, which counts as a write.
+		if (componentKey.Test(componentId))
+		{
+			const EntityLocation& location = m_entityLocations[GetEntityIndex(entity)];
+			m_archetypes[location.ArchetypeIndex]->MarkChanged(componentId, location.ChunkIndex, m_changeTick);
+			*GetArchetypeComponent<TComponent>(entity, componentId) = component;
+		}
 
-	// Make room for the entity component key if necessary.
-	if (entity >= m_entityComponentKeys.size())
+		// Otherwise move the entity to its new archetype, and construct the component in the new row.
+		else
+		{
+			ComponentKey newComponentKey = componentKey;
+			newComponentKey.Set(componentId);
+			MoveEntityToArchetype(entity, newComponentKey);
+			new (GetArchetypeComponent<TComponent>(entity, componentId)) TComponent(component);
+		}
+	}
+
+	else
 	{
-		m_entityComponentKeys.resize(entity * 2 + 1);
+		// Make room for the new component set if necessary.
+		if (componentId >= m_componentSets.size())
+		{
+			m_componentSets.resize(componentId * 2 + 1);
+		}
+
+		// If there is no component set for this component, create one.
+		if (m_componentSets[componentId] == nullptr)
+		{
+			ComponentSet<TComponent>* specificComponentSet = new ComponentSet<TComponent>();
+			std::unique_ptr<IComponentSet> setPointer(static_cast<IComponentSet*>(specificComponentSet));
+			m_componentSets[componentId] = std::move(setPointer);
+		}
+
+		// Add the component to the proper set.
+		std::unique_ptr<IComponentSet>& genericComponentSet = m_componentSets[componentId];
+		ComponentSet<TComponent>* specificComponentSet = static_cast<ComponentSet<TComponent>*>(genericComponentSet.get());
+		specificComponentSet->AddComponent(entity, component, m_changeTick);
 	}
 
-	// Mark the component as present in the entity component key.
-	m_entityComponentKeys[entity].set(componentId);
+	// Mark the component as present in the entity component key, which may complete the entity's owned group.
+	componentKey.Set(componentId);
+	AddToGroup(componentId, &entity, 1);
 }
 
 template<typename TComponent>
 inline void Registry::HandleRemoveComponentDeferred(Entity entity)
 {
-	// Allocate the component removal request.
-	RegistryRequestRemoveComponent<TComponent, decltype(&Registry::HandleRemoveComponenImmediate<TComponent>)>* newRegistryRequest
-		= new RegistryRequestRemoveComponent<TComponent, decltype(&Registry::HandleRemoveComponenImmediate<TComponent>)>(this, &Registry::HandleRemoveComponenImmediate<TComponent>, entity);
-
-	// Wrap the request in a unique pointer, and add it to the set of pending component removals.
-	std::unique_ptr<IRegistryRequestRemoveComponent> genericRequest(static_cast<IRegistryRequestRemoveComponent*>(newRegistryRequest));
-	m_removeComponentRequests.push_back(std::move(genericRequest));
+	// Record the removal in the calling thread's command buffer.
+	GetCommandBuffer(m_componentCommandBuffers).Record([entity](Registry& registry)
+	{
+		registry.HandleRemoveComponenImmediate<TComponent>(entity);
+	});
 }
 
 template<typename TComponent>
@@ -456,44 +785,46 @@ inline void Registry::HandleRemoveComponenImmediate(Entity entity)
 	// We cannot remove components when in the middle of a system update or render routine.
 	assert(!m_isInSystemUpdate && !m_isInSystemRender);
 
-	bool canDeleteEntity = false;
-
 	// Get the component id to index into the component sets array.
-	static const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
 
-	// Remove the component for the corresponding entity, if it exists.
-	m_componentSets[componentId]->RemoveComponent(entity);
+	// A stale entity handle has no components to remove.
+	if (!IsAlive(entity))
+	{
+		return;
+	}
 
 	// Reset the flag for this component in the entity component key set.
-	ComponentKey& componentKey = m_entityComponentKeys[entity];
-	componentKey.reset(componentId);
-
-	// Check if the entity has any remaining components.
-	canDeleteEntity |= m_entityComponentKeys[entity].none();
+	ComponentKey& componentKey = m_entityComponentKeys[GetEntityIndex(entity)];
+	const bool hadComponent = componentKey.Test(componentId);
+	componentKey.Reset(componentId);
 
-	// Check if the remaining components for this entity still qualify it for membership in any of the current systems.
-	if (!canDeleteEntity)
+	// Remove the component for the corresponding entity, if it exists.
+	if (m_storageMode == StorageMode::Archetype)
 	{
-		// For each system...
-		for (std::unique_ptr<ISystem>& genericSystem : m_systems)
+		// Moving the entity to the archetype without the component destroys it.
+		if (hadComponent)
 		{
-			// Get the system component key.
-			const ComponentKey& requiredComponents = genericSystem->GetRequiredComponents();
-
-			// If the component key doesn't math the component set required by the system, remove the entity from the system.
-			const bool canRemoveFromSystem = (componentKey | requiredComponents) != requiredComponents;
-			if (canRemoveFromSystem)
-			{
-				genericSystem->RemoveEntity(entity);
-			}
-
-			// Update the can delete flag.
-			canDeleteEntity |= !canRemoveFromSystem;
+			MoveEntityToArchetype(entity, componentKey);
 		}
 	}
+	else if (hadComponent)
+	{
+		RemoveFromGroup(componentId, &entity, 1);
+		m_componentSets[componentId]->RemoveComponent(entity);
+	}
 
-	// If the entity has no more components, or if it no longer belongs to any system, remove it completely.
-	if (canDeleteEntity)
+	// Queue the entity for the remove observers.
+	if (hadComponent)
+	{
+		RecordComponentsRemoved(componentId, &entity, 1);
+	}
+
+	// Remove the entity from the systems that required the component straight away.
+	UpdateSystemMembership(entity);
+
+	// If the entity has no more components, remove it completely.
+	if (componentKey.None())
 	{
 		RemoveEntity(entity);
 	}
@@ -502,13 +833,11 @@ inline void Registry::HandleRemoveComponenImmediate(Entity entity)
 template<typename TTag>
 inline void Registry::HandleAddTagDeferred(Entity entity)
 {
-	// Allocate the tag addition request.
-	RegistryRequestTag<TTag, decltype(&Registry::HandleAddTagImmediate<TTag>)>* newRegistryRequest
-		= new RegistryRequestTag<TTag, decltype(&Registry::HandleAddTagImmediate<TTag>)>(this, &Registry::HandleAddTagImmediate<TTag>, entity);
-
-	// Wrap the request in a unique pointer, and add it to the set of pending tag additions.
-	std::unique_ptr<IRegistryRequestTag> genericRequest(static_cast<IRegistryRequestTag*>(newRegistryRequest));
-	m_addTagRequests.push_back(std::move(genericRequest));
+	// Record the tag addition in the calling thread's command buffer.
+	GetCommandBuffer(m_tagCommandBuffers).Record([entity](Registry& registry)
+	{
+		registry.HandleAddTagImmediate<TTag>(entity);
+	});
 }
 
 template<typename TTag>
@@ -517,29 +846,36 @@ inline void Registry::HandleAddTagImmediate(Entity entity)
 	// We cannot add new tags when in the middle of a system update or render routine.
 	assert(!m_isInSystemUpdate && !m_isInSystemRender);
 
+	// A stale entity handle cannot be tagged.
+	if (!IsAlive(entity))
+	{
+		return;
+	}
+
 	// Check if we already happen to have this tag.
 	assert(!HaveTag<TTag>(entity));
 
 	// Get the tag id.
-	static const TagId tagId = TagIdGenerator::GetTagId<TTag>();
+	const TagId tagId = TagIdGenerator::GetTagId<TTag>();
 
-	// Append the entity to the list of entities with this tag.
-	m_tagToEntityMap[tagId].push_back(entity);
+	// Make room for the tag set if necessary.
+	if (tagId >= m_tagSets.size())
+	{
+		m_tagSets.resize(tagId + 1);
+	}
 
-	// Append the tag id to the list of tags the entity has.
-	m_entityToTagMap[entity].push_back(tagId);
+	// Add the entity to the set of entities with this tag.
+	m_tagSets[tagId].AddEntity(entity);
 }
 
 template<typename TTag>
 inline void Registry::HandleRemoveTagDeferred(Entity entity)
 {
-	// Allocate the tag addition request.
-	RegistryRequestTag<TTag, decltype(&Registry::HandleRemoveTagImmediate<TTag>)>* newRegistryRequest
-		= new RegistryRequestTag<TTag, decltype(&Registry::HandleRemoveTagImmediate<TTag>)>(this, &Registry::HandleRemoveTagImmediate<TTag>, entity);
-
-	// Wrap the request in a unique pointer, and add it to the set of pending tag additions.
-	std::unique_ptr<IRegistryRequestTag> genericRequest(static_cast<IRegistryRequestTag*>(newRegistryRequest));
-	m_removeTagRequests.push_back(std::move(genericRequest));
+	// Record the tag removal in the calling thread's command buffer.
+	GetCommandBuffer(m_tagCommandBuffers).Record([entity](Registry& registry)
+	{
+		registry.HandleRemoveTagImmediate<TTag>(entity);
+	});
 }
 
 template<typename TTag>
@@ -548,43 +884,20 @@ inline void Registry::HandleRemoveTagImmediate(Entity entity)
 	// We cannot remove tags when in the middle of a system update or render routine.
 	assert(!m_isInSystemUpdate && !m_isInSystemRender);
 
-	// Check if we have the tag we are removing in the first place.
-	assert(HaveTag<TTag>(entity));
-
-	// Get the tag id.
-	static const TagId tagId = TagIdGenerator::GetTagId<TTag>();
-
-	// Remove the tag entry from the tag-entity map.
-	const auto entitySetIterator = m_tagToEntityMap.find(tagId);
-	if (entitySetIterator != m_tagToEntityMap.end())
+	// A stale entity handle has no tags to remove.
+	if (!IsAlive(entity))
 	{
-		// Get the set of entities tagged with this tag.
-		std::vector<Entity>& taggedEntities = entitySetIterator->second;
-
-		// Find the entity that we want to erase.
-		const auto entityIterator = std::find(taggedEntities.begin(), taggedEntities.end(), entity);
-
-		// Erase the entity from the set of entities tagged with this tag.
-		taggedEntities.erase(entityIterator);
+		return;
 	}
 
-	// Remove the tag entry from the entity-tag map.
-	const auto tagSetIterator = m_entityToTagMap.find(entity);
-	if (tagSetIterator != m_entityToTagMap.end())
-	{
-		// Get the set of tags that this entity has.
-		const std::vector<TagId>& entityTags = tagSetIterator->second;
-
-		// Find the tag that we want to erase.
-		const auto tagIterator = std::find(entityTags.begin(), entityTags.end(), tagId);
+	// Check if we have the tag we are removing in the first place.
+	assert(HaveTag<TTag>(entity));
 
-		// Erase the tag from the set of tags this entity has.
-		m_entityToTagMap.erase(tagIterator);
-	}
+	// Get the tag id.
+	const TagId tagId = TagIdGenerator::GetTagId<TTag>();
 
-	// We should always find the tag in either both sets or neither.
-	assert((entitySetIterator == m_tagToEntityMap.find(tagId) && tagSetIterator == m_entityToTagMap.find(entity)) ||
-		(entitySetIterator != m_tagToEntityMap.find(tagId) && tagSetIterator != m_entityToTagMap.find(entity)));
+	// Remove the entity from the set of entities with this tag.
+	m_tagSets[tagId].RemoveEntity(entity);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------
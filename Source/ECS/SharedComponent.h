@@ -0,0 +1,195 @@
+#pragma once
+#include "PCH.h"
+#include "Snapshot.h"
+#include "Types.h"
+
+using SharedIndex = uint32_t;
+
+constexpr SharedIndex INVALID_SHARED_INDEX = UINT32_MAX;	// Marks a shared component that does not reference a value.
+
+// The component an entity carries in place of a shared TComponent value: the index of the value in the registry's table
+// of distinct TComponent values. Systems require it like any other component, and the registry resolves it to the value.
+template<typename TComponent>
+struct SharedComponent
+{
+	SharedIndex Index = INVALID_SHARED_INDEX;
+};
+
+// Reads the index of a shared component without knowing its value type, every SharedComponent has the same layout.
+inline SharedIndex GetSharedIndex(const void* sharedComponent)
+{
+	SharedIndex index = INVALID_SHARED_INDEX;
+	std::memcpy(&index, sharedComponent, sizeof(index));
+	return index;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+class ISharedComponentTable
+{
+public:
+	NO_COPY(ISharedComponentTable);
+	NO_MOVE(ISharedComponentTable);
+
+	ISharedComponentTable() = default;
+	virtual ~ISharedComponentTable() = default;
+
+	virtual size_t GetValueCount() const = 0;
+	virtual void SaveSnapshot(SnapshotWriter& writer) const = 0;
+	virtual bool LoadSnapshot(SnapshotReader& reader) = 0;
+};
+
+// Stores every distinct value of a shared component type once. The component type needs an equality operator and a
+// std::hash specialization. Values are kept until the registry shuts down or loads a snapshot, so indices held by entities
+// never dangle. Snapshots save the values along with the indices, like components only trivially copyable values can be saved.
+template<typename TComponent>
+class SharedComponentTable final : public ISharedComponentTable
+{
+public:
+	SharedComponentTable() = default;
+	~SharedComponentTable() = default;
+
+	SharedIndex Intern(const TComponent& value);
+	const TComponent& GetValue(SharedIndex index) const;
+	size_t GetValueCount() const override { return m_values.size(); }
+	void SaveSnapshot(SnapshotWriter& writer) const override;
+	bool LoadSnapshot(SnapshotReader& reader) override;
+
+	template<typename TView, typename TFunction> void ForEachGroup(TView view, TFunction function);
+
+private:
+	void SaveValues(SnapshotWriter& writer, std::true_type) const;
+	void SaveValues(SnapshotWriter& writer, std::false_type) const;
+	bool LoadValues(SnapshotReader& reader, std::true_type);
+	bool LoadValues(SnapshotReader& reader, std::false_type);
+
+private:
+	std::vector<TComponent> m_values;								// The distinct values, indexed by shared index.
+	std::unordered_map<TComponent, SharedIndex> m_valueIndices;		// Maps every distinct value to its shared index.
+	std::vector<size_t> m_groupOffsets;								// Where each value's group starts in the grouped entities, reused between groupings.
+	std::vector<Entity> m_groupedEntities;							// The entities of the last grouping, ordered by shared index.
+};
+
+template<typename TComponent>
+inline SharedIndex SharedComponentTable<TComponent>::Intern(const TComponent& value)
+{
+	// Reuse the index of an equal value if there is one.
+	const auto iterator = m_valueIndices.find(value);
+	if (iterator != m_valueIndices.end())
+	{
+		return iterator->second;
+	}
+
+	// Otherwise append the value.
+	assert(m_values.size() < INVALID_SHARED_INDEX);
+	const SharedIndex index = static_cast<SharedIndex>(m_values.size());
+	m_values.push_back(value);
+	m_valueIndices.emplace(value, index);
+	return index;
+}
+
+template<typename TComponent>
+inline const TComponent& SharedComponentTable<TComponent>::GetValue(SharedIndex index) const
+{
+	assert(index < m_values.size());
+	return m_values[index];
+}
+
+template<typename TComponent>
+inline void SharedComponentTable<TComponent>::SaveSnapshot(SnapshotWriter& writer) const
+{
+	SaveValues(writer, std::is_trivially_copyable<TComponent>());
+}
+
+template<typename TComponent>
+inline bool SharedComponentTable<TComponent>::LoadSnapshot(SnapshotReader& reader)
+{
+	// The table must be empty, so every value lands at the index it was saved at.
+	assert(m_values.empty());
+	if (!LoadValues(reader, std::is_trivially_copyable<TComponent>()))
+	{
+		return false;
+	}
+
+	// Rebuild the value lookup, every value was distinct when saved.
+	for (SharedIndex index = 0; index < m_values.size(); ++index)
+	{
+		if (!m_valueIndices.emplace(m_values[index], index).second)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+template<typename TComponent>
+inline void SharedComponentTable<TComponent>::SaveValues(SnapshotWriter& writer, std::true_type) const
+{
+	writer.WriteVector(m_values);
+}
+
+template<typename TComponent>
+inline void SharedComponentTable<TComponent>::SaveValues(SnapshotWriter& writer, std::false_type) const
+{
+	// Values owning resources cannot be restored from raw bytes, only an empty table can be saved.
+	assert(m_values.empty() && "Only trivially copyable shared components can be saved to a snapshot.");
+	writer.Write<uint64_t>(0);
+}
+
+template<typename TComponent>
+inline bool SharedComponentTable<TComponent>::LoadValues(SnapshotReader& reader, std::true_type)
+{
+	return reader.ReadVector(m_values) && m_values.size() < INVALID_SHARED_INDEX;
+}
+
+template<typename TComponent>
+inline bool SharedComponentTable<TComponent>::LoadValues(SnapshotReader& reader, std::false_type)
+{
+	// Values owning resources cannot be restored from raw bytes, only an empty table was saved.
+	uint64_t valueCount = 0;
+	return reader.Read(valueCount) && valueCount == 0;
+}
+
+template<typename TComponent>
+template<typename TView, typename TFunction>
+inline void SharedComponentTable<TComponent>::ForEachGroup(TView view, TFunction function)
+{
+	// Count the entities referencing each value. Entities whose shared component was added without a value reference none,
+	// and are left out of every group.
+	m_groupOffsets.assign(m_values.size() + 1, 0);
+	view.Each([this](Entity, const SharedComponent<TComponent>& sharedComponent, const auto&...)
+	{
+		if (sharedComponent.Index < m_values.size())
+		{
+			++m_groupOffsets[sharedComponent.Index + 1];
+		}
+	});
+
+	// Turn the counts into the start of every group.
+	for (size_t index = 1; index < m_groupOffsets.size(); ++index)
+	{
+		m_groupOffsets[index] += m_groupOffsets[index - 1];
+	}
+
+	// Place every entity in its group, keeping the storage order within a group.
+	m_groupedEntities.resize(m_groupOffsets.back());
+	view.Each([this](Entity entity, const SharedComponent<TComponent>& sharedComponent, const auto&...)
+	{
+		if (sharedComponent.Index < m_values.size())
+		{
+			m_groupedEntities[m_groupOffsets[sharedComponent.Index]++] = entity;
+		}
+	});
+
+	// Placing advanced every start to the start of the next group, so each group now ends at its own offset.
+	for (SharedIndex index = 0; index < m_values.size(); ++index)
+	{
+		const size_t groupBegin = index == 0 ? 0 : m_groupOffsets[index - 1];
+		const size_t groupEnd = m_groupOffsets[index];
+		if (groupEnd > groupBegin)
+		{
+			function(m_values[index], m_groupedEntities.data() + groupBegin, groupEnd - groupBegin);
+		}
+	}
+}
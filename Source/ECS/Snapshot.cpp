@@ -0,0 +1,39 @@
+#include "PCH.h"
+#include "Snapshot.h"
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	m_snapshot.insert(m_snapshot.end(), bytes, bytes + size);
+}
+
+bool SnapshotReader::ReadBytes(void* data, size_t size)
+{
+	// Reading past the end means the snapshot is truncated or does not match the registry layout.
+	if (size > m_size - m_offset)
+	{
+		return false;
+	}
+
+	if (size == 0)
+	{
+		return true;
+	}
+
+	std::memcpy(data, m_data + m_offset, size);
+	m_offset += size;
+	return true;
+}
+
+bool SnapshotReader::ReadCount(size_t elementSize, size_t& count)
+{
+	// Read the length prefix of an array, and reject lengths the rest of the blob cannot hold before anything is allocated.
+	uint64_t length = 0;
+	if (!Read(length) || (elementSize > 0 && length > (m_size - m_offset) / elementSize))
+	{
+		return false;
+	}
+
+	count = static_cast<size_t>(length);
+	return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "PCH.h"
+
+constexpr uint32_t SNAPSHOT_MAGIC = 0x53534345;	// Marks the start of a registry snapshot, "ECSS" in little endian.
+constexpr uint32_t SNAPSHOT_VERSION = 4;		// Bumped whenever the snapshot layout changes.
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// Appends raw values and arrays to a binary snapshot blob.
+class SnapshotWriter final
+{
+public:
+	explicit SnapshotWriter(std::vector<unsigned char>& snapshot) : m_snapshot(snapshot) {}
+
+	void WriteBytes(const void* data, size_t size);
+	template<typename TValue> void Write(const TValue& value);
+	template<typename TValue, typename TAllocator> void WriteVector(const std::vector<TValue, TAllocator>& values);
+
+private:
+	std::vector<unsigned char>& m_snapshot;	// The blob being appended to.
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// Reads back, in order, the values and arrays written by a snapshot writer. Every read is checked against the end of the blob,
+// and fails without reading anything when the blob is too short.
+class SnapshotReader final
+{
+public:
+	SnapshotReader(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+
+	bool ReadBytes(void* data, size_t size);
+	bool ReadCount(size_t elementSize, size_t& count);
+	template<typename TValue> bool Read(TValue& value);
+	template<typename TValue, typename TAllocator> bool ReadVector(std::vector<TValue, TAllocator>& values);
+
+	bool IsAtEnd() const { return m_offset == m_size; }
+
+private:
+	const unsigned char* m_data = nullptr;	// The start of the blob.
+	size_t m_size = 0;						// The size in bytes of the blob.
+	size_t m_offset = 0;					// The offset of the next byte to read.
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+template<typename TValue>
+inline void SnapshotWriter::Write(const TValue& value)
+{
+	static_assert(std::is_trivially_copyable<TValue>::value, "Only trivially copyable values can be written to a snapshot.");
+	WriteBytes(&value, sizeof(TValue));
+}
+
+template<typename TValue, typename TAllocator>
+inline void SnapshotWriter::WriteVector(const std::vector<TValue, TAllocator>& values)
+{
+	static_assert(std::is_trivially_copyable<TValue>::value, "Only trivially copyable values can be written to a snapshot.");
+
+	// Prefix the array with its length, then block copy the elements.
+	Write<uint64_t>(values.size());
+	WriteBytes(values.data(), values.size() * sizeof(TValue));
+}
+
+template<typename TValue>
+inline bool SnapshotReader::Read(TValue& value)
+{
+	static_assert(std::is_trivially_copyable<TValue>::value, "Only trivially copyable values can be read from a snapshot.");
+	return ReadBytes(&value, sizeof(TValue));
+}
+
+template<typename TValue, typename TAllocator>
+inline bool SnapshotReader::ReadVector(std::vector<TValue, TAllocator>& values)
+{
+	static_assert(std::is_trivially_copyable<TValue>::value, "Only trivially copyable values can be read from a snapshot.");
+
+	// Size the array from its length prefix, once the blob is known to hold that many elements, then block copy the elements.
+	size_t count = 0;
+	if (!ReadCount(sizeof(TValue), count))
+	{
+		return false;
+	}
+
+	values.resize(count);
+	return ReadBytes(values.data(), count * sizeof(TValue));
+}
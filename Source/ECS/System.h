@@ -1,6 +1,7 @@
 #pragma once
 #include "PCH.h"
 #include "ComponentIdGenerator.h"
+#include "ComponentKey.h"
 #include "Types.h"
 #include "Macros.h"
 
@@ -19,24 +20,180 @@ public:
 	virtual void Update(float deltaTime) = 0;
 	virtual void Render() = 0;
 
-	void AddEntity(Entity an_entity) { m_entities.insert(an_entity); }
-	void RemoveEntity(Entity an_entity) { m_entities.erase(an_entity); }
+	void AddEntity(Entity entity);
+	void AddEntities(const Entity* entities, size_t count);
+	void RemoveEntity(Entity entity);
+	void RemoveEntities(const Entity* entities, size_t count);
+	bool HaveEntity(Entity entity) const;
+	void SortEntities();
+	void ClearEntities();
 
+	const std::vector<Entity>& GetEntities() const { return m_entities; }
 	const ComponentKey& GetRequiredComponents() const { return m_requiredComponents; }
+	const ComponentKey& GetReadComponents() const { return m_readComponents; }
+	const ComponentKey& GetWriteComponents() const { return m_writeComponents; }
+
+	// The registry ticks the last update and render ran at, to filter views on components added or changed since then.
+	ChangeTick GetLastUpdateTick() const { return m_lastUpdateTick; }
+	ChangeTick GetLastRenderTick() const { return m_lastRenderTick; }
+	void SetLastUpdateTick(ChangeTick tick) { m_lastUpdateTick = tick; }
+	void SetLastRenderTick(ChangeTick tick) { m_lastRenderTick = tick; }
+
+	// Bumped whenever entities join or leave the system, to rebuild data derived from the member list.
+	size_t GetMembershipVersion() const { return m_membershipVersion; }
+
+	// A system that declared all of its component access may update concurrently with systems it does not conflict with.
+	bool CanRunInParallel() const { return !m_hasUndeclaredAccess && (m_readComponents | m_writeComponents).Any(); }
 
 protected:
 	template<typename TComponent> void RequireComponent();
+	template<typename TComponent> void RequireRead();
+	template<typename TComponent> void RequireWrite();
 
 protected:
-	std::set<Entity> m_entities;		// The set of entities processed by this system.
+	std::vector<Entity> m_entities;		// The dense list of entities processed by this system.
+	std::vector<size_t> m_entityIndices;	// Maps an entity index to its position in the dense entity list, or INVALID_INDEX if not a member.
 	ComponentKey m_requiredComponents;	// The set of all required components to process an entity.
+	ComponentKey m_readComponents;		// The set of components the system only reads.
+	ComponentKey m_writeComponents;		// The set of components the system reads and writes.
+	bool m_hasUndeclaredAccess = false;	// Set when a component was required without declaring how it is accessed.
+	ChangeTick m_lastUpdateTick = 0;	// The registry tick the last update ran at, zero before the first update.
+	ChangeTick m_lastRenderTick = 0;	// The registry tick the last render ran at, zero before the first render.
+	size_t m_membershipVersion = 0;		// The number of membership changes so far.
 	Registry& m_registry;
 };
 
+inline void ISystem::AddEntity(Entity entity)
+{
+	// Ignore entities that are already members.
+	if (HaveEntity(entity))
+	{
+		return;
+	}
+
+	// Make room for the entity index if necessary.
+	const size_t entityIndex = GetEntityIndex(entity);
+	if (entityIndex >= m_entityIndices.size())
+	{
+		m_entityIndices.resize(entityIndex * 2 + 1, INVALID_INDEX);
+	}
+
+	// Append the entity to the dense list, and record where it went.
+	m_entityIndices[entityIndex] = m_entities.size();
+	m_entities.push_back(entity);
+	++m_membershipVersion;
+}
+
+inline void ISystem::AddEntities(const Entity* entities, size_t count)
+{
+	// Make room for the dense list and the entity indices once. The entities must not be members yet.
+	m_entities.reserve(m_entities.size() + count);
+	for (size_t index = 0; index < count; ++index)
+	{
+		const size_t entityIndex = GetEntityIndex(entities[index]);
+		if (entityIndex >= m_entityIndices.size())
+		{
+			m_entityIndices.resize(entityIndex * 2 + 1, INVALID_INDEX);
+		}
+
+		// Append the entity to the dense list, and record where it went.
+		assert(!HaveEntity(entities[index]));
+		m_entityIndices[entityIndex] = m_entities.size();
+		m_entities.push_back(entities[index]);
+	}
+
+	++m_membershipVersion;
+}
+
+inline void ISystem::RemoveEntity(Entity entity)
+{
+	// Ignore entities that are not members.
+	if (!HaveEntity(entity))
+	{
+		return;
+	}
+
+	// Move the last entity into the removed entity's slot, and shrink the dense list.
+	const size_t index = m_entityIndices[GetEntityIndex(entity)];
+	const Entity lastEntity = m_entities.back();
+	m_entities[index] = lastEntity;
+	m_entityIndices[GetEntityIndex(lastEntity)] = index;
+	m_entities.pop_back();
+	m_entityIndices[GetEntityIndex(entity)] = INVALID_INDEX;
+	++m_membershipVersion;
+}
+
+inline void ISystem::RemoveEntities(const Entity* entities, size_t count)
+{
+	// Swap and pop every member in turn, ignoring entities that are not members.
+	for (size_t index = 0; index < count; ++index)
+	{
+		const Entity entity = entities[index];
+		if (!HaveEntity(entity))
+		{
+			continue;
+		}
+
+		const size_t entityIndex = m_entityIndices[GetEntityIndex(entity)];
+		const Entity lastEntity = m_entities.back();
+		m_entities[entityIndex] = lastEntity;
+		m_entityIndices[GetEntityIndex(lastEntity)] = entityIndex;
+		m_entities.pop_back();
+		m_entityIndices[GetEntityIndex(entity)] = INVALID_INDEX;
+	}
+
+	++m_membershipVersion;
+}
+
+inline bool ISystem::HaveEntity(Entity entity) const
+{
+	// The slot may belong to a newer entity reusing the same index, so compare the full handle.
+	const size_t entityIndex = GetEntityIndex(entity);
+	return entityIndex < m_entityIndices.size() && m_entityIndices[entityIndex] != INVALID_INDEX && m_entities[m_entityIndices[entityIndex]] == entity;
+}
+
+inline void ISystem::SortEntities()
+{
+	// Order the members by entity, and rebuild the index map to match.
+	std::sort(m_entities.begin(), m_entities.end());
+	for (size_t index = 0; index < m_entities.size(); ++index)
+	{
+		m_entityIndices[GetEntityIndex(m_entities[index])] = index;
+	}
+}
+
+inline void ISystem::ClearEntities()
+{
+	m_entities.clear();
+	m_entityIndices.clear();
+	++m_membershipVersion;
+}
+
 template<typename TComponent>
 void ISystem::RequireComponent()
 {
 	// Get the component id and set in the component key bit set.
 	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
-	m_requiredComponents.set(componentId);
+	m_requiredComponents.Set(componentId);
+
+	// Without a declared access the system is assumed to touch anything, and always updates alone.
+	m_hasUndeclaredAccess = true;
+}
+
+template<typename TComponent>
+void ISystem::RequireRead()
+{
+	// Get the component id and set it in both the required and read component key bit sets.
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+	m_requiredComponents.Set(componentId);
+	m_readComponents.Set(componentId);
+}
+
+template<typename TComponent>
+void ISystem::RequireWrite()
+{
+	// Get the component id and set it in both the required and write component key bit sets.
+	const ComponentId componentId = ComponentIdGenerator::GetComponentId<TComponent>();
+	m_requiredComponents.Set(componentId);
+	m_writeComponents.Set(componentId);
 }
@@ -1,5 +1,15 @@
 #include "PCH.h"
 #include "TagIdGenerator.h"
 
-TagId TagIdGenerator::m_nextTagId = 0;
+void TagIdGenerator::PublishIds()
+{
+	// Write the id of every tag type registered so far, in hash order.
+	GetIdTable().Publish();
+}
 
+TypeIdTable& TagIdGenerator::GetIdTable()
+{
+	// Constructed on first use, tag types register during static initialization in no particular order.
+	static TypeIdTable idTable;
+	return idTable;
+}
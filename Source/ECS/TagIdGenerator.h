@@ -1,19 +1,35 @@
 #pragma once
 #include "Types.h"
+#include "TypeHash.h"
 
+// Hands out tag ids, a stable type hash and a dense id published at engine initialization like component ids.
 class TagIdGenerator final
 {
 public:
+	template<typename TTag> static constexpr TypeHash GetTagHash() { return GetTypeHash<TTag>(); }
 	template<typename TTag> static TagId GetTagId();
+	static const std::vector<TypeHash>& GetTagHashes() { return GetIdTable().GetHashes(); }
+	static void PublishIds();
 
 private:
-	static TagId m_nextTagId;
+	static TypeIdTable& GetIdTable();
+
+private:
+	template<typename TTag> static TagId m_tagId;					// The dense id of each tag type, written when the ids are published.
+	template<typename TTag> static const bool m_isTagRegistered;	// Registers each tag type during static initialization.
 };
 
 template<typename TTag>
-static TagId TagIdGenerator::GetTagId()
+TagId TagIdGenerator::m_tagId = INVALID_INDEX;
+
+template<typename TTag>
+const bool TagIdGenerator::m_isTagRegistered = TagIdGenerator::GetIdTable().Register(std::integral_constant<TypeHash, GetTypeHash<TTag>()>::value, &TagIdGenerator::m_tagId<TTag>);
+
+template<typename TTag>
+inline TagId TagIdGenerator::GetTagId()
 {
-	const static TagId tagIg = m_nextTagId++;
-	return tagIg;
+	// Naming the registration makes every tag type used anywhere register before main.
+	static_cast<void>(&m_isTagRegistered<TTag>);
+	assert(m_tagId<TTag> != INVALID_INDEX && "Tag ids are published at engine initialization.");
+	return m_tagId<TTag>;
 }
-
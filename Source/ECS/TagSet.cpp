@@ -0,0 +1,58 @@
+#include "PCH.h"
+#include "TagSet.h"
+
+void TagSet::AddEntity(Entity entity)
+{
+	// Ignore entities that already have the tag.
+	if (HaveEntity(entity))
+	{
+		return;
+	}
+
+	// Make room for the entity bit and index if necessary.
+	const size_t entityIndex = GetEntityIndex(entity);
+	if (entityIndex / 64 >= m_entityBits.size())
+	{
+		m_entityBits.resize(entityIndex / 64 * 2 + 1, 0);
+	}
+
+	if (entityIndex >= m_entityIndices.size())
+	{
+		m_entityIndices.resize(entityIndex * 2 + 1, INVALID_INDEX);
+	}
+
+	// Set the entity bit, append the entity to the packed list, and record where it went.
+	m_entityBits[entityIndex / 64] |= uint64_t(1) << (entityIndex % 64);
+	m_entityIndices[entityIndex] = m_packedEntities.size();
+	m_packedEntities.push_back(entity);
+}
+
+void TagSet::RemoveEntity(Entity entity)
+{
+	// Ignore entities that do not have the tag.
+	if (!HaveEntity(entity))
+	{
+		return;
+	}
+
+	// Move the last entity into the removed entity's slot, and shrink the packed list.
+	const size_t entityIndex = GetEntityIndex(entity);
+	const size_t index = m_entityIndices[entityIndex];
+	const Entity lastEntity = m_packedEntities.back();
+	m_packedEntities[index] = lastEntity;
+	m_entityIndices[GetEntityIndex(lastEntity)] = index;
+	m_packedEntities.pop_back();
+
+	// Clear the entity bit and index.
+	m_entityIndices[entityIndex] = INVALID_INDEX;
+	m_entityBits[entityIndex / 64] &= ~(uint64_t(1) << (entityIndex % 64));
+}
+
+void TagSet::RemoveEntities(const Entity* entities, size_t count)
+{
+	// Untagged entities only cost a bit test.
+	for (size_t index = 0; index < count; ++index)
+	{
+		RemoveEntity(entities[index]);
+	}
+}
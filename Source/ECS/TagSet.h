@@ -0,0 +1,29 @@
+#pragma once
+#include "PCH.h"
+#include "Types.h"
+
+// The set of entities carrying one tag. A bit per entity index answers membership,
+// and a packed entity list, kept compact with swap-and-pop, allows contiguous iteration.
+class TagSet final
+{
+public:
+	void AddEntity(Entity entity);
+	bool HaveEntity(Entity entity) const;
+	void RemoveEntity(Entity entity);
+	void RemoveEntities(const Entity* entities, size_t count);
+
+	const std::vector<Entity>& GetEntities() const { return m_packedEntities; }
+
+private:
+	std::vector<uint64_t> m_entityBits;		// One bit per entity index, set while the entity has the tag.
+	std::vector<size_t> m_entityIndices;	// Maps an entity index to its position in the packed entity list.
+	std::vector<Entity> m_packedEntities;	// The contiguous list of tagged entities.
+};
+
+inline bool TagSet::HaveEntity(Entity entity) const
+{
+	// Test the entity's bit, entities past the end of the bit array were never tagged.
+	const size_t entityIndex = GetEntityIndex(entity);
+	const size_t word = entityIndex / 64;
+	return word < m_entityBits.size() && (m_entityBits[word] & (uint64_t(1) << (entityIndex % 64))) != 0;
+}
@@ -1,9 +1,19 @@
 #pragma once
 
-using Entity = size_t;
+using Entity = uint64_t;	// The low 32 bits hold the entity index, the high 32 bits hold the generation of that index.
 using ComponentId = size_t;
 using TagId = size_t;
+using ChangeTick = uint32_t;	// The registry tick at which a component was last added or written.
 
-constexpr size_t COMPONENT_COUNT = 16;
-using ComponentKey = std::bitset<COMPONENT_COUNT>;
+constexpr Entity INVALID_ENTITY = UINT64_MAX;
+constexpr uint32_t INVALID_ENTITY_INDEX = UINT32_MAX;
 
+inline constexpr uint32_t GetEntityIndex(Entity entity) { return static_cast<uint32_t>(entity); }
+inline constexpr uint32_t GetEntityGeneration(Entity entity) { return static_cast<uint32_t>(entity >> 32); }
+inline constexpr Entity MakeEntity(uint32_t index, uint32_t generation) { return (static_cast<Entity>(generation) << 32) | index; }
+
+// Rounds a value up to the next multiple of a power of two alignment.
+inline constexpr size_t AlignUp(size_t value, size_t alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+
+constexpr size_t SPARSE_PAGE_SIZE = 4096;		// The number of entity slots in a single sparse array page. Must be a power of two.
+constexpr size_t INVALID_INDEX = SIZE_MAX;		// Marks an entity slot in a sparse array as not pointing into the dense array.
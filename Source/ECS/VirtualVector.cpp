@@ -0,0 +1,36 @@
+#include "PCH.h"
+#include "VirtualVector.h"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+void* ReserveVirtualMemory(size_t size)
+{
+#if defined(_WIN32)
+	return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	// An inaccessible mapping takes address space only, commits open up pages of it.
+	void* address = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return address == MAP_FAILED ? nullptr : address;
+#endif
+}
+
+bool CommitVirtualMemory(void* address, size_t size)
+{
+#if defined(_WIN32)
+	return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	return mprotect(address, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void ReleaseVirtualMemory(void* address, size_t size)
+{
+#if defined(_WIN32)
+	(void)size;
+	VirtualFree(address, 0, MEM_RELEASE);
+#else
+	munmap(address, size);
+#endif
+}
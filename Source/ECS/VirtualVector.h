@@ -0,0 +1,159 @@
+#pragma once
+#include "PCH.h"
+#include "Types.h"
+#include "Macros.h"
+
+constexpr size_t VIRTUAL_VECTOR_DEFAULT_MAX_SIZE = size_t(1) << 24;	// The default number of elements a virtual vector reserves room for.
+constexpr size_t VIRTUAL_MEMORY_COMMIT_GRANULARITY = 64 * 1024;		// Commits are rounded up to this many bytes, a multiple of the page size.
+
+// Reserves an address range without backing it with memory. Returns null if the range could not be reserved.
+void* ReserveVirtualMemory(size_t size);
+
+// Backs the given part of a reserved range with readable and writable memory, zero filled on first touch.
+bool CommitVirtualMemory(void* address, size_t size);
+
+// Releases a whole range returned by ReserveVirtualMemory, committed or not.
+void ReleaseVirtualMemory(void* address, size_t size);
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// A vector that reserves the address range of its maximum size up front, and commits memory as it grows.
+// Growing never moves the elements, so references stay valid and nothing is copied, but the size cannot exceed the reservation.
+// It mirrors the part of the std::vector interface component sets use, so it can stand in for one.
+template<typename TValue>
+class VirtualVector final
+{
+	NO_COPY(VirtualVector);
+	NO_MOVE(VirtualVector);
+
+public:
+	explicit VirtualVector(size_t maxSize = VIRTUAL_VECTOR_DEFAULT_MAX_SIZE);
+	~VirtualVector();
+
+	bool empty() const { return m_size == 0; }
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_committedBytes / sizeof(TValue); }
+	size_t max_size() const { return m_reservedBytes / sizeof(TValue); }
+
+	TValue* data() { return m_data; }
+	const TValue* data() const { return m_data; }
+	TValue& operator[](size_t index) { return m_data[index]; }
+	const TValue& operator[](size_t index) const { return m_data[index]; }
+	TValue& back() { return m_data[m_size - 1]; }
+	const TValue& back() const { return m_data[m_size - 1]; }
+
+	void push_back(const TValue& value);
+	void pop_back();
+	void resize(size_t size);
+	void resize(size_t size, const TValue& value);
+	void clear();
+
+	size_t GetReservedBytes() const { return m_reservedBytes; }
+	size_t GetCommittedBytes() const { return m_committedBytes; }
+
+private:
+	void Commit(size_t size);
+
+private:
+	TValue* m_data = nullptr;		// The start of the reserved range.
+	size_t m_size = 0;				// The number of constructed elements.
+	size_t m_reservedBytes = 0;		// The size of the reserved range.
+	size_t m_committedBytes = 0;	// The size of the committed prefix of the reserved range.
+};
+
+template<typename TValue>
+inline VirtualVector<TValue>::VirtualVector(size_t maxSize)
+{
+	// Pages are far more aligned than any element type needs.
+	static_assert(alignof(TValue) <= VIRTUAL_MEMORY_COMMIT_GRANULARITY, "Virtual vector elements cannot be aligned past a commit.");
+
+	// Reserve whole commits, so the last commit never runs past the range.
+	m_reservedBytes = AlignUp(std::max<size_t>(maxSize, 1) * sizeof(TValue), VIRTUAL_MEMORY_COMMIT_GRANULARITY);
+	m_data = static_cast<TValue*>(ReserveVirtualMemory(m_reservedBytes));
+	assert(m_data != nullptr);
+}
+
+template<typename TValue>
+inline VirtualVector<TValue>::~VirtualVector()
+{
+	clear();
+	ReleaseVirtualMemory(m_data, m_reservedBytes);
+}
+
+template<typename TValue>
+inline void VirtualVector<TValue>::push_back(const TValue& value)
+{
+	// Committing never moves the elements, so the value may even be one of them.
+	Commit(m_size + 1);
+	new (m_data + m_size) TValue(value);
+	++m_size;
+}
+
+template<typename TValue>
+inline void VirtualVector<TValue>::pop_back()
+{
+	assert(m_size > 0);
+	--m_size;
+	m_data[m_size].~TValue();
+}
+
+template<typename TValue>
+inline void VirtualVector<TValue>::resize(size_t size)
+{
+	// Default construct the new elements, or destroy the elements past the new size.
+	Commit(size);
+	for (; m_size < size; ++m_size)
+	{
+		new (m_data + m_size) TValue();
+	}
+
+	while (m_size > size)
+	{
+		pop_back();
+	}
+}
+
+template<typename TValue>
+inline void VirtualVector<TValue>::resize(size_t size, const TValue& value)
+{
+	// Copy construct the new elements from the value, or destroy the elements past the new size.
+	Commit(size);
+	for (; m_size < size; ++m_size)
+	{
+		new (m_data + m_size) TValue(value);
+	}
+
+	while (m_size > size)
+	{
+		pop_back();
+	}
+}
+
+template<typename TValue>
+inline void VirtualVector<TValue>::clear()
+{
+	// The memory stays committed, to be reused as the vector grows again.
+	while (m_size > 0)
+	{
+		pop_back();
+	}
+}
+
+template<typename TValue>
+inline void VirtualVector<TValue>::Commit(size_t size)
+{
+	// Nothing to do while the committed prefix holds the elements.
+	const size_t requiredBytes = size * sizeof(TValue);
+	if (requiredBytes <= m_committedBytes)
+	{
+		return;
+	}
+
+	// At least double the committed prefix, to keep the number of commits logarithmic in the size.
+	assert(requiredBytes <= m_reservedBytes && "Virtual vector grew past its reservation.");
+	const size_t committedBytes = std::min(AlignUp(std::max(requiredBytes, m_committedBytes * 2), VIRTUAL_MEMORY_COMMIT_GRANULARITY), m_reservedBytes);
+	const bool isCommitted = CommitVirtualMemory(reinterpret_cast<unsigned char*>(m_data) + m_committedBytes, committedBytes - m_committedBytes);
+	assert(isCommitted);
+	(void)isCommitted;
+	m_committedBytes = committedBytes;
+}
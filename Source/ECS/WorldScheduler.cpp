@@ -0,0 +1,41 @@
+#include "PCH.h"
+#include "WorldScheduler.h"
+#include "Registry.h"
+
+void WorldScheduler::AddWorld(Registry& world)
+{
+	// A world stepped twice per update would race with itself.
+	assert(std::find(m_worlds.begin(), m_worlds.end(), &world) == m_worlds.end());
+	m_worlds.push_back(&world);
+}
+
+void WorldScheduler::RemoveWorld(Registry& world)
+{
+	m_worlds.erase(std::remove(m_worlds.begin(), m_worlds.end(), &world), m_worlds.end());
+}
+
+void WorldScheduler::RunWorldsInitialize()
+{
+	// System initialization may touch shared resource managers, so worlds initialize one after the other.
+	for (Registry* world : m_worlds)
+	{
+		world->RunSystemsInitialize();
+	}
+}
+
+void WorldScheduler::RunWorldsUpdate(float deltaTime)
+{
+	// Every world updates in its own job. The jobs of its system phases are queued on whichever thread runs the world,
+	// and are stolen by idle threads like any other job.
+	std::vector<Job> worldJobs;
+	worldJobs.reserve(m_worlds.size());
+	for (Registry* world : m_worlds)
+	{
+		worldJobs.push_back([world, deltaTime]()
+		{
+			world->RunSystemsUpdate(deltaTime);
+		});
+	}
+
+	m_jobSystem.Execute(worldJobs);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "PCH.h"
+#include "JobSystem/JobSystem.h"
+#include "Macros.h"
+
+class Registry;
+
+// Steps a set of independent worlds concurrently, one job per world. A world runs its own system phases within its job,
+// and the threads waiting on a phase help with the other worlds, so throughput scales with the number of worlds and cores.
+// Worlds only share the job system and the immutable mesh, texture, and shader data, rendering stays with the engine world.
+class WorldScheduler final
+{
+	NO_COPY(WorldScheduler);
+	NO_MOVE(WorldScheduler);
+
+public:
+	WorldScheduler() = default;
+	~WorldScheduler() = default;
+
+	void AddWorld(Registry& world);
+	void RemoveWorld(Registry& world);
+
+	void RunWorldsInitialize();
+	void RunWorldsUpdate(float deltaTime);
+
+	const std::vector<Registry*>& GetWorlds() const { return m_worlds; }
+
+private:
+	std::vector<Registry*> m_worlds;	// The worlds stepped together, owned by the caller.
+	JobSystem& m_jobSystem = JobSystem::GetInstanceWrite();
+};
@@ -1,5 +1,15 @@
 #include "PCH.h"
 #include "EventIdGenerator.h"
 
-EventId EventIdGenerator::m_nextEventId = 0;
+void EventIdGenerator::PublishIds()
+{
+	// Write the id of every event type registered so far, in hash order.
+	GetIdTable().Publish();
+}
 
+TypeIdTable& EventIdGenerator::GetIdTable()
+{
+	// Constructed on first use, event types register during static initialization in no particular order.
+	static TypeIdTable idTable;
+	return idTable;
+}
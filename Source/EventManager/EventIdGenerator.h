@@ -1,20 +1,38 @@
 #pragma once
+#include "TypeHash.h"
 
 using EventId = size_t;
 
+constexpr EventId INVALID_EVENT_ID = SIZE_MAX;	// Marks an event type whose id has not been published yet.
+
+// Hands out event ids, a stable type hash and a dense id published at engine initialization like component ids.
 class EventIdGenerator final
 {
 public:
+	template<typename TEvent> static constexpr TypeHash GetEventHash() { return GetTypeHash<TEvent>(); }
 	template<typename TEvent> static EventId GetEventId();
+	static const std::vector<TypeHash>& GetEventHashes() { return GetIdTable().GetHashes(); }
+	static void PublishIds();
+
+private:
+	static TypeIdTable& GetIdTable();
 
 private:
-	static EventId m_nextEventId;
+	template<typename TEvent> static EventId m_eventId;					// The dense id of each event type, written when the ids are published.
+	template<typename TEvent> static const bool m_isEventRegistered;	// Registers each event type during static initialization.
 };
 
 template<typename TEvent>
-EventId EventIdGenerator::GetEventId()
+EventId EventIdGenerator::m_eventId = INVALID_EVENT_ID;
+
+template<typename TEvent>
+const bool EventIdGenerator::m_isEventRegistered = EventIdGenerator::GetIdTable().Register(std::integral_constant<TypeHash, GetTypeHash<TEvent>()>::value, &EventIdGenerator::m_eventId<TEvent>);
+
+template<typename TEvent>
+inline EventId EventIdGenerator::GetEventId()
 {
-	static EventId eventId = m_nextEventId++;
-	return eventId;
+	// Naming the registration makes every event type used anywhere register before main.
+	static_cast<void>(&m_isEventRegistered<TEvent>);
+	assert(m_eventId<TEvent> != INVALID_EVENT_ID && "Event ids are published at engine initialization.");
+	return m_eventId<TEvent>;
 }
-
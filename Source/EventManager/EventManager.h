@@ -18,7 +18,7 @@ class IEventVector
 public:
 	IEventVector() = default;
 	virtual ~IEventVector() = default;
-	virtual void* GetEvent(size_t index) = 0;
+	virtual const void* GetEvents() const = 0;
 	virtual size_t GetElementCount() const = 0;
 	virtual void Clear() = 0;
 };
@@ -31,7 +31,7 @@ public:
 	~EventVector() = default;
 
 	void AddEvent(const TEvent& event);
-	void* GetEvent(size_t index) override;
+	const void* GetEvents() const override;
 	size_t GetElementCount() const override;
 	void Clear() override;
 
@@ -46,10 +46,9 @@ void EventVector<TEvent>::AddEvent(const TEvent& event)
 }
 
 template<typename TEvent>
-void* EventVector<TEvent>::GetEvent(size_t index)
+const void* EventVector<TEvent>::GetEvents() const
 {
-	assert(index < m_events.size());
-	return static_cast<void*>(&m_events[index]);
+	return static_cast<const void*>(m_events.data());
 }
 
 template<typename TEvent>
@@ -66,53 +65,57 @@ void EventVector<TEvent>::Clear()
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
-class IEventHandler
-{
-public:
-	NO_COPY(IEventHandler);
-	NO_MOVE(IEventHandler);
-
-	IEventHandler() = default;
-	virtual ~IEventHandler() = default;
-	virtual void HandleEvent(const void* event) const = 0;
-};
+// Large enough for a member function pointer of a class with single or multiple inheritance on every supported compiler.
+constexpr size_t EVENT_CALLBACK_SIZE = 2 * sizeof(void*);
 
-template<typename TEvent, typename TOwner>
-class EventHandler final : public IEventHandler
+// A subscribed callback, stored by value in the handler table of its event type.
+struct EventHandler
 {
-public:
-	EventHandler(TOwner* owner, void(TOwner::* callback)(const TEvent& event));
-	~EventHandler() = default;
-	void HandleEvent(const void* event) const override;
-
-private:
-	TOwner* m_owner;
-	void(TOwner::* m_callback)(const TEvent& event);
+	// Restore the types of the owner and the callback, and run the callback on one event or on a contiguous array of events.
+	using Thunk = void(*)(const EventHandler& handler, const void* event);
+	using ArrayThunk = void(*)(const EventHandler& handler, const void* events, size_t eventCount);
+
+	void* Context = nullptr;
+	Thunk Invoke = nullptr;
+	ArrayThunk InvokeAll = nullptr;
+	std::aligned_storage_t<EVENT_CALLBACK_SIZE, alignof(void*)> Callback;	// The member function pointer, type erased.
 };
 
 template<typename TEvent, typename TOwner>
-EventHandler<TEvent, TOwner>::EventHandler(TOwner* owner, void(TOwner::* callback)(const TEvent& event))
-	: IEventHandler::IEventHandler()
-	, m_owner(owner)
-	, m_callback(callback)
+void InvokeEventHandler(const EventHandler& handler, const void* event)
 {
+	// Restore the member function pointer from its type erased storage.
+	void(TOwner::* callback)(const TEvent& event);
+	std::memcpy(&callback, &handler.Callback, sizeof(callback));
+
+	// Invoke the event callback on the event, cast to its true type.
+	(static_cast<TOwner*>(handler.Context)->*callback)(*static_cast<const TEvent*>(event));
 }
 
 template<typename TEvent, typename TOwner>
-void EventHandler<TEvent, TOwner>::HandleEvent(const void* event) const
+void InvokeEventHandlerOnAll(const EventHandler& handler, const void* events, size_t eventCount)
 {
-	// Cast the incoming event to is true type.
-	const TEvent* specificEvent = static_cast<const TEvent*>(event);
+	// Restore the member function pointer from its type erased storage.
+	void(TOwner::* callback)(const TEvent& event);
+	std::memcpy(&callback, &handler.Callback, sizeof(callback));
+
+	// Cast the owner and the incoming events to their true types.
+	TOwner* owner = static_cast<TOwner*>(handler.Context);
+	const TEvent* specificEvents = static_cast<const TEvent*>(events);
 
-	// Invoke the event callback on the event.
-	(m_owner->*m_callback)(*specificEvent);
+	// Invoke the event callback on every event.
+	for (size_t index = 0; index < eventCount; ++index)
+	{
+		(owner->*callback)(specificEvents[index]);
+	}
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------
 
+// Every world owns an event manager, the shared instance belongs to the world the engine runs.
 class EventManager final
 {
-	SINGLETON(EventManager);
+	SHARED_INSTANCE(EventManager);
 
 public:
 	template<typename TEvent, typename TOwner> void SubscribeToEvent(TOwner* owner, void(TOwner::*callback)(const TEvent& event));
@@ -126,24 +129,35 @@ private:
 	template<typename TEvent> void HandleImmediateEvent(const TEvent& event);
 	
 private:
-	std::unordered_map<EventId, std::vector<std::unique_ptr<IEventHandler>>> m_eventHandlerMap;
-	std::unordered_map<EventId, std::unique_ptr<IEventVector>> m_pendingEventMap;
+	std::vector<std::vector<EventHandler>> m_eventHandlers;	// The handlers of every event type, indexed by event id.
+	std::vector<std::unique_ptr<IEventVector>> m_pendingEvents;	// The deferred events of every event type, indexed by event id.
+	std::vector<EventId> m_pendingEventIds;	// The event types with deferred events, in the order they were first emitted.
+	std::mutex m_pendingEventMutex; // Guards the pending events against systems emitting deferred events concurrently.
 };
 
 template<typename TEvent, typename TOwner>
 inline void EventManager::SubscribeToEvent(TOwner* owner, void(TOwner::* callback)(const TEvent& event))
 {
+	static_assert(sizeof(callback) <= EVENT_CALLBACK_SIZE, "The event callback does not fit in an event handler.");
+
 	// Get the corresponding event Id.
-	static const EventId eventId = EventIdGenerator::GetEventId<TEvent>();
+	const EventId eventId = EventIdGenerator::GetEventId<TEvent>();
 
-	// Allocate the corresponding event handler.
-	EventHandler<TEvent, TOwner>* eventHandler = new EventHandler<TEvent, TOwner>(owner, callback);
+	// Make room for the handlers of this event.
+	if (eventId >= m_eventHandlers.size())
+	{
+		m_eventHandlers.resize(eventId + 1);
+	}
 
-	// Cast the event handler to its generic version, and wrap it in a smart pointer.
-	std::unique_ptr<IEventHandler> genericEventHandler(static_cast<IEventHandler*>(eventHandler));
+	// Pair the owner with the thunks that know its type, and store the callback next to them.
+	EventHandler eventHandler;
+	eventHandler.Context = static_cast<void*>(owner);
+	eventHandler.Invoke = &InvokeEventHandler<TEvent, TOwner>;
+	eventHandler.InvokeAll = &InvokeEventHandlerOnAll<TEvent, TOwner>;
+	std::memcpy(&eventHandler.Callback, &callback, sizeof(callback));
 
-	// Move the event handler into the current set of event handlers for this event.
-	m_eventHandlerMap[eventId].push_back(std::move(genericEventHandler));
+	// Add the event handler to the current set of event handlers for this event.
+	m_eventHandlers[eventId].push_back(eventHandler);
 }
 
 template<typename TEvent>
@@ -167,16 +181,31 @@ template<typename TEvent>
 void EventManager::HandleDeferredEvent(const TEvent& event)
 {
 	// Get the corresponding event Id.
-	static const EventId eventId = EventIdGenerator::GetEventId<TEvent>();
+	const EventId eventId = EventIdGenerator::GetEventId<TEvent>();
+
+	// Systems in the same update phase may emit concurrently.
+	std::lock_guard<std::mutex> lock(m_pendingEventMutex);
+
+	// Make room for the events of this type.
+	if (eventId >= m_pendingEvents.size())
+	{
+		m_pendingEvents.resize(eventId + 1);
+	}
 
 	// If we don't have a corresponding event vector, create one.
-	if (m_pendingEventMap.find(eventId) == m_pendingEventMap.end())
+	if (!m_pendingEvents[eventId])
 	{
-		m_pendingEventMap[eventId].reset(static_cast<IEventVector*>(new EventVector<TEvent>()));
+		m_pendingEvents[eventId].reset(static_cast<IEventVector*>(new EventVector<TEvent>()));
 	}
 
 	// Get the event vector.
-	EventVector<TEvent>* eventVector = static_cast<EventVector<TEvent>*>(m_pendingEventMap[eventId].get());
+	EventVector<TEvent>* eventVector = static_cast<EventVector<TEvent>*>(m_pendingEvents[eventId].get());
+
+	// The first event of its type this update schedules the type for dispatch.
+	if (eventVector->GetElementCount() == 0)
+	{
+		m_pendingEventIds.push_back(eventId);
+	}
 
 	// Add the event.
 	eventVector->AddEvent(std::move(event));
@@ -186,47 +215,66 @@ template<typename TEvent>
 void EventManager::HandleImmediateEvent(const TEvent& event)
 {
 	// Get the corresponding event Id.
-	static const EventId eventId = EventIdGenerator::GetEventId<TEvent>();
+	const EventId eventId = EventIdGenerator::GetEventId<TEvent>();
 
 	// If we have a set of event handlers for this event...
-	if (m_eventHandlerMap.find(eventId) != m_eventHandlerMap.end())
+	if (eventId < m_eventHandlers.size())
 	{
-		// Run the event through all the corresponding event handlers.
-		for (std::unique_ptr<IEventHandler>& eventHandler : m_eventHandlerMap[eventId])
+		// Run the event through all the corresponding event handlers, handlers may subscribe while we go.
+		const size_t handlerCount = m_eventHandlers[eventId].size();
+		for (size_t handlerIndex = 0; handlerIndex < handlerCount; ++handlerIndex)
 		{
-			eventHandler->HandleEvent(&event);
+			const EventHandler& eventHandler = m_eventHandlers[eventId][handlerIndex];
+			eventHandler.Invoke(eventHandler, &event);
 		}
 	}
 }
 
 inline void EventManager::Update()
 {
-	// For every pending event pair...
-	for (std::pair<const EventId, std::unique_ptr<IEventVector>>& pendingEventPair : m_pendingEventMap)
+	// Detach every pending event up front. Deferred events emitted by the handlers start new sets, dispatched next update.
+	std::vector<EventId> pendingEventIds;
+	std::vector<std::unique_ptr<IEventVector>> eventVectors;
 	{
-		// Get the event Id and the set of pending events.
-		const EventId eventId = pendingEventPair.first;
-		std::unique_ptr<IEventVector>& eventVector = pendingEventPair.second;
+		// Emitters may run concurrently with the start of the update.
+		std::lock_guard<std::mutex> lock(m_pendingEventMutex);
+		pendingEventIds.swap(m_pendingEventIds);
+		eventVectors.reserve(pendingEventIds.size());
+		for (const EventId eventId : pendingEventIds)
+		{
+			eventVectors.push_back(std::move(m_pendingEvents[eventId]));
+		}
+	}
 
-		// For every event handler for this event type...
-		for (const std::unique_ptr<IEventHandler>& eventHandler : m_eventHandlerMap[eventId])
+	// For every event type with pending events...
+	for (size_t pendingIndex = 0; pendingIndex < pendingEventIds.size(); ++pendingIndex)
+	{
+		const EventId eventId = pendingEventIds[pendingIndex];
+		std::unique_ptr<IEventVector>& eventVector = eventVectors[pendingIndex];
+
+		// Run all the pending events through every event handler for this event type, handlers may subscribe while we go.
+		const size_t handlerCount = eventId < m_eventHandlers.size() ? m_eventHandlers[eventId].size() : 0;
+		for (size_t handlerIndex = 0; handlerIndex < handlerCount; ++handlerIndex)
 		{
-			// Run each pending event of the current type through the event handler.
-			for (size_t index = 0; index < eventVector->GetElementCount(); ++index)
-			{
-				eventHandler->HandleEvent(eventVector->GetEvent(index));
-			}
+			const EventHandler& eventHandler = m_eventHandlers[eventId][handlerIndex];
+			eventHandler.InvokeAll(eventHandler, eventVector->GetEvents(), eventVector->GetElementCount());
 		}
 
-		// Clear the now processed set of events.
+		// Clear the now processed set of events, and reuse its memory unless the handlers started a new set.
 		eventVector->Clear();
+		std::lock_guard<std::mutex> lock(m_pendingEventMutex);
+		if (eventId < m_pendingEvents.size() && !m_pendingEvents[eventId])
+		{
+			m_pendingEvents[eventId] = std::move(eventVector);
+		}
 	}
 }
 
 inline void EventManager::Shutdown()
 {
-	m_eventHandlerMap.clear();
-	m_pendingEventMap.clear();
+	m_eventHandlers.clear();
+	m_pendingEvents.clear();
+	m_pendingEventIds.clear();
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,198 @@
+#include "PCH.h"
+#include "JobSystem.h"
+
+// The index of the current thread in the pool. The main thread, and any thread outside the pool, is zero.
+static thread_local size_t s_threadIndex = 0;
+
+void JobSystem::Initialize(size_t threadCount)
+{
+	assert(m_workers.empty());
+
+	// By default use every hardware thread. The calling thread counts as one, e.g. a single thread spawns no workers.
+	if (threadCount == 0)
+	{
+		threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	}
+
+	const size_t workerCount = threadCount - 1;
+
+	// Create a queue per thread, the main thread included, before any worker can look for work to steal.
+	for (size_t threadIndex = 0; threadIndex <= workerCount; ++threadIndex)
+	{
+		m_queues.push_back(std::make_unique<WorkQueue>());
+	}
+
+	// Spawn the workers, worker thread indices start at one.
+	m_isRunning = true;
+	for (size_t workerIndex = 0; workerIndex < workerCount; ++workerIndex)
+	{
+		m_workers.emplace_back(&JobSystem::WorkerLoop, this, workerIndex + 1);
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	// Tell the workers to exit once the queues are drained, and wait for them.
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_isRunning = false;
+	}
+	m_condition.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+
+	m_workers.clear();
+	m_queues.clear();
+}
+
+void JobSystem::Execute(std::vector<Job>& jobs)
+{
+	// Without workers, or with a single job, run everything on the calling thread.
+	if (m_workers.empty() || jobs.size() == 1)
+	{
+		for (Job& job : jobs)
+		{
+			job();
+		}
+		return;
+	}
+
+	// Queue the jobs on the calling thread's queue against a counter shared by the batch, and help running them until the
+	// whole batch is done.
+	std::atomic<size_t> pendingJobCount(0);
+	QueueJobs(*m_queues[s_threadIndex], jobs, pendingJobCount);
+	Wait(pendingJobCount);
+}
+
+void JobSystem::Submit(std::vector<Job>& jobs, std::atomic<size_t>& pendingJobCount)
+{
+	// Without workers nothing would ever run the jobs, so run them on the calling thread right away.
+	if (m_workers.empty())
+	{
+		for (Job& job : jobs)
+		{
+			job();
+		}
+		return;
+	}
+
+	// Queue the jobs in the background, where a thread helping with its own batch never picks them up.
+	QueueJobs(m_backgroundQueue, jobs, pendingJobCount);
+}
+
+void JobSystem::Wait(std::atomic<size_t>& pendingJobCount)
+{
+	// Help running jobs until every job counted against the counter is done. Jobs from other batches may be run too, but
+	// background jobs are left to the workers, so waiting on a batch never stalls behind a long background job.
+	const size_t threadIndex = s_threadIndex;
+	while (pendingJobCount.load(std::memory_order_acquire) > 0)
+	{
+		if (!TryRunJob(threadIndex, false))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+size_t JobSystem::GetThreadIndex()
+{
+	return s_threadIndex;
+}
+
+void JobSystem::WorkerLoop(size_t threadIndex)
+{
+	s_threadIndex = threadIndex;
+
+	while (true)
+	{
+		// Keep running jobs for as long as there are any.
+		if (TryRunJob(threadIndex, true))
+		{
+			continue;
+		}
+
+		// Sleep until jobs are queued, or exit once the pool is shutting down and everything ran.
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_condition.wait(lock, [this]() { return m_queuedJobCount.load(std::memory_order_acquire) > 0 || !m_isRunning; });
+
+		if (!m_isRunning && m_queuedJobCount.load(std::memory_order_acquire) == 0)
+		{
+			return;
+		}
+	}
+}
+
+void JobSystem::QueueJobs(WorkQueue& workQueue, std::vector<Job>& jobs, std::atomic<size_t>& pendingJobCount)
+{
+	// Count the jobs in the caller's counter before any thread can finish them.
+	pendingJobCount.fetch_add(jobs.size(), std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(workQueue.Mutex);
+		for (Job& job : jobs)
+		{
+			workQueue.Jobs.push_back({ std::move(job), &pendingJobCount });
+		}
+	}
+
+	// Publish the jobs, taking the sleep mutex so a worker about to sleep cannot miss them.
+	m_queuedJobCount.fetch_add(jobs.size(), std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	m_condition.notify_all();
+}
+
+bool JobSystem::TryRunJob(size_t threadIndex, bool canRunBackgroundJobs)
+{
+	QueuedJob queuedJob;
+
+	// Take the newest job of our own queue, otherwise steal the oldest job of another thread.
+	bool hasJob = TryPopJob(*m_queues[threadIndex], true, queuedJob);
+	for (size_t offset = 1; !hasJob && offset < m_queues.size(); ++offset)
+	{
+		hasJob = TryPopJob(*m_queues[(threadIndex + offset) % m_queues.size()], false, queuedJob);
+	}
+
+	// Only start a background job when no batch needs help.
+	if (!hasJob && canRunBackgroundJobs)
+	{
+		hasJob = TryPopJob(m_backgroundQueue, false, queuedJob);
+	}
+
+	if (!hasJob)
+	{
+		return false;
+	}
+
+	// Run the job, and report it as done to its batch.
+	queuedJob.Function();
+	queuedJob.PendingJobCount->fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+bool JobSystem::TryPopJob(WorkQueue& workQueue, bool isOwnQueue, QueuedJob& queuedJob)
+{
+	std::lock_guard<std::mutex> lock(workQueue.Mutex);
+	if (workQueue.Jobs.empty())
+	{
+		return false;
+	}
+
+	// The owner works on its most recent, cache warm, jobs while thieves take the oldest ones.
+	if (isOwnQueue)
+	{
+		queuedJob = std::move(workQueue.Jobs.back());
+		workQueue.Jobs.pop_back();
+	}
+	else
+	{
+		queuedJob = std::move(workQueue.Jobs.front());
+		workQueue.Jobs.pop_front();
+	}
+
+	m_queuedJobCount.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
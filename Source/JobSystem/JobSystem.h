@@ -0,0 +1,84 @@
+#pragma once
+#include "PCH.h"
+#include "Macros.h"
+
+using Job = std::function<void()>;
+
+constexpr size_t PARALLEL_FOR_BATCH_ALIGNMENT = 64;		// Batches over dense arrays hold a multiple of this many elements.
+constexpr size_t PARALLEL_FOR_SERIAL_THRESHOLD = 4096;	// Ranges smaller than this are not worth splitting by default.
+constexpr size_t PARALLEL_FOR_BATCHES_PER_THREAD = 4;	// Over-split ranges so faster threads can steal the remainder.
+
+// A pool of worker threads that run batches of jobs alongside the calling thread.
+// Every thread owns a queue, takes its newest jobs first, and steals the oldest jobs of other threads when idle.
+// Background jobs have a queue of their own that only workers take from, once no batch is left to help with.
+class JobSystem final
+{
+	SINGLETON(JobSystem);
+
+	struct QueuedJob
+	{
+		Job Function;
+		std::atomic<size_t>* PendingJobCount = nullptr;	// The counter of the batch the job belongs to.
+	};
+
+	struct WorkQueue
+	{
+		std::mutex Mutex;
+		std::deque<QueuedJob> Jobs;
+	};
+
+public:
+	void Initialize(size_t threadCount = 0);
+	void Shutdown();
+
+	void Execute(std::vector<Job>& jobs);
+	void Submit(std::vector<Job>& jobs, std::atomic<size_t>& pendingJobCount);
+	void Wait(std::atomic<size_t>& pendingJobCount);
+	template<typename TFunction> void ParallelFor(size_t count, size_t batchAlignment, TFunction function);
+
+	size_t GetWorkerCount() const { return m_workers.size(); }
+	size_t GetThreadCount() const { return m_workers.size() + 1; }
+	static size_t GetThreadIndex();
+
+private:
+	void WorkerLoop(size_t threadIndex);
+	void QueueJobs(WorkQueue& workQueue, std::vector<Job>& jobs, std::atomic<size_t>& pendingJobCount);
+	bool TryRunJob(size_t threadIndex, bool canRunBackgroundJobs);
+	bool TryPopJob(WorkQueue& workQueue, bool isOwnQueue, QueuedJob& queuedJob);
+
+private:
+	std::vector<std::thread> m_workers;					// The worker threads, the main thread is not included.
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;	// One queue per thread, indexed by thread index.
+	WorkQueue m_backgroundQueue;						// Jobs nobody waits on right away, run by idle workers in submission order.
+	std::atomic<size_t> m_queuedJobCount{ 0 };			// The number of jobs waiting across all queues.
+	std::mutex m_sleepMutex;							// Guards the running flag and sleeping on the condition.
+	std::condition_variable m_condition;				// Wakes sleeping workers when jobs are queued or the pool shuts down.
+	bool m_isRunning = false;
+};
+
+template<typename TFunction>
+inline void JobSystem::ParallelFor(size_t count, size_t batchAlignment, TFunction function)
+{
+	// Split the range in a few batches per thread, rounded up to a multiple of the batch alignment.
+	const size_t batchCount = GetThreadCount() * PARALLEL_FOR_BATCHES_PER_THREAD;
+	size_t batchSize = (count + batchCount - 1) / batchCount;
+	batchSize = std::max<size_t>(((batchSize + batchAlignment - 1) / batchAlignment) * batchAlignment, 1);
+
+	// A range that fits in one batch runs on the calling thread.
+	if (batchSize >= count)
+	{
+		function(size_t(0), count);
+		return;
+	}
+
+	// Hand every batch its own sub range.
+	std::vector<Job> jobs;
+	jobs.reserve((count + batchSize - 1) / batchSize);
+	for (size_t begin = 0; begin < count; begin += batchSize)
+	{
+		const size_t end = std::min(begin + batchSize, count);
+		jobs.push_back([&function, begin, end]() { function(begin, end); });
+	}
+
+	Execute(jobs);
+}
@@ -26,6 +26,24 @@
 		static CLASS& GetInstanceWrite() { return GetInstance(); } \
 	private:
 
+// Like SINGLETON, but the class can also be instantiated. The shared instance is the one the engine itself runs on.
+#define SHARED_INSTANCE(CLASS) \
+	NO_COPY(CLASS); \
+	NO_MOVE(CLASS); \
+	public: \
+		CLASS() = default; \
+		~CLASS() = default; \
+	private: \
+		static CLASS& GetInstance() \
+		{ \
+			static CLASS instance; \
+			return instance; \
+		} \
+	public: \
+		static const CLASS& GetInstanceRead() { return GetInstance(); } \
+		static CLASS& GetInstanceWrite() { return GetInstance(); } \
+	private:
+
 #define ENGINE_ASSERT(CONDITION, FORMAT, ...) \
 	if (!(CONDITION)) \
 	{ \
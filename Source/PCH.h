@@ -8,6 +8,8 @@
 #endif
 #endif
 
+// The ECS, event, and job code only needs the standard library, so it also builds off Windows, e.g. for the benchmarks.
+#if defined(_WIN32)
 #include <Windows.h>
 #include <wrl.h>		// ComPtr
 #include <comdef.h>		// COM error reporting.
@@ -15,19 +17,36 @@
 #include <rpcnterr.h>	// For UUID error check.
 #include <shlwapi.h>	// For StrStr function.
 #include <xmllite.h>	// For XML reader.
+#endif
 
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cwchar>
 
+#include <algorithm>
+#include <atomic>
 #include <bitset>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <unordered_map>
 #include <set>
 #include <stack>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#if defined(_WIN32)
 #include <d3d11.h>
 #include <dxgi.h>
 #include <d3dcompiler.h>
@@ -57,3 +76,4 @@ using namespace DirectX;
 #pragma comment(lib, "Rpcrt4.lib")	// For UUID generation.
 #pragma comment(lib, "Shlwapi.lib") // For StrStr function.
 #pragma comment(lib, "XmlLite.lib")	// For XML reader.
+#endif
@@ -1,6 +1,7 @@
 #include "PCH.h"
 #include "Components/Components.h"
 #include "Core/Core.h"
+#include "ECS/MortonCode.h"
 #include "ECS/Registry.h"
 #include "Macros.h"
 #include "MeshManager/MeshManager.h"
@@ -8,10 +9,14 @@
 #include "ShaderManager/ShaderManager.h"
 #include "Systems/PhysicsSystem.h"
 #include "Systems/GraphicsMeshRenderSystem.h"
+#include "Systems/TransformHierarchySystem.h"
 #include "Systems/UIRenderSystem.h"
 #include "TextureManager/TextureManager.h"
 #include "UIManager/UIManager.h"
 
+constexpr size_t SPATIAL_ORDER_UPDATE_INTERVAL = 120;	// The number of updates between reordering the component storage by position.
+constexpr float SPATIAL_ORDER_CELL_SIZE = 1.0f;			// The size of the grid cells positions are quantized to before ordering.
+
 Scene::Scene(const wchar_t* filePath)
 {
 	// Create the lookup table that maps node string names to scene parse states.
@@ -28,6 +33,18 @@ void Scene::Update(float deltaTime)
 {
 	static Registry& registry = Registry::GetInstanceWrite();
 	registry.RunSystemsUpdate(deltaTime);
+
+	// Every so often reorder the component storage by position, so entities close in space are close in memory for culling
+	// and proximity passes. The order is sorted in the background and applied at the start of a later update.
+	static size_t updateCount = 0;
+	if (++updateCount % SPATIAL_ORDER_UPDATE_INTERVAL == 0)
+	{
+		registry.RequestComponentOrder<TransformComponent>([](const TransformComponent& transformComponent)
+		{
+			const XMFLOAT4X4A& transform = transformComponent.Transform;
+			return GetMortonCode(transform._41, transform._42, transform._43, SPATIAL_ORDER_CELL_SIZE);
+		});
+	}
 }
 
 void Scene::Render()
@@ -372,9 +389,16 @@ void Scene::ProcessSystemNode(const Node& node)
 	if (_wcsicmp(node.textValues.value, L"GraphicsMeshRenderSystem") == 0)
 		registry.AddSystem<GraphicsMeshRenderSystem>();
 	else if (_wcsicmp(node.textValues.value, L"PhysicsSystem") == 0)
+	{
 		registry.AddSystem<PhysicsSystem>();
+
+		// Keep transforms and physics co-sorted, so the physics update walks both arrays in lockstep.
+		registry.AddGroup<TransformComponent, PhysicsComponent>();
+	}
 	else if (_wcsicmp(node.textValues.value, L"UIRenderSystem") == 0)
 		registry.AddSystem<UIRenderSystem>();
+	else if (_wcsicmp(node.textValues.value, L"TransformHierarchySystem") == 0)
+		registry.AddSystem<TransformHierarchySystem>();
 }
 
 void Scene::ProcessEntityNode()
@@ -392,7 +416,7 @@ void Scene::ProcessTransfromComponentNode(const Node& node)
 	TransformComponent transformComponent = { };
 
 	// Retrieve the SIMD entity transform matrix.
-	XMMATRIX transform = XMLoadFloat4x4(&transformComponent.Transform);
+	XMMATRIX transform = XMLoadFloat4x4A(&transformComponent.Transform);
 
 	// Retrieve the local space scale factors.
 	const float xScale = std::stof(node.attributes[6].value);
@@ -424,7 +448,7 @@ void Scene::ProcessTransfromComponentNode(const Node& node)
 
 	// Apply the transformations to the entity transform.
 	transform *= scaleMatrix * rotationMatrix * translationMatrix;
-	XMStoreFloat4x4(&transformComponent.Transform, transform);
+	XMStoreFloat4x4A(&transformComponent.Transform, transform);
 
 	// Add the transform component to the entity.
 	Registry& registry = Registry::GetInstanceWrite();
@@ -452,9 +476,9 @@ void Scene::ProcessGraphicsMeshComponentNode(const Node& node)
 		graphicsMeshComponent.BlendTextureName = node.attributes[3].value;
 	}
 
-	// Add the graphics mesh component to the entity.
+	// Add the graphics mesh component to the entity, sharing one value between every entity drawn the same way.
 	Registry& registry = Registry::GetInstanceWrite();
-	registry.AddComponent<GraphicsMeshComponent>(m_lastProcessedEntity, graphicsMeshComponent);
+	registry.AddSharedComponent<GraphicsMeshComponent>(m_lastProcessedEntity, graphicsMeshComponent);
 }
 
 void Scene::ProcessPhysicsComponentNode(const Node& node)
@@ -89,6 +89,6 @@ private:
 	SceneReader m_sceneReader;
 	ParseState m_parseState = ParseState::NONE;
 
-	size_t m_lastProcessedEntity = 0;
+	Entity m_lastProcessedEntity = INVALID_ENTITY;
 };
 
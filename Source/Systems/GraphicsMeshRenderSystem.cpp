@@ -12,7 +12,7 @@ GraphicsMeshRenderSystem::GraphicsMeshRenderSystem(Registry& registry)
 	: ISystem::ISystem(registry)
 {
 	RequireComponent<TransformComponent>();
-	RequireComponent<GraphicsMeshComponent>();
+	RequireComponent<SharedComponent<GraphicsMeshComponent>>();
 }
 
 void GraphicsMeshRenderSystem::Render()
@@ -28,47 +28,43 @@ void GraphicsMeshRenderSystem::Render()
 	const ShaderManager& shaderManager = ShaderManager::GetInstanceRead();
 	const TextureManager& textureManager = TextureManager::GetInstanceRead();
 
-	for (const Entity entity : m_entities)
+	// Draw the entities in groups sharing one graphics mesh component, so the graphics data is only looked up once per group.
+	m_registry.ForEachSharedComponentGroup<GraphicsMeshComponent, TransformComponent>([&](const GraphicsMeshComponent& graphicsMeshComponent, const Entity* entities, size_t count)
 	{
-		// Retrieve the relevant components.
-		const TransformComponent& transformComponent = m_registry.GetComponentRead<TransformComponent>(entity);
-		const GraphicsMeshComponent& graphicsMeshComponent = m_registry.GetComponentRead<GraphicsMeshComponent>(entity);
-
 		// Retrieve the relevant graphics data.
 		const MeshData& meshData = meshManager.GetMeshDataRead(graphicsMeshComponent.MeshName);
 		const ShaderData& shaderData = shaderManager.GetShaderDataRead(graphicsMeshComponent.ShaderName);
 
-		// Update the GPU constant buffer with the entity model/world matrix.
-		renderer.UpdatePerMeshConstantBuffer(transformComponent.Transform);
+		// Retrieve the texture data referencing the textures the meshes should be drawn with, if any.
+		const TextureData* textureData = graphicsMeshComponent.TextureName ? &textureManager.GetTextureDataRead(graphicsMeshComponent.TextureName) : nullptr;
+		const TextureData* blendTextureData = graphicsMeshComponent.BlendTextureName ? &textureManager.GetTextureDataRead(graphicsMeshComponent.BlendTextureName) : nullptr;
 
 		// Disable any color blending when drawing a regular 3D mesh.
 		renderer.DisableBlending();
 
-		// 
-		if (graphicsMeshComponent.TextureName && graphicsMeshComponent.BlendTextureName)
+		for (size_t index = 0; index < count; ++index)
 		{
-			const TextureData& textureData = textureManager.GetTextureDataRead(graphicsMeshComponent.TextureName);
-			const TextureData& blendTextureData = textureManager.GetTextureDataRead(graphicsMeshComponent.BlendTextureName);
+			// Update the GPU constant buffer with the entity model/world matrix.
+			const TransformComponent& transformComponent = m_registry.GetComponentRead<TransformComponent>(entities[index]);
+			renderer.UpdatePerMeshConstantBuffer(transformComponent.Transform);
 
-			// Draw the mesh using the relevant mesh data.
-			renderer.DrawMesh(&meshData, &shaderData, &textureData, &blendTextureData);
-		}
+			// Draw the mesh with both textures if it blends them.
+			if (textureData && blendTextureData)
+			{
+				renderer.DrawMesh(&meshData, &shaderData, textureData, blendTextureData);
+			}
 
-		// If the mesh has a texture, draw it with the specified texture.
-		else if (graphicsMeshComponent.TextureName)
-		{
-			// Retrieve the texture data referencing the texture the mesh should be drawn with.
-			const TextureData& textureData = textureManager.GetTextureDataRead(graphicsMeshComponent.TextureName);
+			// If the mesh has a texture, draw it with the specified texture.
+			else if (textureData)
+			{
+				renderer.DrawMesh(&meshData, &shaderData, textureData);
+			}
 
-			// Draw the mesh using the relevant mesh data.
-			renderer.DrawMesh(&meshData, &shaderData, &textureData);
+			// Otherwise draw the mesh without a texture.
+			else
+			{
+				renderer.DrawMesh(&meshData, &shaderData);
+			}
 		}
-
-		// Otherwise draw the mesh without a texture.
-		else
-		{
-			renderer.DrawMesh(&meshData, &shaderData);
-		}
-	}
+	});
 }
-
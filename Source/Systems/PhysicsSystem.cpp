@@ -6,17 +6,17 @@
 PhysicsSystem::PhysicsSystem(Registry& registry)
 	: ISystem::ISystem(registry)
 {
-	RequireComponent<TransformComponent>();
-	RequireComponent<PhysicsComponent>();
+	RequireWrite<TransformComponent>();
+	RequireRead<PhysicsComponent>();
 }
 
 void PhysicsSystem::Update(float deltaTime)
 {
-	for (const Entity entity : m_entities)
+	// Every entity is integrated independently, so spread them over all threads.
+	m_registry.View<TransformComponent, const PhysicsComponent>().ParallelEach([deltaTime](Entity entity, TransformComponent& transformComponent, const PhysicsComponent& physicsComponent)
 	{
-		// Retrieve the relevant components for physics update.
-		TransformComponent& transformComponent = m_registry.GetComponentWrite<TransformComponent>(entity);
-		const PhysicsComponent& physicsComponent = m_registry.GetComponentRead<PhysicsComponent>(entity);
+		// Load the transform once, both updates work on the registers and it is stored back once at the end.
+		XMMATRIX transform = XMLoadFloat4x4A(&transformComponent.Transform);
 
 		// Rotation Update.
 		{
@@ -25,18 +25,14 @@ void PhysicsSystem::Update(float deltaTime)
 			const float yaw = XMConvertToRadians(physicsComponent.AngularVelocity.y * deltaTime);
 			const float roll = XMConvertToRadians(physicsComponent.AngularVelocity.z * deltaTime);
 
-			const float xPosition = transformComponent.Transform._41;
-			const float yPosition = transformComponent.Transform._42;
-			const float zPosition = transformComponent.Transform._43;
-
-			const XMMATRIX localSpace = XMMatrixTranslation(-xPosition, -yPosition, -zPosition);
+			// Rotate about the entity position, held in the last row of the transform.
+			const XMVECTOR position = transform.r[3];
+			const XMMATRIX localSpace = XMMatrixTranslationFromVector(XMVectorNegate(position));
 			const XMMATRIX rotationMatrix = XMMatrixRotationRollPitchYaw(pitch, yaw, roll);
-			const XMMATRIX worldSpace = XMMatrixTranslation(xPosition, yPosition, zPosition);
+			const XMMATRIX worldSpace = XMMatrixTranslationFromVector(position);
 
-			// Update the transform component's rotation.
-			XMMATRIX transform = XMLoadFloat4x4(&transformComponent.Transform);
+			// Update the transform's rotation.
 			transform *= localSpace * rotationMatrix * worldSpace;
-			XMStoreFloat4x4(&transformComponent.Transform, transform);
 		}
 
 		// Translation Update.
@@ -49,10 +45,11 @@ void PhysicsSystem::Update(float deltaTime)
 			// Construct the translation matrix.
 			const XMMATRIX translationMatrix = XMMatrixTranslation(xTranslation, yTranslation, zTranslation);
 
-			// Update the transform component's translation.
-			XMMATRIX transform = XMLoadFloat4x4(&transformComponent.Transform);
+			// Update the transform's translation.
 			transform *= translationMatrix;
-			XMStoreFloat4x4(&transformComponent.Transform, transform);
 		}
-	}
+
+		// Store the transform back once.
+		XMStoreFloat4x4A(&transformComponent.Transform, transform);
+	});
 }
@@ -0,0 +1,330 @@
+#include "PCH.h"
+#include "Components/Components.h"
+#include "ECS/Registry.h"
+#include "JobSystem/JobSystem.h"
+#include "TransformHierarchySystem.h"
+
+static void StoreLocalMatrix(const LocalTransformComponent& localTransformComponent, XMFLOAT4X4A& localMatrix)
+{
+	// Scale, then rotate, then translate, about the local origin.
+	const XMMATRIX matrix = XMMatrixAffineTransformation(
+		XMLoadFloat3(&localTransformComponent.Scale),
+		XMVectorZero(),
+		XMLoadFloat4(&localTransformComponent.Rotation),
+		XMLoadFloat3(&localTransformComponent.Position)
+	);
+
+	XMStoreFloat4x4A(&localMatrix, matrix);
+}
+
+TransformHierarchySystem::TransformHierarchySystem(Registry& registry)
+	: ISystem::ISystem(registry)
+{
+	RequireRead<LocalTransformComponent>();
+	RequireWrite<TransformComponent>();
+}
+
+void TransformHierarchySystem::Update(float deltaTime)
+{
+	// Rebuild the breadth first order when entities joined or left the hierarchy, or were attached to a new parent.
+	if (GetMembershipVersion() != m_builtMembershipVersion || MarkChangedNodes())
+	{
+		RebuildHierarchy();
+	}
+
+	// A hierarchy without changes has nothing to propagate.
+	if (m_changedNodes.empty())
+	{
+		return;
+	}
+
+	// Changed nodes are found in view order, merge them into the dirty ranges in node order.
+	std::sort(m_changedNodes.begin(), m_changedNodes.end());
+
+	// Walk the levels top down, the nodes of a level only read the world matrices of the level above.
+	JobSystem& jobSystem = JobSystem::GetInstanceWrite();
+	std::vector<NodeRange> parentRanges;
+	std::vector<NodeRange> levelRanges;
+	size_t changedNode = 0;
+	m_dirtyRanges.clear();
+	for (size_t level = 0; level + 1 < m_levelOffsets.size(); ++level)
+	{
+		// Stop at the first level below every change.
+		GatherDirtyRanges(parentRanges, m_levelOffsets[level + 1], changedNode, levelRanges);
+		if (levelRanges.empty() && changedNode == m_changedNodes.size())
+		{
+			break;
+		}
+
+		for (const NodeRange& range : levelRanges)
+		{
+			// Small ranges are cheaper to walk on the calling thread.
+			const size_t beginNode = range.first;
+			if (range.second - beginNode < PARALLEL_FOR_SERIAL_THRESHOLD)
+			{
+				PropagateRange(beginNode, range.second);
+				continue;
+			}
+
+			jobSystem.ParallelFor(range.second - beginNode, PARALLEL_FOR_BATCH_ALIGNMENT, [this, beginNode](size_t begin, size_t end)
+			{
+				PropagateRange(beginNode + begin, beginNode + end);
+			});
+		}
+
+		m_dirtyRanges.insert(m_dirtyRanges.end(), levelRanges.begin(), levelRanges.end());
+		std::swap(parentRanges, levelRanges);
+	}
+
+	// Write only the recomputed world matrices back to their transform components.
+	for (const NodeRange& range : m_dirtyRanges)
+	{
+		for (size_t node = range.first; node < range.second; ++node)
+		{
+			m_registry.GetComponentWrite<TransformComponent>(m_nodes[node]).Transform = m_worldMatrices[node];
+		}
+	}
+
+	m_changedNodes.clear();
+}
+
+void TransformHierarchySystem::RebuildHierarchy()
+{
+	const size_t memberCount = m_entities.size();
+
+	// Map every member entity index to its position in the member list.
+	size_t maxEntityIndex = 0;
+	for (const Entity entity : m_entities)
+	{
+		maxEntityIndex = std::max<size_t>(maxEntityIndex, GetEntityIndex(entity));
+	}
+
+	std::vector<size_t> memberIndices(maxEntityIndex + 1, INVALID_INDEX);
+	for (size_t member = 0; member < memberCount; ++member)
+	{
+		memberIndices[GetEntityIndex(m_entities[member])] = member;
+	}
+
+	// Find every member's parent member. Members attached to an entity outside the hierarchy are roots.
+	std::vector<Entity> memberParents(memberCount);
+	std::vector<size_t> parentMembers(memberCount, INVALID_INDEX);
+	std::vector<size_t> childOffsets(memberCount + 1, 0);
+	for (size_t member = 0; member < memberCount; ++member)
+	{
+		const Entity parent = m_registry.GetComponentRead<LocalTransformComponent>(m_entities[member]).Parent;
+		memberParents[member] = parent;
+
+		const size_t parentEntityIndex = GetEntityIndex(parent);
+		if (parent != INVALID_ENTITY && parentEntityIndex <= maxEntityIndex && memberIndices[parentEntityIndex] != INVALID_INDEX && m_entities[memberIndices[parentEntityIndex]] == parent)
+		{
+			parentMembers[member] = memberIndices[parentEntityIndex];
+		}
+	}
+
+	// Break every parent cycle, so every member is reachable from a root. Walk up the parents of every member not walked yet,
+	// a walk coming back to a member of the same walk closed a cycle, and that member becomes a root.
+	std::vector<uint8_t> walkStates(memberCount, 0);	// Zero before a member is walked, one during its walk, two after.
+	std::vector<size_t> walk;
+	for (size_t member = 0; member < memberCount; ++member)
+	{
+		size_t walkMember = member;
+		while (walkMember != INVALID_INDEX && walkStates[walkMember] == 0)
+		{
+			walkStates[walkMember] = 1;
+			walk.push_back(walkMember);
+			walkMember = parentMembers[walkMember];
+		}
+
+		if (walkMember != INVALID_INDEX && walkStates[walkMember] == 1)
+		{
+			parentMembers[walkMember] = INVALID_INDEX;
+		}
+
+		for (const size_t walkedMember : walk)
+		{
+			walkStates[walkedMember] = 2;
+		}
+
+		walk.clear();
+	}
+
+	// Lay the children of every member out contiguously.
+	for (size_t member = 0; member < memberCount; ++member)
+	{
+		if (parentMembers[member] != INVALID_INDEX)
+		{
+			++childOffsets[parentMembers[member] + 1];
+		}
+	}
+
+	for (size_t member = 0; member < memberCount; ++member)
+	{
+		childOffsets[member + 1] += childOffsets[member];
+	}
+
+	std::vector<size_t> children(childOffsets[memberCount]);
+	std::vector<size_t> childCounts(memberCount, 0);
+	for (size_t member = 0; member < memberCount; ++member)
+	{
+		if (parentMembers[member] != INVALID_INDEX)
+		{
+			const size_t parentMember = parentMembers[member];
+			children[childOffsets[parentMember] + childCounts[parentMember]++] = member;
+		}
+	}
+
+	// Order the members breadth first, the roots forming the first level.
+	std::vector<size_t> order;
+	order.reserve(memberCount);
+	for (size_t member = 0; member < memberCount; ++member)
+	{
+		if (parentMembers[member] == INVALID_INDEX)
+		{
+			order.push_back(member);
+		}
+	}
+
+	m_levelOffsets.assign(1, 0);
+	m_childOffsets.assign(memberCount + 1, 0);
+	for (size_t levelBegin = 0; levelBegin < order.size();)
+	{
+		// Append the children of the current level, they form the next level. The node at an order index starts its children
+		// where the order ends, so the children of consecutive nodes are consecutive too.
+		const size_t levelEnd = order.size();
+		for (size_t index = levelBegin; index < levelEnd; ++index)
+		{
+			const size_t member = order[index];
+			m_childOffsets[index] = order.size();
+			order.insert(order.end(), children.begin() + childOffsets[member], children.begin() + childOffsets[member + 1]);
+		}
+
+		m_levelOffsets.push_back(levelEnd);
+		levelBegin = levelEnd;
+	}
+
+	// With every cycle broken, every member is reached from a root.
+	const size_t nodeCount = order.size();
+	assert(nodeCount == memberCount);
+	m_childOffsets.resize(nodeCount + 1);
+	m_childOffsets[nodeCount] = nodeCount;
+
+	// Store the nodes in breadth first order.
+	m_nodes.resize(nodeCount);
+	m_nodeParents.resize(nodeCount);
+	m_parentNodes.resize(nodeCount);
+	m_localMatrices.resize(nodeCount);
+	m_worldMatrices.resize(nodeCount);
+	m_nodeIndices.assign(maxEntityIndex + 1, INVALID_INDEX);
+
+	for (size_t node = 0; node < order.size(); ++node)
+	{
+		m_nodes[node] = m_entities[order[node]];
+		m_nodeParents[node] = memberParents[order[node]];
+		m_nodeIndices[GetEntityIndex(m_nodes[node])] = node;
+		StoreLocalMatrix(m_registry.GetComponentRead<LocalTransformComponent>(m_nodes[node]), m_localMatrices[node]);
+	}
+
+	// Parents always come before their children, so their nodes are known by now.
+	for (size_t node = 0; node < order.size(); ++node)
+	{
+		const size_t parentMember = parentMembers[order[node]];
+		m_parentNodes[node] = parentMember == INVALID_INDEX ? INVALID_INDEX : m_nodeIndices[GetEntityIndex(m_entities[parentMember])];
+	}
+
+	// Mark every root changed, so the whole hierarchy is propagated. Changes found before the rebuild named the old nodes.
+	const size_t rootCount = m_levelOffsets.size() > 1 ? m_levelOffsets[1] : 0;
+	m_changedNodes.resize(rootCount);
+	for (size_t node = 0; node < rootCount; ++node)
+	{
+		m_changedNodes[node] = node;
+	}
+
+	m_builtMembershipVersion = GetMembershipVersion();
+}
+
+bool TransformHierarchySystem::MarkChangedNodes()
+{
+	bool isReparented = false;
+
+	// Only local transforms written since the last update need their local matrix recomputed.
+	m_registry.View<const LocalTransformComponent>().Changed<LocalTransformComponent>(GetLastUpdateTick()).Each([this, &isReparented](Entity entity, const LocalTransformComponent& localTransformComponent)
+	{
+		// Entities without a world transform are not part of the hierarchy.
+		const size_t entityIndex = GetEntityIndex(entity);
+		if (entityIndex >= m_nodeIndices.size() || m_nodeIndices[entityIndex] == INVALID_INDEX)
+		{
+			return;
+		}
+
+		// A new parent changes the breadth first order, which the caller rebuilds from scratch.
+		const size_t node = m_nodeIndices[entityIndex];
+		if (localTransformComponent.Parent != m_nodeParents[node])
+		{
+			isReparented = true;
+			return;
+		}
+
+		StoreLocalMatrix(localTransformComponent, m_localMatrices[node]);
+		m_changedNodes.push_back(node);
+	});
+
+	return isReparented;
+}
+
+void TransformHierarchySystem::GatherDirtyRanges(const std::vector<NodeRange>& parentRanges, size_t levelEnd, size_t& changedNode, std::vector<NodeRange>& levelRanges) const
+{
+	// The children of the dirty ranges of the level above are dirty, and so are the changed nodes of this level. Both come
+	// in node order, merge them, and join ranges that touch.
+	levelRanges.clear();
+	size_t parentRange = 0;
+	while (true)
+	{
+		const bool hasChangedNode = changedNode < m_changedNodes.size() && m_changedNodes[changedNode] < levelEnd;
+		if (!hasChangedNode && parentRange == parentRanges.size())
+		{
+			break;
+		}
+
+		NodeRange range;
+		if (hasChangedNode && (parentRange == parentRanges.size() || m_changedNodes[changedNode] < m_childOffsets[parentRanges[parentRange].first]))
+		{
+			range = NodeRange(m_changedNodes[changedNode], m_changedNodes[changedNode] + 1);
+			++changedNode;
+		}
+		else
+		{
+			range = NodeRange(m_childOffsets[parentRanges[parentRange].first], m_childOffsets[parentRanges[parentRange].second]);
+			++parentRange;
+		}
+
+		if (range.first == range.second)
+		{
+			continue;
+		}
+
+		if (!levelRanges.empty() && range.first <= levelRanges.back().second)
+		{
+			levelRanges.back().second = std::max(levelRanges.back().second, range.second);
+		}
+		else
+		{
+			levelRanges.push_back(range);
+		}
+	}
+}
+
+void TransformHierarchySystem::PropagateRange(size_t beginNode, size_t endNode)
+{
+	for (size_t node = beginNode; node < endNode; ++node)
+	{
+		// Roots are placed by their local matrix alone, children relative to their parent's world matrix.
+		const size_t parentNode = m_parentNodes[node];
+		XMMATRIX worldMatrix = XMLoadFloat4x4A(&m_localMatrices[node]);
+		if (parentNode != INVALID_INDEX)
+		{
+			worldMatrix = XMMatrixMultiply(worldMatrix, XMLoadFloat4x4A(&m_worldMatrices[parentNode]));
+		}
+
+		XMStoreFloat4x4A(&m_worldMatrices[node], worldMatrix);
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "ECS/AlignedAllocator.h"
+#include "ECS/System.h"
+
+// Propagates local transforms down the parent child hierarchy into world transforms. Nodes are kept breadth first sorted
+// in contiguous arrays, so every depth level only depends on the levels before it and can be split across threads.
+// The descendants of a node form one contiguous range per level, so only the ranges below changed local transforms are
+// recomputed and written back.
+class TransformHierarchySystem final : public ISystem
+{
+public:
+	TransformHierarchySystem(Registry& registry);
+	~TransformHierarchySystem() = default;
+
+	// Inherited via ISystem.
+	void Initialize() override {}
+	void Update(float deltaTime) override;
+	void Render() override {}
+
+private:
+	using NodeRange = std::pair<size_t, size_t>;
+
+	void RebuildHierarchy();
+	bool MarkChangedNodes();
+	void GatherDirtyRanges(const std::vector<NodeRange>& parentRanges, size_t levelEnd, size_t& changedNode, std::vector<NodeRange>& levelRanges) const;
+	void PropagateRange(size_t beginNode, size_t endNode);
+
+private:
+	std::vector<Entity> m_nodes;				// The hierarchy members in breadth first order.
+	std::vector<Entity> m_nodeParents;			// The parent entity every node was sorted under.
+	std::vector<size_t> m_parentNodes;			// The node of every node's parent, or INVALID_INDEX for roots.
+	std::vector<size_t> m_childOffsets;			// The first child node of every node, followed by the node count.
+	std::vector<size_t> m_nodeIndices;			// Maps an entity index to its node, or INVALID_INDEX if not a member.
+	std::vector<size_t> m_levelOffsets;			// The first node of every depth level, followed by the node count.
+	AlignedVector<XMFLOAT4X4A> m_localMatrices;	// The local matrix of every node.
+	AlignedVector<XMFLOAT4X4A> m_worldMatrices;	// The cached world matrix of every node.
+	std::vector<size_t> m_changedNodes;			// The nodes whose own local matrix changed this update.
+	std::vector<NodeRange> m_dirtyRanges;		// The node ranges whose world matrix was recomputed this update.
+	size_t m_builtMembershipVersion = SIZE_MAX;	// The system membership version the hierarchy was built from.
+};
@@ -7,22 +7,21 @@
 #include "UIManager/UIManager.h"
 #include "UIRenderSystem.h"
 
-static bool MoveToBottomLeft(Entity avgFPSEntity)
+static bool MoveToBottomLeft(Registry& registry, Entity avgFPSEntity)
 {
 	// Retrieve the window dimensions to translate the ui entity.
 	const Window& window = Window::GetInstanceRead();
 	const float xTranslation = window.GetClientWidth() / 2.0f;
 	const float yTranslation = window.GetClientHeight() / 2.0f;
 
-	// Retrieve the ui entity transform for updating.
-	Registry& registry = Registry::GetInstanceWrite();
+	// Retrieve the ui entity transform for updating, from the world the system belongs to.
 	TransformComponent& transformComponent = registry.GetComponentWrite<TransformComponent>(avgFPSEntity);
 	
 	// Apply the translation to the entity transform.
 	const XMMATRIX translation = XMMatrixTranslation(-xTranslation, -yTranslation, 0.0f);
-	XMMATRIX transform = XMLoadFloat4x4(&transformComponent.Transform);
+	XMMATRIX transform = XMLoadFloat4x4A(&transformComponent.Transform);
 	transform *= translation;
-	XMStoreFloat4x4(&transformComponent.Transform, transform);
+	XMStoreFloat4x4A(&transformComponent.Transform, transform);
 
 	// Dummy return value.
 	return true;
@@ -44,7 +43,7 @@ void UIRenderSystem::Update(float deltaTime)
 	static const UIComponent& uiComponent = m_registry.GetComponentRead<UIComponent>(avgFPSEntity);
 
 	// Move the ui element to the bottom left of the window.
-	static bool runOnce = MoveToBottomLeft(avgFPSEntity);
+	static bool runOnce = MoveToBottomLeft(m_registry, avgFPSEntity);
 
 	// Recreate the ui element mesh based on the new average fps value.
 	const std::wstring averageFPS = L"Average FPS: " + std::to_wstring(engine.GetAverageFPS());
@@ -59,12 +58,8 @@ void UIRenderSystem::Render()
 	static UIManager& uiManager = UIManager::GetInstanceWrite();
 	static Renderer& renderer = Renderer::GetInstanceWrite();
 
-	for (const Entity entity : m_entities)
+	m_registry.View<const TransformComponent, const UIComponent>().Each([](Entity entity, const TransformComponent& transformComponent, const UIComponent& uiComponent)
 	{
-		// Retrieve the relevant components to query for data relevant for rendering.
-		const TransformComponent& transformComponent = m_registry.GetComponentRead<TransformComponent>(entity);
-		const UIComponent& uiComponent = m_registry.GetComponentRead<UIComponent>(entity);
-
 		// Retrieve the relevant shader, texture, and ui data to render the ui element.
 		const ShaderData& shaderData = shaderManager.GetShaderDataRead(uiComponent.ShaderName);
 		const TextureData& textureData = textureManager.GetTextureDataRead(uiComponent.TextureName);
@@ -81,5 +76,5 @@ void UIRenderSystem::Render()
 
 		// Draw the ui element.
 		renderer.DrawUI(&uiData.Mesh, &shaderData, &textureData);
-	}
+	});
 }
@@ -0,0 +1,104 @@
+#pragma once
+#include "PCH.h"
+
+using TypeHash = uint64_t;	// Identifies a type by its name, the same in every run of a build.
+
+constexpr TypeHash TYPE_HASH_OFFSET_BASIS = 14695981039346656037ull;	// The 64 bit FNV-1a offset basis.
+constexpr TypeHash TYPE_HASH_PRIME = 1099511628211ull;					// The 64 bit FNV-1a prime.
+
+// Hashes a null terminated string with 64 bit FNV-1a, at compile time when given a constant.
+inline constexpr TypeHash HashTypeName(const char* name)
+{
+	TypeHash hash = TYPE_HASH_OFFSET_BASIS;
+	while (*name != '\0')
+	{
+		hash = (hash ^ static_cast<unsigned char>(*name++)) * TYPE_HASH_PRIME;
+	}
+
+	return hash;
+}
+
+// Hashes the signature of this function, which spells out the full name of the type it was instantiated for.
+template<typename TType>
+inline constexpr TypeHash GetTypeHash()
+{
+#if defined(_MSC_VER)
+	return HashTypeName(__FUNCSIG__);
+#else
+	return HashTypeName(__PRETTY_FUNCTION__);
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------
+
+// Hands out dense ids for type hashes. Every type registers its hash, and where to store its id, during static
+// initialization. Publishing sorts the registered hashes and writes every id, so ids follow hash order and only depend on the
+// set of types in the build, and looking an id up afterwards is a plain load. A type registering after the ids were published,
+// e.g. from a library loaded later, takes the next free id right away.
+class TypeIdTable final
+{
+	struct Registration
+	{
+		TypeHash Hash;
+		size_t* Id;		// Where the type's id is published to.
+	};
+
+public:
+	bool Register(TypeHash typeHash, size_t* id);
+	void Publish();
+	const std::vector<TypeHash>& GetHashes();
+
+private:
+	std::mutex m_mutex;							// Libraries may register types while ids are being published.
+	std::vector<Registration> m_registrations;	// The types registered before the ids were published.
+	std::vector<TypeHash> m_hashes;				// The hash of every published type, indexed by id.
+	bool m_isPublished = false;
+};
+
+inline bool TypeIdTable::Register(TypeHash typeHash, size_t* id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Every type registers once, so a hash seen before means two types collided.
+	assert(std::find(m_hashes.begin(), m_hashes.end(), typeHash) == m_hashes.end());
+	assert(std::find_if(m_registrations.begin(), m_registrations.end(), [typeHash](const Registration& registration) { return registration.Hash == typeHash; }) == m_registrations.end());
+
+	// Once published, ids never move, so a late type takes the next one.
+	if (m_isPublished)
+	{
+		*id = m_hashes.size();
+		m_hashes.push_back(typeHash);
+		return true;
+	}
+
+	m_registrations.push_back({ typeHash, id });
+	return true;
+}
+
+inline void TypeIdTable::Publish()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_isPublished)
+	{
+		return;
+	}
+
+	// The id of every type is its position in hash order.
+	std::sort(m_registrations.begin(), m_registrations.end(), [](const Registration& left, const Registration& right) { return left.Hash < right.Hash; });
+	for (const Registration& registration : m_registrations)
+	{
+		*registration.Id = m_hashes.size();
+		m_hashes.push_back(registration.Hash);
+	}
+
+	m_registrations.clear();
+	m_registrations.shrink_to_fit();
+	m_isPublished = true;
+}
+
+inline const std::vector<TypeHash>& TypeIdTable::GetHashes()
+{
+	// The hashes are only indexed by id once the ids are published.
+	Publish();
+	return m_hashes;
+}